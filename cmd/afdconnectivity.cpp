@@ -137,7 +137,7 @@ class AFDConnectivity : public DWI::Tractography::SIFT::ModelBase<Fixel>
         fmls.reset (new DWI::FMLS::Segmenter (dirs, Math::SH::LforN (fod_buffer.size (3))));
       }
       mapper.set_upsample_ratio (DWI::Tractography::Mapping::determine_upsample_ratio (fod_buffer, tck_path, 0.1));
-      mapper.set_use_precise_mapping (true);
+      mapper.set_use_precise_or_exact_mapping();
     }
 
 
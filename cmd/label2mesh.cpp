@@ -128,7 +128,7 @@ void run ()
       if (blocky)
         MR::Surface::Algo::image2mesh_blocky (scratch, meshes[in]);
       else
-        MR::Surface::Algo::image2mesh_mc (scratch, meshes[in], 0.5);
+        MR::Surface::Algo::image2mesh_mc (scratch, meshes[in], 0.5, false);
       std::lock_guard<std::mutex> lock (mutex);
       ++progress;
       return true;
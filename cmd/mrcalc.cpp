@@ -186,6 +186,7 @@ UNARY_OP (atanh, "atanh (%1)", NORMAL, "inverse hyperbolic tangent", { return st
 #include "math/rng.h"
 #include "algo/threaded_copy.h"
 #include "dwi/gradient.h"
+#include "image_io/pipe.h"
 
 using namespace MR;
 using namespace App;
@@ -295,9 +296,18 @@ class ThreadLocalStorage : public vector<ThreadLocalStorageItem> { NOMEMALIGN
           if (image.size(n) > 1)
             image.index(n) = iter->index(n);
 
+        // read whole rows at once where possible:
+        const bool by_row = axes[0] < image.ndim() && image.size (axes[0]) > 1;
+
         size_t n = 0;
         for (size_t y = 0; y < size[1]; ++y) {
           if (axes[1] < image.ndim()) if (image.size (axes[1]) > 1) image.index(axes[1]) = y;
+          if (by_row) {
+            image.index(axes[0]) = 0;
+            image.get_row (axes[0], &chunk[n], size[0]);
+            n += size[0];
+            continue;
+          }
           for (size_t x = 0; x < size[0]; ++x) {
             if (axes[0] < image.ndim()) if (image.size (axes[0]) > 1) image.index(axes[0]) = x;
             chunk[n++] = image.value();
@@ -781,9 +791,12 @@ class ThreadFunctor { NOMEMALIGN
 
       Chunk& chunk = top_entry.evaluate (storage);
 
-      auto value = chunk.cbegin();
-      for (auto l = loop (image); l; ++l)
-        image.value() = *(value++);
+      const complex_type* value = &chunk[0];
+      for (size_t y = 0; y < storage.size[1]; ++y, value += storage.size[0]) {
+        image.index (storage.axes[1]) = y;
+        image.index (storage.axes[0]) = 0;
+        image.set_row (storage.axes[0], value, storage.size[0]);
+      }
     }
 
 
@@ -900,6 +913,9 @@ class OpTernary : public OpBase { NOMEMALIGN
  **********************************************************************/
 
 void run () {
+  // each output voxel is written exactly once, row by row:
+  ImageIO::Pipe::stream_piped_images = true;
+
   vector<StackEntry> stack;
 
   for (int n = 1; n < App::argc; ++n) {
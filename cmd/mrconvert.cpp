@@ -26,6 +26,7 @@
 #include "adapter/permute_axes.h"
 #include "file/json_utils.h"
 #include "file/ofstream.h"
+#include "image_io/pipe.h"
 #include "dwi/gradient.h"
 
 
@@ -385,6 +386,9 @@ void extract (Header& header_in, Header& header_out, const vector<vector<uint32_
 
 void run ()
 {
+  // output is written in a single pass via threaded_copy():
+  ImageIO::Pipe::stream_piped_images = true;
+
   Header header_in = Header::open (argument[0]);
   Eigen::MatrixXd dw_scheme;
   try {
@@ -553,6 +557,13 @@ void run ()
 
     }
   }
+  else if ((header_out.datatype()() & DataType::Type) == DataType::Float32) {
+    // conversion to single precision is exact via single-precision intermediates:
+    if (header_out.datatype().is_complex())
+      extract<cfloat> (header_in, header_out, pos, argument[1]);
+    else
+      extract<float> (header_in, header_out, pos, argument[1]);
+  }
   else {
     if (header_out.datatype().is_complex())
       extract<cdouble> (header_in, header_out, pos, argument[1]);
@@ -14,18 +14,19 @@
  * For more details, see http://www.mrtrix.org/.
  */
 
-#include <unsupported/Eigen/FFT>
-
 #include "axes.h"
 #include "command.h"
 #include "image.h"
 #include "progressbar.h"
 #include "algo/threaded_loop.h"
+#include "math/fft.h"
 #include <numeric>
 
 using namespace MR;
 using namespace App;
 
+const char* const precisions[] = { "float32", "float64", nullptr };
+
 void usage ()
 {
   AUTHOR = "Ben Jeurissen (ben.jeurissen@uantwerpen.be) & J-Donald Tournier (jdtournier@gmail.com)";
@@ -74,6 +75,12 @@ void usage ()
   + Option ("maxW", "right border of window used for TV computation (default: 3).")
   +   Argument ("value").type_integer (0, 128)
 
+  + Option ("precision", "the floating-point precision used for processing (default: float64). "
+            "Note that in builds configured with FFTW, float64 transforms are computed by FFTW "
+            "one line at a time, rather than batched across lines as they otherwise are; "
+            "in such builds, batching only applies to float32 processing.")
+  +   Argument ("float32/float64").type_choice (precisions)
+
   + DataType::options();
 
 
@@ -90,9 +97,13 @@ typedef double value_type;
 
 
 
+template <typename T>
 class ComputeSlice
-{ MEMALIGN (ComputeSlice)
+{ MEMALIGN (ComputeSlice<T>)
   public:
+    using complex_type = std::complex<T>;
+    using array_type = typename Math::BatchFFT<T>::array_type;
+
     ComputeSlice (const vector<size_t>& outer_axes, const vector<size_t>& slice_axes, const int& nsh, const int& minW, const int& maxW, Image<value_type>& in, Image<value_type>& out) :
       outer_axes (outer_axes),
       slice_axes (slice_axes),
@@ -101,24 +112,9 @@ class ComputeSlice
       maxW (maxW),
       in (in),
       out (out),
-      im1 (in.size(slice_axes[0]), in.size(slice_axes[1])),
-      im2 (im1.rows(), im1.cols()) {
-        prealloc_FFT();
-      }
-
-    ComputeSlice (const ComputeSlice& other) :
-      outer_axes (other.outer_axes),
-      slice_axes (other.slice_axes),
-      nsh (other.nsh),
-      minW (other.minW),
-      maxW (other.maxW),
-      in (other.in),
-      out (other.out),
-      fft (),
-      im1 (in.size(slice_axes[0]), in.size(slice_axes[1])),
-      im2 (im1.rows(), im1.cols()) {
-        prealloc_FFT();
-      }
+      row_fft (in.size(slice_axes[1])),
+      col_fft (in.size(slice_axes[0])),
+      slice (in.size(slice_axes[0]), in.size(slice_axes[1])) { }
 
 
     void operator() (const Iterator& pos)
@@ -128,7 +124,7 @@ class ComputeSlice
       assign_pos_of (pos, outer_axes).to (in, out);
 
       for (auto l = Loop (slice_axes) (in); l; ++l)
-        im1 (ssize_t(in.index(X)), ssize_t(in.index(Y))) = cdouble (in.value(), 0.0);
+        slice (ssize_t(in.index(X)), ssize_t(in.index(Y))) = in.value();
 
       unring_2d ();
 
@@ -141,72 +137,56 @@ class ComputeSlice
     const vector<size_t>& slice_axes;
     const int nsh, minW, maxW;
     Image<value_type> in, out;
-    Eigen::FFT<double> fft;
-    Eigen::MatrixXcd im1, im2, shifted;
-    Eigen::VectorXcd v;
-
-    void prealloc_FFT () {
-      // needed to avoid within-thread allocations,
-      // which aren't thread-safe in FFTW:
-#ifdef EIGEN_FFTW_DEFAULT
-      Eigen::VectorXcd tmp (im1.rows());
-      FFT (tmp);
-      iFFT (tmp);
-      tmp.resize (im1.cols());
-      FFT (tmp);
-      iFFT (tmp);
-#endif
-    }
-
-    template <typename Derived> FORCE_INLINE void FFT      (Eigen::MatrixBase<Derived>&& vec) { fft.fwd (v, vec); vec = v; }
-    template <typename Derived> FORCE_INLINE void FFT      (Eigen::MatrixBase<Derived>& vec) { FFT (std::move (vec)); }
-    template <typename Derived> FORCE_INLINE void iFFT     (Eigen::MatrixBase<Derived>&& vec) { fft.inv (v, vec); vec = v; }
-    template <typename Derived> FORCE_INLINE void iFFT     (Eigen::MatrixBase<Derived>& vec) { iFFT (std::move (vec)); }
-    template <typename Derived> FORCE_INLINE void row_FFT  (Eigen::MatrixBase<Derived>& mat) { for (auto n = 0; n < mat.rows(); ++n)  FFT (mat.row(n)); }
-    template <typename Derived> FORCE_INLINE void row_iFFT (Eigen::MatrixBase<Derived>& mat) { for (auto n = 0; n < mat.rows(); ++n) iFFT (mat.row(n)); }
-    template <typename Derived> FORCE_INLINE void col_FFT  (Eigen::MatrixBase<Derived>& mat) { for (auto n = 0; n < mat.cols(); ++n)  FFT (mat.col(n)); }
-    template <typename Derived> FORCE_INLINE void col_iFFT (Eigen::MatrixBase<Derived>& mat) { for (auto n = 0; n < mat.cols(); ++n) iFFT (mat.col(n)); }
+    // transforms along each row (i.e. along the second slice axis) and each column of the slice:
+    Math::BatchFFT<T> row_fft, col_fft;
+    typename Math::BatchFFT<T>::real_array_type slice;
+    // im1 is held as rows x columns, im2 as columns x rows, so that
+    // each is laid out as required for its transforms:
+    array_type im1, im2, shifted;
 
 
 
     FORCE_INLINE void unring_2d ()
     {
-      row_FFT (im1);
-      col_FFT (im1);
+      // 2D FFT of the slice, along the rows (from real input), then along the columns:
+      row_fft.forward (slice, im1);
+      im2 = im1.transpose();
+      col_fft.forward (im2);
 
-      for (int k = 0; k < im1.cols(); k++) {
-        double ck = (1.0+cos(2.0*Math::pi*(double(k)/im1.cols())))*0.5;
-        for (int j = 0 ; j < im1.rows(); j++) {
-          double cj = (1.0+cos(2.0*Math::pi*(double(j)/im1.rows())))*0.5;
+      for (int k = 0; k < im2.rows(); k++) {
+        double ck = (1.0+cos(2.0*Math::pi*(double(k)/im2.rows())))*0.5;
+        for (int j = 0 ; j < im2.cols(); j++) {
+          double cj = (1.0+cos(2.0*Math::pi*(double(j)/im2.cols())))*0.5;
 
           if (ck+cj != 0.0) {
-            im2(j,k) = im1(j,k) * cj / (ck+cj);
-            im1(j,k) *= ck / (ck+cj);
+            im1(j,k) = im2(k,j) * T(ck / (ck+cj));
+            im2(k,j) *= T(cj / (ck+cj));
           }
           else
-            im1(j,k) = im2(j,k) = cdouble(0.0, 0.0);
+            im1(j,k) = im2(k,j) = complex_type (0.0, 0.0);
         }
       }
 
-      row_iFFT (im1);
-      col_iFFT (im2);
+      row_fft.inverse (im1);
+      col_fft.inverse (im2);
 
-      unring_1d (im1);
-      unring_1d (im2.transpose());
+      unring_1d (im1, col_fft);
+      unring_1d (im2, row_fft);
 
-      im1 += im2;
+      im1 += im2.transpose();
     }
 
 
 
 
 
-    template <typename Derived>
-      FORCE_INLINE void unring_1d (Eigen::MatrixBase<Derived>&& eig)
+    // unring each column of eig, given its FFT along the columns; all
+    // shifted versions of each column are inverse transformed in one batch:
+    FORCE_INLINE void unring_1d (array_type& eig, Math::BatchFFT<T>& fft)
       {
         const int n = eig.rows();
         const int numlines = eig.cols();
-        shifted.resize (n, 2*nsh+1);
+        shifted.resize (2*nsh+1, n);
 
         int shifts [2*nsh+1];
         shifts[0] = 0;
@@ -215,11 +195,11 @@ class ComputeSlice
           shifts[1+nsh+j] = -(j+1);
         }
 
-        double TV1arr[2*nsh+1];
-        double TV2arr[2*nsh+1];
+        T TV1arr[2*nsh+1];
+        T TV2arr[2*nsh+1];
 
         for (int k = 0; k < numlines; k++) {
-          shifted.col(0) = eig.col(k);
+          shifted.row(0) = eig.col(k).transpose();
 
           const int maxn = (n&1) ? (n-1)/2 : n/2-1;
 
@@ -227,34 +207,34 @@ class ComputeSlice
             double phi = Math::pi*double(shifts[j])/double(n*nsh);
             cdouble u (std::cos(phi), std::sin(phi));
             cdouble e (1.0, 0.0);
-            shifted(0,j) = shifted(0,0);
+            shifted(j,0) = shifted(0,0);
 
             if (!(n&1))
-              shifted(n/2,j) = cdouble(0.0, 0.0);
+              shifted(j,n/2) = complex_type (0.0, 0.0);
 
             for (int l = 0; l < maxn; l++) {
               e = u*e;
-              int L = l+1; shifted(L,j) = e * shifted(L,0);
-              L = n-1-l;   shifted(L,j) = std::conj(e) * shifted(L,0);
+              int L = l+1; shifted(j,L) = complex_type (e) * shifted(0,L);
+              L = n-1-l;   shifted(j,L) = complex_type (std::conj(e)) * shifted(0,L);
             }
           }
 
 
-          col_iFFT (shifted);
+          fft.inverse (shifted);
 
           for (int j = 0; j < 2*nsh+1; ++j) {
             TV1arr[j] = 0.0;
             TV2arr[j] = 0.0;
             for (int t = minW; t <= maxW; t++) {
-              TV1arr[j] += abs (shifted((n-t)%n,j).real() - shifted((n-t-1)%n,j).real());
-              TV1arr[j] += abs (shifted((n-t)%n,j).imag() - shifted((n-t-1)%n,j).imag());
-              TV2arr[j] += abs (shifted((n+t)%n,j).real() - shifted((n+t+1)%n,j).real());
-              TV2arr[j] += abs (shifted((n+t)%n,j).imag() - shifted((n+t+1)%n,j).imag());
+              TV1arr[j] += std::abs (shifted(j,(n-t)%n).real() - shifted(j,(n-t-1)%n).real());
+              TV1arr[j] += std::abs (shifted(j,(n-t)%n).imag() - shifted(j,(n-t-1)%n).imag());
+              TV2arr[j] += std::abs (shifted(j,(n+t)%n).real() - shifted(j,(n+t+1)%n).real());
+              TV2arr[j] += std::abs (shifted(j,(n+t)%n).imag() - shifted(j,(n+t+1)%n).imag());
             }
           }
 
           for (int l = 0; l < n; ++l) {
-            double minTV = std::numeric_limits<double>::max();
+            T minTV = std::numeric_limits<T>::max();
             int minidx = 0;
             for (int j = 0; j < 2*nsh+1; ++j) {
 
@@ -267,36 +247,33 @@ class ComputeSlice
                 minidx = j;
               }
 
-              TV1arr[j] += abs (shifted((l-minW+1+n)%n,j).real() - shifted((l-(minW  )+n)%n,j).real());
-              TV1arr[j] -= abs (shifted((l-maxW  +n)%n,j).real() - shifted((l-(maxW+1)+n)%n,j).real());
-              TV2arr[j] += abs (shifted((l+maxW+1+n)%n,j).real() - shifted((l+(maxW+2)+n)%n,j).real());
-              TV2arr[j] -= abs (shifted((l+minW  +n)%n,j).real() - shifted((l+(minW+1)+n)%n,j).real());
+              TV1arr[j] += std::abs (shifted(j,(l-minW+1+n)%n).real() - shifted(j,(l-(minW  )+n)%n).real());
+              TV1arr[j] -= std::abs (shifted(j,(l-maxW  +n)%n).real() - shifted(j,(l-(maxW+1)+n)%n).real());
+              TV2arr[j] += std::abs (shifted(j,(l+maxW+1+n)%n).real() - shifted(j,(l+(maxW+2)+n)%n).real());
+              TV2arr[j] -= std::abs (shifted(j,(l+minW  +n)%n).real() - shifted(j,(l+(minW+1)+n)%n).real());
 
-              TV1arr[j] += abs (shifted((l-minW+1+n)%n,j).imag() - shifted((l-(minW  )+n)%n,j).imag());
-              TV1arr[j] -= abs (shifted((l-maxW  +n)%n,j).imag() - shifted((l-(maxW+1)+n)%n,j).imag());
-              TV2arr[j] += abs (shifted((l+maxW+1+n)%n,j).imag() - shifted((l+(maxW+2)+n)%n,j).imag());
-              TV2arr[j] -= abs (shifted((l+minW  +n)%n,j).imag() - shifted((l+(minW+1)+n)%n,j).imag());
+              TV1arr[j] += std::abs (shifted(j,(l-minW+1+n)%n).imag() - shifted(j,(l-(minW  )+n)%n).imag());
+              TV1arr[j] -= std::abs (shifted(j,(l-maxW  +n)%n).imag() - shifted(j,(l-(maxW+1)+n)%n).imag());
+              TV2arr[j] += std::abs (shifted(j,(l+maxW+1+n)%n).imag() - shifted(j,(l+(maxW+2)+n)%n).imag());
+              TV2arr[j] -= std::abs (shifted(j,(l+minW  +n)%n).imag() - shifted(j,(l+(minW+1)+n)%n).imag());
             }
 
-            double a0r = shifted((l-1+n)%n,minidx).real();
-            double a1r = shifted(l,minidx).real();
-            double a2r = shifted((l+1+n)%n,minidx).real();
-            double a0i = shifted((l-1+n)%n,minidx).imag();
-            double a1i = shifted(l,minidx).imag();
-            double a2i = shifted((l+1+n)%n,minidx).imag();
-            double s = double(shifts[minidx])/(2.0*nsh);
+            const T a0r = shifted(minidx,(l-1+n)%n).real();
+            const T a1r = shifted(minidx,l).real();
+            const T a2r = shifted(minidx,(l+1+n)%n).real();
+            const T a0i = shifted(minidx,(l-1+n)%n).imag();
+            const T a1i = shifted(minidx,l).imag();
+            const T a2i = shifted(minidx,(l+1+n)%n).imag();
+            const T s = T(shifts[minidx])/T(2*nsh);
 
             if (s > 0.0)
-              eig(l,k) = cdouble (a1r*(1.0-s) + a0r*s, a1i*(1.0-s) + a0i*s);
+              eig(l,k) = complex_type (a1r*(T(1)-s) + a0r*s, a1i*(T(1)-s) + a0i*s);
             else
-              eig(l,k) = cdouble (a1r*(1.0+s) - a2r*s, a1i*(1.0+s) - a2i*s);
+              eig(l,k) = complex_type (a1r*(T(1)+s) - a2r*s, a1i*(T(1)+s) - a2i*s);
           }
         }
       }
 
-    template <typename Derived>
-      FORCE_INLINE void unring_1d (Eigen::MatrixBase<Derived>& eig) { unring_1d (std::move (eig)); }
-
 };
 
 
@@ -376,7 +353,11 @@ void run ()
     outer_axes.erase (it);
   }
 
-  ThreadedLoop ("performing Gibbs ringing removal", in, outer_axes, slice_axes)
-    .run_outer (ComputeSlice (outer_axes, slice_axes, nshifts, minW, maxW, in, out));
+  if (get_option_value ("precision", 1) == 0)
+    ThreadedLoop ("performing Gibbs ringing removal", in, outer_axes, slice_axes)
+      .run_outer (ComputeSlice<float> (outer_axes, slice_axes, nshifts, minW, maxW, in, out));
+  else
+    ThreadedLoop ("performing Gibbs ringing removal", in, outer_axes, slice_axes)
+      .run_outer (ComputeSlice<double> (outer_axes, slice_axes, nshifts, minW, maxW, in, out));
 }
 
@@ -63,6 +63,12 @@ const OptionGroup GradientOption = OptionGroup ("Options for gradient filter")
   + Option ("magnitude", "output the gradient magnitude, rather "
             "than the default x,y,z components")
 
+  + Option ("recursive", "smooth the input image using a recursive approximation "
+            "to the Gaussian kernel, whose computational cost is independent of the "
+            "width of the kernel. This only applies to axes with a standard deviation "
+            "of at least two voxels (and hence not with the default stdev); other axes "
+            "are still smoothed by direct convolution.")
+
   + Option ("scanner", "define the gradient with respect to the scanner coordinate "
             "frame of reference.");
 
@@ -72,7 +78,12 @@ const OptionGroup MedianOption = OptionGroup ("Options for median filter")
   + Option ("extent", "specify extent of median filtering neighbourhood in voxels. "
         "This can be specified either as a single value to be used for all 3 axes, "
         "or as a comma-separated list of 3 values, one for each axis (default: 3x3x3).")
-    + Argument ("size").type_sequence_int();
+    + Argument ("size").type_sequence_int()
+
+  + Option ("approximate", "for images that do not hold integer values only, compute "
+        "an approximate median by quantising the image intensities into "
+        + str(size_t (Filter::Median::max_bins)) + " levels; this is much faster for large "
+        "neighbourhoods, but only accurate to within half a quantisation step.");
 
 const OptionGroup NormaliseOption = OptionGroup ("Options for normalisation filter")
 
@@ -100,7 +111,13 @@ const OptionGroup SmoothOption = OptionGroup ("Options for smooth filter")
             "This can be specified either as a single value to be used for all axes, "
             "or as a comma-separated list of the extent for each axis. "
             "The default extent is 2 * ceil(2.5 * stdev / voxel_size) - 1.")
-  + Argument ("voxels").type_sequence_int();
+  + Argument ("voxels").type_sequence_int()
+
+  + Option ("recursive", "use a recursive approximation to the full (untruncated) "
+            "Gaussian kernel, whose computational cost is independent of the width "
+            "of the kernel; this is much faster for large stdev or FWHM. "
+            "Axes with a standard deviation of less than two voxels, or for which "
+            "the -extent option is specified, are still smoothed by direct convolution.");
 
 const OptionGroup ZcleanOption = OptionGroup ("Options for zclean filter")
 + Option ("zupper", "define high intensity outliers: default: 2.5")
@@ -199,6 +216,16 @@ void run () {
           stdev[dim] = filter.spacing (dim);
       }
       filter.compute_wrt_scanner (get_options ("scanner").size() ? true : false);
+      if (get_options ("recursive").size()) {
+        filter.set_recursive (true);
+        for (size_t dim = 0; dim != 3; ++dim) {
+          if (stdev[stdev.size() == 1 ? 0 : dim] < 2.0 * filter.spacing (dim)) {
+            WARN ("-recursive option has no effect along axes with a Gaussian stdev of less than two voxels; "
+                  "direct convolution will be used along such axes");
+            break;
+          }
+        }
+      }
       filter.set_message (std::string("applying ") + std::string(argument[1]) + " filter to image " + std::string(argument[0]));
       Stride::set_from_command_line (filter);
       filter.set_stdev (stdev);
@@ -216,6 +243,7 @@ void run () {
       auto opt = get_options ("extent");
       if (opt.size())
         filter.set_extent (parse_ints<uint32_t> (opt[0][0]));
+      filter.set_approximate (get_options ("approximate").size());
       filter.set_message (std::string("applying ") + std::string(argument[1]) + " filter to image " + std::string(argument[0]));
       Stride::set_from_command_line (filter);
 
@@ -246,6 +274,8 @@ void run () {
       opt = get_options ("extent");
       if (opt.size())
         filter.set_extent (parse_ints<uint32_t> (opt[0][0]));
+      if (get_options ("recursive").size())
+        filter.set_recursive (true);
       filter.set_message (std::string("applying ") + std::string(argument[1]) + " filter to image " + std::string(argument[0]));
       Stride::set_from_command_line (filter);
 
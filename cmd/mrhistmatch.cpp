@@ -160,15 +160,13 @@ void match_nonlinear (Image<float>& input,
                       Image<bool>& mask_target,
                       const size_t nbins)
 {
-  Algo::Histogram::Calibrator calib_input (nbins, true);
-  Algo::Histogram::calibrate (calib_input, input, mask_input);
+  Algo::Histogram::Data hist_input = Algo::Histogram::generate (input, mask_input, nbins, true);
+  const auto& calib_input = hist_input.get_calibration();
   INFO ("Input histogram ranges from " + str(calib_input.get_min()) + " to " + str(calib_input.get_max()) + "; using " + str(calib_input.get_num_bins()) + " bins");
-  Algo::Histogram::Data hist_input = Algo::Histogram::generate (calib_input, input, mask_input);
 
-  Algo::Histogram::Calibrator calib_target (nbins, true);
-  Algo::Histogram::calibrate (calib_target, target, mask_target);
+  Algo::Histogram::Data hist_target = Algo::Histogram::generate (target, mask_target, nbins, true);
+  const auto& calib_target = hist_target.get_calibration();
   INFO ("Target histogram ranges from " + str(calib_target.get_min()) + " to " + str(calib_target.get_max()) + "; using " + str(calib_target.get_num_bins()) + " bins");
-  Algo::Histogram::Data hist_target = Algo::Histogram::generate (calib_target, target, mask_target);
 
   // Non-linear intensity mapping determined within this class
   Algo::Histogram::Matcher matcher (hist_input, hist_target);
@@ -312,14 +312,29 @@ class ImageKernel : public ImageKernelBase { NOMEMALIGN
         template <class ImageType>
           void operator() (ImageType& out) const { out.value() = Operation(); }
     };
+    // process the input one row at a time, to make use of bulk row access:
     class ProcessFunctor { NOMEMALIGN
       public:
-        template <class ImageType1, class ImageType2>
-          void operator() (ImageType1& out, ImageType2& in) const {
-            Operation op = out.value();
-            op (in.value());
-            out.value() = op;
+        ProcessFunctor (const vector<size_t>& outer_axes, size_t axis, const Image<Operation>& image, const Image<value_type>& in) :
+          outer_axes (outer_axes), axis (axis), image (image), in (in), row (image.size (axis)) { }
+
+        void operator() (const Iterator& pos) {
+          assign_pos_of (pos, outer_axes).to (image, in);
+          in.index (axis) = 0;
+          in.get_row (axis, row.data(), row.size());
+          for (auto l = Loop (axis) (image); l; ++l) {
+            Operation op = image.value();
+            op (row[image.index (axis)]);
+            image.value() = op;
           }
+        }
+
+      protected:
+        const vector<size_t>& outer_axes;
+        const size_t axis;
+        Image<Operation> image;
+        Image<value_type> in;
+        vector<value_type> row;
     };
     class ResultFunctor { NOMEMALIGN
       public:
@@ -344,7 +359,8 @@ class ImageKernel : public ImageKernelBase { NOMEMALIGN
     void process (Header& header_in)
     {
       auto in = header_in.get_image<value_type>();
-      ThreadedLoop (image).run (ProcessFunctor(), image, in);
+      auto loop = ThreadedLoop (image);
+      loop.run_outer (ProcessFunctor (loop.outer_loop.axes, loop.inner_axes[0], image, in));
     }
 
   protected:
@@ -14,6 +14,8 @@
  * For more details, see http://www.mrtrix.org/.
  */
 
+#include <set>
+
 #include "command.h"
 #include "image.h"
 #include "image_helpers.h"
@@ -107,6 +109,17 @@ void usage ()
 
   + Option("nan", "use NaN as out of bounds value. (Default: 0.0)")
 
+  + Option ("batch", "register multiple input images to the same template in a single invocation. "
+    "In this mode, only the template image(s) (image2, contrast2, ...) are provided as arguments. "
+    "Each non-empty line of the text file lists the input image(s) of one subject (image1, contrast1, ...), "
+    "optionally followed by any options that apply to that subject only (e.g. -mask1, -affine, -nl_warp_full, -transformed); "
+    "anything following a # is ignored. Options provided on the command line apply to all subjects; "
+    "standard options (such as -force or -nthreads) can only be provided on the command line. "
+    "All entries are checked (input images, option values, and output files) before any registration starts. "
+    "The template images, template mask and their smoothed versions at each resolution level are only computed once, "
+    "and reused for all subjects, which are registered in turn.")
+    + Argument ("file").type_file_in ()
+
   + Registration::rigid_options
 
   + Registration::affine_options
@@ -126,7 +139,23 @@ void usage ()
 
 using value_type = double;
 
-void run () {
+
+// template data shared between the registrations of all subjects in batch mode
+class BatchTemplate { NOMEMALIGN
+  public:
+    BatchTemplate () : pyramid (make_shared<Registration::MultiResolutionCache>()) { }
+
+    // preloaded template images, and the number of volumes preloaded for each contrast
+    Image<value_type> images;
+    vector<size_t> nvols;
+    std::map<std::string, Image<value_type>> masks;
+    std::shared_ptr<Registration::MultiResolutionCache> pyramid;
+};
+
+
+
+void register_images (BatchTemplate* batch)
+{
 
   vector<Header> input1, input2;
   const size_t n_images = argument.size() / 2;
@@ -320,7 +349,14 @@ void run () {
   opt = get_options ("mask2");
   Image<value_type> im2_mask;
   if (opt.size ()) {
-    im2_mask = Image<value_type>::open(opt[0][0]);
+    if (batch) {
+      auto& mask = batch->masks[opt[0][0]];
+      if (!mask.valid())
+        mask = Image<value_type>::open(opt[0][0]);
+      im2_mask = mask;
+    } else {
+      im2_mask = Image<value_type>::open(opt[0][0]);
+    }
     check_dimensions (input2[0], im2_mask, 0, 3);
   }
 
@@ -753,6 +789,12 @@ void run () {
     nl_registration.set_init_grad_step (opt[0][0]);
   }
 
+  if (get_options ("nl_single_precision").size()) {
+    if (!do_nonlinear)
+      throw Exception ("the -nl_single_precision option has been set when no non-linear registration is requested");
+    nl_registration.set_single_precision (true);
+  }
+
   opt = get_options ("nl_lmax");
   vector<uint32_t> nl_lmax;
   if (opt.size()) {
@@ -831,8 +873,25 @@ void run () {
   Image<value_type> images1, images2;
   INFO ("preloading input1...");
   Registration::preload_data (input1, images1, mc_params);
-  INFO ("preloading input2...");
-  Registration::preload_data (input2, images2, mc_params);
+  if (batch) {
+    // the template only needs to be preloaded again if a different number of volumes is required
+    vector<size_t> nvols;
+    for (const auto& mc : mc_params)
+      nvols.push_back (mc.nvols);
+    if (!batch->images.valid() || nvols != batch->nvols) {
+      INFO ("preloading input2...");
+      Registration::preload_data (input2, batch->images, mc_params);
+      batch->nvols = nvols;
+      batch->pyramid = make_shared<Registration::MultiResolutionCache>();
+    }
+    images2 = batch->images;
+    rigid_registration.set_im2_cache (batch->pyramid);
+    affine_registration.set_im2_cache (batch->pyramid);
+    nl_registration.set_im2_cache (batch->pyramid);
+  } else {
+    INFO ("preloading input2...");
+    Registration::preload_data (input2, images2, mc_params);
+  }
   INFO ("preloading input images done");
 
   // ****** RUN RIGID REGISTRATION *******
@@ -1172,3 +1231,131 @@ void run () {
   if (get_options ("affine_log").size() or get_options ("rigid_log").size())
     linear_logstream.close();
 }
+
+
+
+void run ()
+{
+  auto opt = get_options ("batch");
+  if (!opt.size()) {
+    register_images (nullptr);
+    return;
+  }
+
+  // the arguments and options provided on the command line apply to all subjects:
+  const vector<ParsedArgument> template_arguments (argument);
+  vector<ParsedOption> common_options;
+  for (const auto& o : option)
+    if (!(o == "batch"))
+      common_options.push_back (o);
+
+  vector<vector<std::string>> subjects;
+  {
+    std::ifstream in (opt[0][0]);
+    if (!in)
+      throw Exception ("error opening batch file \"" + str(opt[0][0]) + "\": " + strerror (errno));
+    std::string line;
+    while (std::getline (in, line)) {
+      line = strip (line.substr (0, line.find_first_of ('#')));
+      if (line.size())
+        subjects.push_back (split (line, " \t", true));
+    }
+  }
+  if (subjects.empty())
+    throw Exception ("no subjects found in batch file \"" + str(opt[0][0]) + "\"");
+
+  // parse the images and options of subject n as if provided on the command line;
+  // if requested, also check everything that would otherwise only be checked
+  // once the registration of that subject is under way:
+  vector<const char*> subject_argv;
+  std::set<std::string> outputs;
+  auto parse_subject = [&] (const size_t n, const bool check) {
+    subject_argv.assign (1, App::argv[0]);
+    for (const auto& token : subjects[n])
+      subject_argv.push_back (token.c_str());
+    argument.clear();
+    option.clear();
+    sort_arguments (subject_argv.size(), subject_argv.data());
+
+    if (argument.size() != template_arguments.size())
+      throw Exception ("number of input images for subject \"" + subjects[n][0] + "\" (" + str(argument.size())
+                       + ") does not match number of template images (" + str(template_arguments.size()) + ")");
+    for (const auto& o : option) {
+      if (o == "batch")
+        throw Exception ("option -batch cannot be used within a batch file");
+      bool is_command_option = false;
+      for (const auto& group : OPTIONS)
+        for (const auto& candidate : group)
+          if (&candidate == o.opt)
+            is_command_option = true;
+      if (!is_command_option)
+        throw Exception ("standard option -" + std::string (o.opt->id) + " for subject \"" + subjects[n][0]
+                         + "\" cannot be used within a batch file; provide it on the command line instead");
+      if (!(o.opt->flags & AllowMultiple)) {
+        for (const auto& c : common_options)
+          if (c.opt == o.opt)
+            throw Exception ("option -" + std::string (o.opt->id) + " for subject \"" + subjects[n][0]
+                             + "\" is already provided on the command line");
+      }
+    }
+
+    // interleave the subject's and the template's images as expected by register_images():
+    const vector<ParsedArgument> subject_arguments (argument);
+    argument.clear();
+    for (size_t i = 0; i < subject_arguments.size(); ++i) {
+      argument.push_back (subject_arguments[i]);
+      argument.push_back (template_arguments[i]);
+    }
+    option.insert (option.end(), common_options.begin(), common_options.end());
+    if (!check)
+      return;
+
+    try {
+      // as performed by App::parse() for the command line:
+      check_arguments();
+
+      // values and images are otherwise only parsed when first used:
+      for (size_t i = 0; i < argument.size(); i += 2)
+        Header::open (argument[i]);
+      for (const auto& o : option) {
+        for (size_t j = 0; j != o.opt->size(); ++j) {
+          const auto value = o[j];
+          const auto type = (*o.opt)[j].type;
+          switch (type) {
+            case Integer: case Choice: value.as_int(); break;
+            case Float: value.as_float(); break;
+            case IntSeq: value.as_sequence_int(); break;
+            case FloatSeq: value.as_sequence_float(); break;
+            case ImageIn:
+              if (!is_dash (value))
+                Header::open (value);
+              break;
+            case ImageOut:
+              if (!is_dash (value))
+                check_overwrite (value);
+              break;
+            default: break;
+          }
+          if ((type == ImageOut && !is_dash (value)) || type == ArgFileOut) {
+            if (!outputs.insert (std::string (value)).second)
+              throw Exception ("output \"" + std::string (value) + "\" for option \"-" + std::string (o.opt->id)
+                               + "\" is written by more than one subject");
+          }
+        }
+      }
+    } catch (Exception& e) {
+      throw Exception (e, "invalid batch file entry for subject \"" + subjects[n][0] + "\"");
+    }
+  };
+
+  // check the whole batch file before starting any registration:
+  for (size_t n = 0; n < subjects.size(); ++n)
+    parse_subject (n, true);
+
+  BatchTemplate batch;
+  for (size_t n = 0; n < subjects.size(); ++n) {
+    CONSOLE ("registering subject " + str(n+1) + " of " + str(subjects.size()) + ": " + subjects[n][0]);
+    parse_subject (n, false);
+    register_images (&batch);
+  }
+}
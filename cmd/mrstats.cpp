@@ -26,6 +26,7 @@
 
 #include "algo/histogram.h"
 #include "algo/loop.h"
+#include "algo/threaded_loop.h"
 #include "file/ofstream.h"
 
 
@@ -96,17 +97,47 @@ class Volume_loop
 
 
 
-void run_volume (Stats::Stats& stats, Image<complex_type>& data, Image<bool>& mask)
-{
-  if (mask.valid()) {
-    for (auto l = Loop(0,3) (data, mask); l; ++l) {
+class StatsFunctor
+{ NOMEMALIGN
+  public:
+    StatsFunctor (Stats::Stats& overall, const Stats::Stats& initial) :
+        overall (overall),
+        stats (initial) { }
+
+    // merge the statistics accumulated by each thread:
+    ~StatsFunctor ()
+    {
+      std::lock_guard<std::mutex> lock (mutex);
+      overall.merge (stats);
+    }
+
+    void operator() (Image<complex_type>& data)
+    {
+      stats (data.value());
+    }
+
+    void operator() (Image<complex_type>& data, Image<bool>& mask)
+    {
       if (mask.value())
         stats (data.value());
     }
-  } else {
-    for (auto l = Loop(0,3) (data); l; ++l)
-      stats (data.value());
-  }
+
+  private:
+    Stats::Stats& overall;
+    Stats::Stats stats;
+    static std::mutex mutex;
+};
+std::mutex StatsFunctor::mutex;
+
+
+
+
+void run_volume (Stats::Stats& stats, const Stats::Stats& initial, Image<complex_type>& data, Image<bool>& mask)
+{
+  if (mask.valid())
+    ThreadedLoop (data, 0, 3).run (StatsFunctor (stats, initial), data, mask);
+  else
+    ThreadedLoop (data, 0, 3).run (StatsFunctor (stats, initial), data);
 }
 
 
@@ -121,6 +152,7 @@ void run ()
   const bool is_complex = header.datatype().is_complex();
   auto data = header.get_image<complex_type>();
   const bool ignorezero = get_options("ignorezero").size();
+  const Stats::Stats initial (is_complex, ignorezero, get_options("approximate").size());
 
   auto opt = get_options ("mask");
   Image<bool> mask;
@@ -139,16 +171,16 @@ void run ()
 
   if (get_options ("allvolumes").size()) {
 
-    Stats::Stats stats (is_complex, ignorezero);
+    Stats::Stats stats (initial);
     for (auto i = Volume_loop (data); i; ++i)
-      run_volume (stats, data, mask);
+      run_volume (stats, initial, data, mask);
     stats.print (data, fields);
 
   } else {
 
     for (auto i = Volume_loop (data); i; ++i) {
-      Stats::Stats stats (is_complex, ignorezero);
-      run_volume (stats, data, mask);
+      Stats::Stats stats (initial);
+      run_volume (stats, initial, data, mask);
       stats.print (data, fields);
     }
 
@@ -171,7 +171,7 @@ void run ()
     DWI::Tractography::Mapping::TrackLoader loader (track_file, num_tracks, "mapping tracks to fixels");
     DWI::Tractography::Mapping::TrackMapperBase mapper (index_image);
     mapper.set_upsample_ratio (DWI::Tractography::Mapping::determine_upsample_ratio (index_header, properties, 0.333f));
-    mapper.set_use_precise_mapping (true);
+    mapper.set_use_precise_or_exact_mapping();
     TrackProcessor tract_processor (index_image, directions, fixel_TDI, angular_threshold);
     Thread::run_queue (
         loader,
@@ -147,6 +147,11 @@ const OptionGroup MappingOption = OptionGroup ("Options for the streamline-to-vo
       "use a more precise streamline mapping strategy, that accurately quantifies the length through each voxel "
       "(these lengths are then taken into account during TWI calculation)")
 
+  + Option ("exact",
+      "quantify the exact length of each streamline through each voxel, treating the streamline as "
+      "straight line segments between its vertices; unlike -precise, this does not upsample the streamlines "
+      "(these lengths are then taken into account during TWI calculation)")
+
   + Option ("ends_only",
       "only map the streamline endpoints to the image");
 
@@ -202,7 +207,12 @@ REFERENCES
   + "* If using -precise mapping option:\n"
   "Smith, R. E.; Tournier, J.-D.; Calamante, F. & Connelly, A. " // Internal
   "SIFT: Spherical-deconvolution informed filtering of tractograms. "
-  "NeuroImage, 2013, 67, 298-312 (Appendix 3)";
+  "NeuroImage, 2013, 67, 298-312 (Appendix 3)"
+
+  + "* If using -exact mapping option:\n"
+  "Amanatides, J. & Woo, A. "
+  "A fast voxel traversal algorithm for ray tracing. "
+  "Eurographics, 1987, 87, 3-10";
 
 ARGUMENTS
   + Argument ("tracks", "the input track file.").type_file_in()
@@ -443,10 +453,18 @@ void run () {
   // Figure out how the streamlines will be mapped
   const bool precise = get_options ("precise").size();
   header.keyval()["precise_mapping"] = precise ? "1" : "0";
+  const bool exact = get_options ("exact").size();
+  if (exact) {
+    if (precise)
+      throw Exception ("Options -precise and -exact are mutually exclusive");
+    if (stat_tck == GAUSSIAN)
+      throw Exception ("Option -exact cannot be used with the gaussian track-wise statistic");
+    header.keyval()["exact_mapping"] = "1";
+  }
   const bool ends_only = get_options ("ends_only").size();
   if (ends_only) {
-    if (precise)
-      throw Exception ("Options -precise and -ends_only are mutually exclusive");
+    if (precise || exact)
+      throw Exception ("Option -ends_only is mutually exclusive with -precise and -exact");
     header.keyval()["endpoints_only"] = "1";
   }
 
@@ -455,11 +473,13 @@ void run () {
   if (opt.size()) {
     if (ends_only) {
       WARN ("cannot use upsampling if only streamline endpoints are to be mapped");
+    } else if (exact) {
+      WARN ("upsampling is not used with exact streamline mapping");
     } else {
       upsample_ratio = opt[0][0];
       INFO ("track upsampling ratio manually set to " + str(upsample_ratio));
     }
-  } else if (!ends_only) {
+  } else if (!ends_only && !exact) {
     // If accurately calculating the length through each voxel traversed, need a higher upsampling ratio
     //   (1/10th of the voxel size was found to give a good quantification of chordal length)
     // For all other applications, making the upsampled step size about 1/3rd of a voxel seems sufficient
@@ -495,9 +515,9 @@ void run () {
   }
 
   DataType default_datatype = DataType::Float32;
-  if ((writer_type == GREYSCALE || writer_type == DIXEL) && !have_weights && ((!precise && contrast == TDI) || contrast == SCALAR_MAP_COUNT))
+  if ((writer_type == GREYSCALE || writer_type == DIXEL) && !have_weights && ((!(precise || exact) && contrast == TDI) || contrast == SCALAR_MAP_COUNT))
     default_datatype = DataType::UInt32;
-  header.datatype() = determine_datatype (header.datatype(), contrast, default_datatype, precise);
+  header.datatype() = determine_datatype (header.datatype(), contrast, default_datatype, precise || exact);
   header.datatype().set_byte_order_native();
 
 
@@ -563,6 +583,7 @@ void run () {
   mapper->set_upsample_ratio      (upsample_ratio);
   mapper->set_map_zero            (map_zero);
   mapper->set_use_precise_mapping (precise);
+  mapper->set_use_exact_mapping   (exact);
   mapper->set_map_ends_only       (ends_only);
   if (writer_type == DIXEL)
     mapper->create_dixel_plugin (*dirs);
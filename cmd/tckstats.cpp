@@ -14,6 +14,8 @@
  * For more details, see http://www.mrtrix.org/.
  */
 
+#include <map>
+
 #include "command.h"
 #include "memory.h"
 #include "progressbar.h"
@@ -21,6 +23,8 @@
 
 #include "file/ofstream.h"
 
+#include "thread_queue.h"
+
 #include "math/median.h"
 
 #include "dwi/tractography/file.h"
@@ -42,6 +46,10 @@ using namespace MR::DWI::Tractography;
 
 const char * field_choices[] = { "mean", "median", "std", "min", "max", "count", NULL };
 
+constexpr size_t max_exact_lengths = 1U<<20;
+constexpr size_t median_bins_per_step = 64;
+constexpr size_t max_median_bins = 1U<<16;
+
 
 void usage ()
 {
@@ -68,6 +76,12 @@ void usage ()
 
   + Option ("ignorezero", "do not generate a warning if the track file contains streamlines with zero length")
 
+  + Option ("approximate", "if the track file contains more than " + str(max_exact_lengths) + " streamlines, "
+      "estimate the median length from a fine-grained histogram rather than storing the lengths of all "
+      "streamlines; this bounds the memory required, with the median accurate to within the larger of 1/"
+      + str(median_bins_per_step) + " of the step size (or of 1mm if the step size is not known) "
+      "and 1/" + str(max_median_bins/2) + " of the maximum streamline length")
+
   + Tractography::TrackWeightsInOption;
 
 }
@@ -99,63 +113,235 @@ LW operator/ (const LW& lw, const double div)
 }
 
 
-void run ()
-{
+// Median of the (weighted) streamline lengths
+// The lengths are stored and the median computed exactly, unless more than
+//   max_exact lengths are provided; beyond that point, the lengths are instead
+//   accumulated into a fine-grained histogram, within the bins of which the
+//   median is then interpolated
+class LengthMedian { NOMEMALIGN
+  public:
+    LengthMedian (const size_t max_exact, const default_type bin_width) :
+        max_exact (max_exact),
+        bin_width (bin_width),
+        approximate (false) { }
+
+    void operator() (const LW& lw)
+    {
+      if (approximate) {
+        add_to_bins (lw);
+        return;
+      }
+      lengths.push_back (lw);
+      if (lengths.size() > max_exact) {
+        approximate = true;
+        for (const auto& i : lengths)
+          add_to_bins (i);
+        vector<LW>().swap (lengths);
+      }
+    }
 
-  const bool weights_provided = get_options ("tck_weights_in").size();
+    float get (const bool weighted, const default_type sum_weights)
+    {
+      if (approximate) {
+        const default_type target = 0.5 * sum_weights;
+        default_type sum = 0.0;
+        for (size_t i = 0; i != bins.size(); ++i) {
+          if (bins[i] && sum + bins[i] >= target)
+            return (i + (target - sum) / bins[i]) * bin_width;
+          sum += bins[i];
+        }
+        return bins.size() * bin_width;
+      }
+      if (lengths.empty())
+        return NaN;
+      if (weighted) {
+        // Perform a weighted median calculation
+        std::sort (lengths.begin(), lengths.end());
+        size_t median_index = 0;
+        default_type sum = sum_weights - lengths[0].get_weight();
+        while (sum > 0.5 * sum_weights) { sum -= lengths[++median_index].get_weight(); }
+        return lengths[median_index].get_length();
+      }
+      return Math::median (lengths).get_length();
+    }
 
-  float step_size = NaN;
-  size_t count = 0, header_count = 0;
-  float min_length = std::numeric_limits<float>::infinity();
-  float max_length = -std::numeric_limits<float>::infinity();
-  size_t empty_streamlines = 0, zero_length_streamlines = 0;
-  default_type sum_lengths = 0.0, sum_weights = 0.0;
-  vector<default_type> histogram;
-  vector<LW> all_lengths;
-  all_lengths.reserve (header_count);
+  private:
+    const size_t max_exact;
+    default_type bin_width;
+    bool approximate;
+    vector<LW> lengths;
+    vector<default_type> bins;
+
+    void add_to_bins (const LW& lw)
+    {
+      size_t index = lw.get_length() / bin_width;
+      // Coarsen the histogram as required to keep its size bounded; once
+      //   coarsened, the bins are less than 2/max_median_bins of the
+      //   maximum length wide
+      while (index >= max_median_bins) {
+        for (size_t i = 0; i != bins.size(); ++i)
+          bins[i/2] = (i % 2) ? bins[i/2] + bins[i] : bins[i];
+        bins.resize ((bins.size() + 1) / 2);
+        bin_width *= 2.0;
+        index /= 2;
+      }
+      if (bins.size() <= index)
+        bins.resize (index + 1, 0.0);
+      bins[index] += lw.get_weight();
+    }
+};
+
+
+
+// Length computed for a streamline by the worker threads
+class TrackLength { NOMEMALIGN
+  public:
+    TrackLength () : index (0), length (NaN), weight (NaN) { }
+    size_t index;
+    float length, weight;
+};
 
-  {
-    Tractography::Properties properties;
-    Tractography::Reader<float> reader (argument[0], properties);
 
-    if (properties.find ("count") != properties.end())
-      header_count = to<size_t> (properties["count"]);
 
-    step_size = properties.get_stepsize();
-    if ((!std::isfinite (step_size) || !step_size) && get_options ("histogram").size()) {
-      WARN ("Do not have streamline step size with which to bin histogram; histogram will be generated using 1mm bin widths");
+class Source { NOMEMALIGN
+  public:
+    Source (Tractography::Reader<float>& reader, const size_t header_count) :
+        reader (reader),
+        progress ("Reading track file", header_count) { }
+
+    bool operator() (Streamline<>& tck)
+    {
+      if (!reader (tck))
+        return false;
+      ++progress;
+      return true;
     }
 
-    std::unique_ptr<File::OFStream> dump;
-    auto opt = get_options ("dump");
-    if (opt.size())
-      dump.reset (new File::OFStream (std::string(opt[0][0]), std::ios_base::out | std::ios_base::trunc));
+  private:
+    Tractography::Reader<float>& reader;
+    ProgressBar progress;
+};
+
+
 
-    ProgressBar progress ("Reading track file", header_count);
-    Streamline<> tck;
-    while (reader (tck)) {
+class Worker { NOMEMALIGN
+  public:
+    bool operator() (const Streamline<>& tck, TrackLength& out) const
+    {
+      out.index = tck.get_index();
+      out.length = Tractography::length (tck);
+      out.weight = tck.weight;
+      return true;
+    }
+};
+
+
+
+// Accumulates all statistics from the computed streamline lengths
+class Receiver { NOMEMALIGN
+  public:
+    Receiver (const float step_size, const size_t max_exact, std::unique_ptr<File::OFStream>& dump) :
+        step_size (step_size),
+        count (0),
+        min_length (std::numeric_limits<float>::infinity()),
+        max_length (-std::numeric_limits<float>::infinity()),
+        empty_streamlines (0),
+        zero_length_streamlines (0),
+        sum_lengths (0.0),
+        sum_weights (0.0),
+        running_mean (0.0),
+        sum_squared_deviations (0.0),
+        median (max_exact, (std::isfinite (step_size) && step_size ? step_size : 1.0) / median_bins_per_step),
+        dump (dump),
+        next_to_dump (0) { }
+
+    bool operator() (const TrackLength& in)
+    {
       ++count;
-      const float length = Tractography::length (tck);
+      const float length = in.length;
       if (std::isfinite (length)) {
         min_length = std::min (min_length, length);
         max_length = std::max (max_length, length);
-        sum_lengths += tck.weight * length;
-        sum_weights += tck.weight;
-        all_lengths.push_back (LW (length, tck.weight));
+        sum_lengths += in.weight * length;
+        sum_weights += in.weight;
+        // Weighted version of Welford's online algorithm for the variance
+        if (sum_weights) {
+          const default_type delta = length - running_mean;
+          running_mean += (in.weight / sum_weights) * delta;
+          sum_squared_deviations += in.weight * delta * (length - running_mean);
+        }
+        median (LW (length, in.weight));
         const size_t index = std::isfinite (step_size) ? std::round (length / step_size) : std::round (length);
         while (histogram.size() <= index)
           histogram.push_back (0.0);
-        histogram[index] += tck.weight;
+        histogram[index] += in.weight;
         if (!length)
           ++zero_length_streamlines;
       } else {
         ++empty_streamlines;
       }
-      if (dump)
-        (*dump) << length << "\n";
-      ++progress;
+      if (dump) {
+        // Lengths may arrive out of order from the worker threads
+        pending_dump[in.index] = length;
+        for (auto i = pending_dump.begin(); i != pending_dump.end() && i->first == next_to_dump; i = pending_dump.erase (i), ++next_to_dump)
+          (*dump) << i->second << "\n";
+      }
+      return true;
     }
+
+    const float step_size;
+    size_t count;
+    float min_length, max_length;
+    size_t empty_streamlines, zero_length_streamlines;
+    default_type sum_lengths, sum_weights, running_mean, sum_squared_deviations;
+    vector<default_type> histogram;
+    LengthMedian median;
+
+  private:
+    std::unique_ptr<File::OFStream>& dump;
+    std::map<size_t, float> pending_dump;
+    size_t next_to_dump;
+};
+
+
+
+void run ()
+{
+
+  const bool weights_provided = get_options ("tck_weights_in").size();
+
+  size_t header_count = 0;
+
+  Tractography::Properties properties;
+  Tractography::Reader<float> reader (argument[0], properties);
+
+  if (properties.find ("count") != properties.end())
+    header_count = to<size_t> (properties["count"]);
+
+  float step_size = properties.get_stepsize();
+  if ((!std::isfinite (step_size) || !step_size) && get_options ("histogram").size()) {
+    WARN ("Do not have streamline step size with which to bin histogram; histogram will be generated using 1mm bin widths");
+  }
+
+  std::unique_ptr<File::OFStream> dump;
+  auto opt = get_options ("dump");
+  if (opt.size())
+    dump.reset (new File::OFStream (std::string(opt[0][0]), std::ios_base::out | std::ios_base::trunc));
+
+  Receiver receiver (step_size, get_options ("approximate").size() ? max_exact_lengths : std::numeric_limits<size_t>::max(), dump);
+  {
+    Source source (reader, header_count);
+    Thread::run_queue (source, Thread::batch (Streamline<>()), Thread::multi (Worker()), Thread::batch (TrackLength()), receiver);
   }
+  dump.reset();
+
+  const size_t count = receiver.count;
+  const size_t empty_streamlines = receiver.empty_streamlines;
+  const size_t zero_length_streamlines = receiver.zero_length_streamlines;
+  const default_type sum_weights = receiver.sum_weights;
+  const auto& histogram = receiver.histogram;
+  float min_length = receiver.min_length;
+  float max_length = receiver.max_length;
 
   if (!get_options ("ignorezero").size() && (empty_streamlines || zero_length_streamlines)) {
     std::string s ("read");
@@ -175,31 +361,15 @@ void run ()
   if (!std::isfinite (max_length))
     max_length = NaN;
 
-  const float mean_length = sum_weights ? (sum_lengths / sum_weights) : NaN;
+  const float mean_length = sum_weights ? (receiver.sum_lengths / sum_weights) : NaN;
 
-  float median_length = 0.0f;
-  if (count) {
-    if (weights_provided) {
-      // Perform a weighted median calculation
-      std::sort (all_lengths.begin(), all_lengths.end());
-      size_t median_index = 0;
-      default_type sum = sum_weights - all_lengths[0].get_weight();
-      while (sum > 0.5 * sum_weights) { sum -= all_lengths[++median_index].get_weight(); }
-      median_length = all_lengths[median_index].get_length();
-    } else {
-      median_length = Math::median (all_lengths).get_length();
-    }
-  } else {
-    median_length = NaN;
-  }
+  const float median_length = count ? receiver.median.get (weights_provided, sum_weights) : NaN;
 
-  default_type ssd = 0.0;
-  for (vector<LW>::const_iterator i = all_lengths.begin(); i != all_lengths.end(); ++i)
-    ssd += i->get_weight() * Math::pow2 (i->get_length() - mean_length);
+  const default_type ssd = receiver.sum_squared_deviations;
   const float stdev = sum_weights ? (std::sqrt (ssd / (((count - 1) / default_type(count)) * sum_weights))) : NaN;
 
   vector<std::string> fields;
-  auto opt = get_options ("output");
+  opt = get_options ("output");
   for (size_t n = 0; n < opt.size(); ++n)
     fields.push_back (opt[n][0]);
 
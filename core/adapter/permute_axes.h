@@ -83,6 +83,17 @@ namespace MR
             else parent().index (a) += increment;
           }
 
+          void get_row (size_t axis, value_type* data, size_t count) {
+            const auto a = axes_[axis];
+            if (a < 0) { for (size_t n = 0; n < count; ++n) data[n] = parent().value(); }
+            else MR::get_row (parent(), a, data, count);
+          }
+          void set_row (size_t axis, const value_type* data, size_t count) {
+            const auto a = axes_[axis];
+            if (a < 0) { if (count) parent().value() = data[count-1]; }
+            else MR::set_row (parent(), a, data, count);
+          }
+
         private:
           vector<int> axes_;
           vector<size_t> non_existent_axes;
@@ -224,6 +224,11 @@ namespace MR
           return interp.value();
         }
 
+        //! whether multiple samples are averaged for each output voxel
+        bool is_oversampled () const { return oversampling; }
+        //! the transform from output voxel positions to input voxel positions
+        const transform_type& voxel_transform () const { return direct_transform; }
+
         ssize_t get_index (size_t axis) const { return axis < 3 ? x[axis] : interp.index(axis); }
         void move_index (size_t axis, ssize_t increment) {
           if (axis < 3) x[axis] += increment;
@@ -67,6 +67,9 @@ namespace MR
         ssize_t get_index (size_t axis) const { return parent().index(axis)-from_[axis]; }
         void move_index (size_t axis, ssize_t increment) { parent().index(axis) += increment; }
 
+        void get_row (size_t axis, value_type* data, size_t count) { MR::get_row (parent(), axis, data, count); }
+        void set_row (size_t axis, const value_type* data, size_t count) { MR::set_row (parent(), axis, data, count); }
+
       protected:
         using base_type::parent;
         const vector<ssize_t> from_, size_;
@@ -42,6 +42,15 @@ namespace MR
 
 
 
+      void Calibrator::merge (const Calibrator& other)
+      {
+        min = std::min (min, other.min);
+        max = std::max (max, other.max);
+        data.insert (data.end(), other.data.begin(), other.data.end());
+      }
+
+
+
       void Calibrator::from_file (const std::string& path)
       {
         Eigen::MatrixXd M;
@@ -101,7 +110,9 @@ namespace MR
         assert (data.size());
         const size_t lower_index = std::round (0.25*data.size());
         std::nth_element (data.begin(), data.begin() + lower_index, data.end());
-        const default_type lower = data[data.size()/4];
+        // Only the element at the partition index is well-defined; data is accumulated
+        //   by multiple threads, so any other element would depend on thread scheduling
+        const default_type lower = data[lower_index];
         const size_t upper_index = std::round (0.75*data.size());
         std::nth_element (data.begin(), data.begin() + upper_index, data.end());
         const default_type upper = data[upper_index];
@@ -113,6 +124,157 @@ namespace MR
 
 
 
+      namespace
+      {
+        // floor (index / 2^n)
+        inline int64_t shift (const int64_t index, const int n)
+        {
+          if (n >= 63)
+            return index < 0 ? -1 : 0;
+          return index >= 0 ? index >> n : -((-(index+1)) >> n) - 1;
+        }
+      }
+
+
+
+      void Provisional::merge (const Provisional& other)
+      {
+        assert (other.num_fine_bins == num_fine_bins);
+        if (other.calibrator.get_max() > calibrator.get_max())
+          max_count = other.max_count;
+        else if (other.calibrator.get_max() == calibrator.get_max())
+          max_count += other.max_count;
+        calibrator.merge (other.calibrator);
+
+        int64_t other_first, other_last, first, last;
+        if (!other.occupied (other_first, other_last))
+          return;
+        if (!occupied (first, last)) {
+          scale = other.scale;
+          origin = other.origin;
+          counts = other.counts;
+          values = other.values;
+          return;
+        }
+        const int new_scale = std::max (scale, other.scale);
+        fit (new_scale,
+             std::min (shift (first, new_scale - scale), shift (other_first, new_scale - other.scale)),
+             std::max (shift (last, new_scale - scale), shift (other_last, new_scale - other.scale)));
+        for (size_t n = 0; n != other.counts.size(); ++n) {
+          if (other.counts[n])
+            add_to_bin (shift (other.origin + int64_t(n), scale - other.scale) - origin, other.counts[n], other.values[n]);
+        }
+      }
+
+
+
+      Data Provisional::finalize (const size_t num_volumes, const bool is_integer)
+      {
+        calibrator.finalize (num_volumes, is_integer);
+        Data result (calibrator);
+        const default_type min = calibrator.get_min();
+        const default_type bin_width = calibrator.get_bin_width();
+        const default_type num_bins = result.size();
+        if (counts.empty() || !(bin_width > 0.0))
+          return result;
+
+        // as in Data::operator(), values falling beyond the last bin (i.e.
+        //   those equal to the maximum, unless the bins were widened to
+        //   integer widths) are not counted:
+        size_t max_fine_bin = counts.size();
+        if (!(std::floor ((calibrator.get_max() - min) / bin_width) < num_bins))
+          max_fine_bin = int64_t (std::floor (std::ldexp (calibrator.get_max(), -scale))) - origin;
+
+        for (size_t n = 0; n != counts.size(); ++n) {
+          if (!counts[n])
+            continue;
+          if (std::isfinite (values[n])) {
+            // all values in this fine bin are equal; bin them exactly
+            const default_type pos = std::floor ((values[n] - min) / bin_width);
+            if (pos >= 0.0 && pos < num_bins)
+              result.list[size_t(pos)] += counts[n];
+            continue;
+          }
+          const size_t count = counts[n] - (n == max_fine_bin ? max_count : 0);
+          const default_type centre = std::ldexp (default_type (origin + int64_t(n)) + 0.5, scale);
+          const default_type pos = std::floor ((centre - min) / bin_width);
+          result.list[size_t (std::max (0.0, std::min (num_bins - 1.0, pos)))] += count;
+        }
+        return result;
+      }
+
+
+
+      void Provisional::include (const default_type value)
+      {
+        if (counts.empty()) {
+          // start with fine bins much narrower than the magnitude of the
+          //   first value; these are widened as the range of values grows
+          scale = (value == 0.0 ? 0 : std::ilogb (value)) - 32;
+          origin = int64_t (std::floor (std::ldexp (value, -scale))) - int64_t (num_fine_bins/2);
+          counts.assign (num_fine_bins, 0);
+          values.assign (num_fine_bins, NaN);
+          return;
+        }
+        int new_scale = scale;
+        while (std::abs (value) >= std::ldexp (0x1p60, new_scale))
+          ++new_scale;
+        const int64_t index = std::floor (std::ldexp (value, -new_scale));
+        int64_t first, last;
+        if (!occupied (first, last))
+          first = last = origin;
+        fit (new_scale,
+             std::min (shift (first, new_scale - scale), index),
+             std::max (shift (last, new_scale - scale), index));
+      }
+
+
+
+      bool Provisional::occupied (int64_t& first, int64_t& last) const
+      {
+        size_t n = 0;
+        while (n != counts.size() && !counts[n])
+          ++n;
+        if (n == counts.size())
+          return false;
+        first = origin + int64_t(n);
+        n = counts.size() - 1;
+        while (!counts[n])
+          --n;
+        last = origin + int64_t(n);
+        return true;
+      }
+
+
+
+      void Provisional::fit (int new_scale, int64_t first, int64_t last)
+      {
+        // first & last are the fine bin indices to be covered, at the new scale
+        while (last - first >= int64_t(num_fine_bins)) {
+          ++new_scale;
+          first = shift (first, 1);
+          last = shift (last, 1);
+        }
+        const int64_t new_origin = first - (int64_t(num_fine_bins) - 1 - (last - first)) / 2;
+        vector<size_t> old_counts (num_fine_bins, 0);
+        vector<default_type> old_values (num_fine_bins, NaN);
+        std::swap (counts, old_counts);
+        std::swap (values, old_values);
+        const int old_scale = scale;
+        const int64_t old_origin = origin;
+        scale = new_scale;
+        origin = new_origin;
+        for (size_t n = 0; n != old_counts.size(); ++n) {
+          if (old_counts[n])
+            add_to_bin (shift (old_origin + int64_t(n), new_scale - old_scale) - new_origin, old_counts[n], old_values[n]);
+        }
+      }
+
+
+
+
+
+
       Data::cdf_type Data::cdf() const
       {
         cdf_type result (list.size());
@@ -18,11 +18,13 @@
 #define __algo_histogram_h__
 
 #include <cmath>
+#include <mutex>
 
 #include "image_helpers.h"
 #include "types.h"
 #include "adapter/replicate.h"
 #include "algo/loop.h"
+#include "algo/threaded_loop.h"
 
 namespace MR
 {
@@ -62,6 +64,16 @@ namespace MR
             return (*this) (typename T::value_type (val));
           }
 
+          //! process a contiguous block of \a count values
+          template <typename value_type>
+          void add (const value_type* values, const size_t count) {
+            for (size_t n = 0; n != count; ++n)
+              (*this) (values[n]);
+          }
+
+          //! include the range (and any retained data) of \a other
+          void merge (const Calibrator& other);
+
           void from_file (const std::string&);
 
           void finalize (const size_t num_volumes, const bool is_integer);
@@ -112,6 +124,35 @@ namespace MR
             return true;
           }
 
+          //! bin a contiguous block of \a count values
+          /*! the bin positions are computed for a block of values at a time
+           * in a tight loop free of branches (amenable to vectorisation by
+           * the compiler), before the corresponding bins are incremented. */
+          template <typename value_type>
+          void add (const value_type* values, const size_t count) {
+            constexpr size_t block_size = 256;
+            default_type pos[block_size];
+            const default_type min = info.get_min(), bin_width = info.get_bin_width();
+            const default_type num_bins = list.size();
+            const bool ignore_zero = info.get_ignore_zero();
+            for (size_t start = 0; start < count; start += block_size) {
+              const value_type* block = values + start;
+              const size_t n = std::min (block_size, count - start);
+              for (size_t i = 0; i != n; ++i)
+                pos[i] = std::floor ((block[i] - min) / bin_width);
+              for (size_t i = 0; i != n; ++i) {
+                if (std::isfinite (block[i]) && !(ignore_zero && block[i] == 0.0) && pos[i] >= 0.0 && pos[i] < num_bins)
+                  ++list[size_t(pos[i])];
+              }
+            }
+          }
+
+          //! add the bin counts of \a other, which must share the same calibration
+          void merge (const Data& other) {
+            assert (other.list.size() == list.size());
+            list += other.list;
+          }
+
           template <typename value_type>
           size_t bin (const value_type val) const {
             size_t pos = std::floor ((val - info.get_min()) / info.get_bin_width());
@@ -140,15 +181,171 @@ namespace MR
           const Calibrator info;
           vector_type list;
           friend class Kernel;
+          friend class Provisional;
+      };
+
+
+
+
+      //! a provisional histogram, for calibrating & binning in a single pass
+      /*! Values are counted in a fine histogram whose range expands as
+       * required: its bins are aligned to multiples of a power-of-two bin
+       * width, which is doubled (merging pairs of bins) whenever the values
+       * no longer fit within its fixed number of bins. The range of the
+       * values is tracked by a Calibrator as usual; once all values have
+       * been added, finalize() calibrates the histogram, and each fine bin
+       * is assigned to the final bin containing its centre.
+       *
+       * Fine bins whose values are all equal are binned exactly, so data
+       * quantised more coarsely than the fine bins (such as integer-valued
+       * data) give exactly the same counts as separate calibration and
+       * binning. Otherwise, the fine bins are at most 1/128 of the width of
+       * the final bins if the number of bins is specified, or 1/32768 of the
+       * range of the values otherwise; only values lying within one fine bin
+       * of a boundary between final bins may be counted in the adjacent
+       * bin. */
+      class Provisional
+      { MEMALIGN (Provisional)
+        public:
+          Provisional (const size_t number_of_bins = 0, const bool ignorezero = false) :
+              calibrator (number_of_bins, ignorezero),
+              max_count (0),
+              num_fine_bins (std::max (number_of_bins, size_t(256)) * 256),
+              scale (0),
+              origin (0) { }
+
+          template <typename value_type>
+          typename std::enable_if<std::is_arithmetic<value_type>::value, bool>::type operator() (const value_type val) {
+            if (std::isfinite (val) && !(calibrator.get_ignore_zero() && val == 0.0)) {
+              const default_type value (val);
+              if (value > calibrator.get_max())
+                max_count = 1;
+              else if (value == calibrator.get_max())
+                ++max_count;
+              calibrator (value);
+              const size_t n = index (value);
+              add_to_bin (n, 1, value);
+            }
+            return true;
+          }
+
+          template <class T>
+          FORCE_INLINE typename std::enable_if<!std::is_arithmetic<T>::value, bool>::type operator() (const T& val) {
+            return (*this) (typename T::value_type (val));
+          }
+
+          //! process a contiguous block of \a count values
+          template <typename value_type>
+          void add (const value_type* values, const size_t count) {
+            for (size_t n = 0; n != count; ++n)
+              (*this) (values[n]);
+          }
+
+          //! include the values counted by \a other
+          void merge (const Provisional& other);
+
+          //! calibrate the histogram from the values seen, and bin them
+          Data finalize (const size_t num_volumes, const bool is_integer);
+
+        private:
+          Calibrator calibrator;
+          size_t max_count;
+          const size_t num_fine_bins;
+          // the fine bins are of width 2^scale, the first spanning
+          //   [ origin * 2^scale, (origin+1) * 2^scale )
+          int scale;
+          int64_t origin;
+          vector<size_t> counts;
+          // the value counted in each fine bin, if all such values are equal
+          vector<default_type> values;
+
+          void add_to_bin (const size_t n, const size_t count, const default_type value) {
+            if (!counts[n])
+              values[n] = value;
+            else if (values[n] != value)
+              values[n] = NaN;
+            counts[n] += count;
+          }
+
+          size_t index (const default_type value) {
+            if (!counts.empty() && std::abs (value) < std::ldexp (0x1p60, scale)) {
+              const int64_t i = std::floor (std::ldexp (value, -scale));
+              if (i >= origin && i < origin + int64_t(num_fine_bins))
+                return i - origin;
+            }
+            include (value);
+            return int64_t (std::floor (std::ldexp (value, -scale))) - origin;
+          }
+
+          void include (const default_type);
+          bool occupied (int64_t& first, int64_t& last) const;
+          void fit (int new_scale, int64_t first, int64_t last);
       };
 
 
+      //! \cond skip
+      namespace
+      {
+        // per-thread accumulation of image values into a Calibrator or
+        // Data instance, merged into the overall result on destruction
+        template <class ImageType, class AccumulatorType>
+        class __Accumulate
+        { MEMALIGN (__Accumulate<ImageType,AccumulatorType>)
+          public:
+            using value_type = typename ImageType::value_type;
+
+            __Accumulate (AccumulatorType& overall, const AccumulatorType& initial) :
+                overall (overall),
+                local (initial),
+                count (0) { }
+
+            __Accumulate (const __Accumulate& that) :
+                overall (that.overall),
+                local (that.local),
+                count (0) { }
+
+            ~__Accumulate () {
+              local.add (buffer, count);
+              std::lock_guard<std::mutex> lock (mutex);
+              overall.merge (local);
+            }
+
+            void operator() (ImageType& image) {
+              buffer[count++] = image.value();
+              if (count == buffer_size) {
+                local.add (buffer, count);
+                count = 0;
+              }
+            }
+
+            template <class MaskType>
+            void operator() (ImageType& image, MaskType& mask) {
+              if (mask.value())
+                (*this) (image);
+            }
+
+          private:
+            static constexpr size_t buffer_size = 256;
+            AccumulatorType& overall;
+            AccumulatorType local;
+            value_type buffer[buffer_size];
+            size_t count;
+            static std::mutex mutex;
+        };
+        template <class ImageType, class AccumulatorType>
+        std::mutex __Accumulate<ImageType,AccumulatorType>::mutex;
+      }
+      //! \endcond
+
+
+
       // Convenience functions for calibrating (& histograming) basic input images
+      // These are multi-threaded: each thread accumulates its own calibration
+      //   or histogram, and these are merged once all threads have completed
       template <class ImageType>
       void calibrate (Calibrator& result, ImageType& image)
       {
-        for (auto l = Loop(image) (image); l; ++l)
-          result (image.value());
+        ThreadedLoop (image).run (__Accumulate<ImageType,Calibrator> (result, Calibrator (result.get_num_bins(), result.get_ignore_zero())), image);
         result.finalize (image.ndim() > 3 ? image.size(3) : 1, std::is_integral<typename ImageType::value_type>::value);
       }
 
@@ -162,35 +359,41 @@ namespace MR
         if (!dimensions_match (image, mask, 0, 3))
           throw Exception ("Image and mask for histogram calibration do not match");
         Adapter::Replicate<MaskType> mask_replicate (mask, image);
-        for (auto l = Loop(image) (image, mask_replicate); l; ++l) {
-          if (mask_replicate.value())
-            result (image.value());
-        }
+        ThreadedLoop (image).run (__Accumulate<ImageType,Calibrator> (result, Calibrator (result.get_num_bins(), result.get_ignore_zero())), image, mask_replicate);
         result.finalize (image.ndim() > 3 ? image.size(3) : 1, std::is_integral<typename ImageType::value_type>::value);
       }
 
+      //! calibrate and generate a histogram in a single pass through the image
+      /*! The values are counted in a Provisional histogram, which is binned
+       * once the calibration is known; see Provisional for the accuracy of
+       * the resulting bin counts. Use calibrate() followed by
+       * generate (calibrator, ...) if exact counts are required. */
       template <class ImageType>
       Data generate (ImageType& image, const size_t num_bins, const bool ignore_zero = false)
       {
-        Calibrator calibrator (num_bins, ignore_zero);
-        calibrate (calibrator, image);
-        return generate (calibrator, image);
+        Provisional result (num_bins, ignore_zero);
+        ThreadedLoop (image).run (__Accumulate<ImageType,Provisional> (result, Provisional (num_bins, ignore_zero)), image);
+        return result.finalize (image.ndim() > 3 ? image.size(3) : 1, std::is_integral<typename ImageType::value_type>::value);
       }
 
       template <class ImageType, class MaskType>
       Data generate (ImageType& image, MaskType& mask, const size_t num_bins, const bool ignore_zero = false)
       {
-        Calibrator calibrator (num_bins, ignore_zero);
-        calibrate (calibrator, image, mask);
-        return generate (calibrator, image, mask);
+        if (!mask.valid())
+          return generate (image, num_bins, ignore_zero);
+        if (!dimensions_match (image, mask, 0, 3))
+          throw Exception ("Image and mask for histogram generation do not match");
+        Provisional result (num_bins, ignore_zero);
+        Adapter::Replicate<MaskType> mask_replicate (mask, image);
+        ThreadedLoop (image).run (__Accumulate<ImageType,Provisional> (result, Provisional (num_bins, ignore_zero)), image, mask_replicate);
+        return result.finalize (image.ndim() > 3 ? image.size(3) : 1, std::is_integral<typename ImageType::value_type>::value);
       }
 
       template <class ImageType>
       Data generate (const Calibrator& calibrator, ImageType& image)
       {
         Data result (calibrator);
-        for (auto l = Loop(image) (image); l; ++l)
-          result (typename ImageType::value_type (image.value()));
+        ThreadedLoop (image).run (__Accumulate<ImageType,Data> (result, Data (calibrator)), image);
         return result;
       }
 
@@ -203,10 +406,7 @@ namespace MR
           throw Exception ("Image and mask for histogram generation do not match");
         Data result (calibrator);
         Adapter::Replicate<MaskType> mask_replicate (mask, image);
-        for (auto l = Loop(image) (image, mask_replicate); l; ++l) {
-          if (mask_replicate.value())
-            result (typename ImageType::value_type (image.value()));
-        }
+        ThreadedLoop (image).run (__Accumulate<ImageType,Data> (result, Data (calibrator)), image, mask_replicate);
         return result;
       }
 
@@ -32,6 +32,62 @@ namespace MR
         }
     };
 
+
+    // copy whole rows along the first inner axis in one go, to make use of
+    // the bulk get_row() / set_row() methods where available:
+    template <class InputImageType, class OutputImageType>
+      struct __copy_row_func { MEMALIGN(__copy_row_func<InputImageType,OutputImageType>)
+        using in_value_type = typename InputImageType::value_type;
+        using out_value_type = typename OutputImageType::value_type;
+
+        __copy_row_func (const vector<size_t>& outer_axes, const vector<size_t>& inner_axes, const InputImageType& in, const OutputImageType& out) :
+          outer_axes (outer_axes), inner_axes (inner_axes.begin()+1, inner_axes.end()), axis (inner_axes[0]),
+          in (in), out (out), count (in.size (axis)),
+          in_row (new in_value_type [count]), out_row (new out_value_type [count]) { }
+
+        __copy_row_func (const __copy_row_func& that) :
+          outer_axes (that.outer_axes), inner_axes (that.inner_axes), axis (that.axis),
+          in (that.in), out (that.out), count (that.count),
+          in_row (new in_value_type [count]), out_row (new out_value_type [count]) { }
+
+        void operator() (const Iterator& pos) {
+          assign_pos_of (pos, outer_axes).to (in, out);
+          in.index (axis) = out.index (axis) = 0;
+          if (inner_axes.empty())
+            copy_row();
+          else
+            for (auto i = Loop (inner_axes) (in, out); i; ++i)
+              copy_row();
+        }
+
+        FORCE_INLINE void copy_row () {
+          get_row (in, axis, in_row.get(), count);
+          for (size_t n = 0; n < count; ++n)
+            out_row[n] = in_row[n];
+          set_row (out, axis, out_row.get(), count);
+        }
+
+        const vector<size_t>& outer_axes;
+        const vector<size_t> inner_axes;
+        const size_t axis;
+        InputImageType in;
+        OutputImageType out;
+        const size_t count;
+        std::unique_ptr<in_value_type[]> in_row;
+        std::unique_ptr<out_value_type[]> out_row;
+    };
+
+    template <class InputImageType, class OutputImageType, class LoopType>
+      inline void __threaded_copy (LoopType&& loop, InputImageType& source, OutputImageType& destination)
+      {
+        if (has_row_access<InputImageType>::value || has_row_access<OutputImageType>::value) {
+          loop.run_outer (__copy_row_func<InputImageType,OutputImageType> (loop.outer_loop.axes, loop.inner_axes, source, destination));
+          check_app_exit_code();
+        }
+        else
+          loop.run (__copy_func(), source, destination);
+      }
+
   }
 
   //! \endcond
@@ -46,8 +102,7 @@ namespace MR
         const vector<size_t>& axes,
         size_t num_axes_in_thread = 1) 
     {
-      ThreadedLoop (source, axes, num_axes_in_thread)
-        .run (__copy_func(), source, destination);
+      __threaded_copy (ThreadedLoop (source, axes, num_axes_in_thread), source, destination);
     }
 
   template <class InputImageType, class OutputImageType>
@@ -58,8 +113,7 @@ namespace MR
         size_t to_axis = std::numeric_limits<size_t>::max(),
         size_t num_axes_in_thread = 1)
     {
-      ThreadedLoop (source, from_axis, to_axis, num_axes_in_thread)
-        .run (__copy_func(), source, destination);
+      __threaded_copy (ThreadedLoop (source, from_axis, to_axis, num_axes_in_thread), source, destination);
     }
 
 
@@ -73,8 +127,7 @@ namespace MR
         const vector<size_t>& axes,
         size_t num_axes_in_thread = 1)
     {
-      ThreadedLoop (message, source, axes, num_axes_in_thread)
-        .run (__copy_func(), source, destination);
+      __threaded_copy (ThreadedLoop (message, source, axes, num_axes_in_thread), source, destination);
     }
 
   template <class InputImageType, class OutputImageType>
@@ -86,8 +139,7 @@ namespace MR
         size_t to_axis = std::numeric_limits<size_t>::max(), 
         size_t num_axes_in_thread = 1)
     {
-      ThreadedLoop (message, source, from_axis, to_axis, num_axes_in_thread)
-        .run (__copy_func(), source, destination);
+      __threaded_copy (ThreadedLoop (message, source, from_axis, to_axis, num_axes_in_thread), source, destination);
     }
 
 
@@ -1055,22 +1055,8 @@ namespace MR
 
 
 
-    void parse ()
+    void check_arguments ()
     {
-      argument.clear();
-      option.clear();
-
-      sort_arguments (argc, argv);
-
-      if (get_options ("help").size()) {
-        print_help();
-        throw 0;
-      }
-      if (get_options ("version").size()) {
-        print (version_string());
-        throw 0;
-      }
-
       size_t num_args_required = 0;
       size_t num_optional_arguments = 0;
 
@@ -1088,11 +1074,6 @@ namespace MR
           ++num_args_required;
       }
 
-      if (!option.size() && !argument.size() && REQUIRES_AT_LEAST_ONE_ARGUMENT) {
-        print_help ();
-        throw 0;
-      }
-
       if (num_optional_arguments && num_args_required > argument.size())
         throw Exception ("Expected at least " + str (num_args_required)
             + " arguments (" + str (argument.size()) + " supplied)");
@@ -1159,21 +1140,6 @@ namespace MR
         }
       }
 
-      parse_standard_options();
-
-      File::Config::init ();
-
-      //CONF option: FailOnWarn
-      //CONF default: 0 (false)
-      //CONF A boolean value specifying whether MRtrix applications should
-      //CONF abort as soon as any (otherwise non-fatal) warning is issued.
-      fail_on_warn = File::Config::get_bool ("FailOnWarn", false);
-
-      //CONF option: TerminalColor
-      //CONF default: 1 (true)
-      //CONF A boolean value to indicate whether colours should be used in the terminal.
-      terminal_use_colour = File::Config::get_bool ("TerminalColor", terminal_use_colour);
-
       // check for the existence of all specified input files (including optional ones that have been provided)
       // if necessary, also check for pre-existence of any output files with known paths
       //   (if the output is e.g. given as a prefix, the argument should be flagged as type_text())
@@ -1232,6 +1198,47 @@ namespace MR
             throw Exception ("output track file \"" + text + "\" for option \"-" + std::string(i.opt->id) + "\" must use the .tck suffix");
         }
       }
+    }
+
+
+
+    void parse ()
+    {
+      argument.clear();
+      option.clear();
+
+      sort_arguments (argc, argv);
+
+      if (get_options ("help").size()) {
+        print_help();
+        throw 0;
+      }
+      if (get_options ("version").size()) {
+        print (version_string());
+        throw 0;
+      }
+
+      if (!option.size() && !argument.size() && REQUIRES_AT_LEAST_ONE_ARGUMENT) {
+        print_help ();
+        throw 0;
+      }
+
+      parse_standard_options();
+
+      File::Config::init ();
+
+      //CONF option: FailOnWarn
+      //CONF default: 0 (false)
+      //CONF A boolean value specifying whether MRtrix applications should
+      //CONF abort as soon as any (otherwise non-fatal) warning is issued.
+      fail_on_warn = File::Config::get_bool ("FailOnWarn", false);
+
+      //CONF option: TerminalColor
+      //CONF default: 1 (true)
+      //CONF A boolean value to indicate whether colours should be used in the terminal.
+      terminal_use_colour = File::Config::get_bool ("TerminalColor", terminal_use_colour);
+
+      check_arguments();
 
       SignalHandler::init();
     }
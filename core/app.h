@@ -193,6 +193,14 @@ namespace MR
     //! do the actual parsing of the command-line [used internally]
     void parse ();
 
+    //! check the parsed arguments and options against the command's usage
+    /*! This assigns each argument to its definition, and checks the number
+     * of arguments and options supplied, the existence of input files, and
+     * that output files will not be overwritten unless -force is set. It is
+     * called by parse(), and can be used to check sets of arguments
+     * subsequently placed in App::argument and App::option. */
+    void check_arguments ();
+
     //! sort command-line tokens into arguments and options [used internally]
     void sort_arguments (int argc, const char* const* argv);
 
@@ -274,6 +282,7 @@ namespace MR
         friend class Options;
         friend void  MR::App::init (int argc, const char* const* argv);
         friend void  MR::App::parse ();
+        friend void  MR::App::check_arguments ();
         friend void  MR::App::sort_arguments (int argc, const char* const* argv);
     };
 
@@ -16,6 +16,8 @@
 
 
 #include "filter/connected_components.h"
+#include "thread_queue.h"
+#include "misc/union_find.h"
 
 namespace MR
 {
@@ -26,7 +28,7 @@ namespace MR
 
     void Connector::Adjacency::initialise (const Header& header, const Voxel2Vector& v2v)
     {
-      data.clear();
+      clear();
       // Simplify handling of 4D images: don't need to keep checking
       //   size of axes against number of image dimensions
       if (header.ndim() < 3)
@@ -34,7 +36,7 @@ namespace MR
       if (header.ndim() > enabled_axes.size())
         enabled_axes.resize (header.ndim(), false);
       // Begin by disabling adjacency offsets for those axes for which adjacency is not permitted
-      vector< vector<int> > offsets;
+      vector< vector<int> > neighbour_offsets;
       vector<int> o (header.ndim(), -1);
       size_t start_axis = 0;
       for (size_t axis = 0; axis != header.ndim(); ++axis) {
@@ -53,7 +55,7 @@ namespace MR
         // - Don't add self-connection
         if (!(!use_26_neighbours && ((abs(o[0]) + abs(o[1]) + abs(o[2])) > 1))
             && (abs(o[0]) + abs(o[1]) + abs(o[2]) > 0))
-          offsets.push_back (o);
+          neighbour_offsets.push_back (o);
         // Find the next offset to be tested
         ++o[start_axis];
         for (size_t axis = start_axis; axis != header.ndim(); ++axis) {
@@ -73,11 +75,14 @@ namespace MR
       // This may appear different to previous code, given the use of the Voxel2Vector class
       vector<index_t> pos (header.ndim());
       vector<int> neighbour (header.ndim());
-      data.reserve (v2v.size());
+      vector<index_t> indices;
+      offsets.reserve (v2v.size() + 1);
+      forward_offsets.reserve (v2v.size());
+      offsets.push_back (0);
       for (size_t i = 0; i != v2v.size(); ++i) {
         pos = v2v[i];
-        vector<index_t> indices;
-        for (auto o : offsets) {
+        indices.clear();
+        for (const auto& o : neighbour_offsets) {
           for (size_t axis = 0; axis != header.ndim(); ++axis)
             neighbour[axis] = pos[axis] + o[axis];
           // Is this a valid neighbour position, i.e. within the mask?
@@ -87,9 +92,12 @@ namespace MR
           if (j != v2v.invalid)
             indices.push_back (j);
         }
-        data.push_back (indices);
+        std::sort (indices.begin(), indices.end());
+        forward_offsets.push_back (data.size() + (std::upper_bound (indices.begin(), indices.end(), index_t(i)) - indices.begin()));
+        data.insert (data.end(), indices.begin(), indices.end());
+        offsets.push_back (data.size());
       }
-      DEBUG("Adjacency data for " + str(data.size()) + " voxels initialised");
+      DEBUG("Adjacency data for " + str(size()) + " voxels initialised");
     }
 
 
@@ -98,54 +106,54 @@ namespace MR
                          vector<uint32_t>& labels) const
     {
       assert (adjacency.size());
-      labels.resize (adjacency.size(), 0);
-      uint32_t current_label = 0;
-      for (uint32_t i = 0; i < labels.size(); i++) {
-        // This node has not been already clustered
-        if (!labels[i]) {
-          Cluster cluster (++current_label);
-          depth_first_search (i, cluster, labels);
-          clusters.push_back (cluster);
-        }
-      }
-      if (clusters.size() > std::numeric_limits<uint32_t>::max())
-        throw Exception ("The number of clusters is larger than can be labelled with an unsigned 32bit integer.");
+      label (clusters, labels, vector<uint8_t> (adjacency.size(), 1));
     }
 
 
 
-    bool Connector::next_neighbour (uint32_t& node, vector<uint32_t>& labels) const
+    void Connector::label (vector<Cluster>& clusters,
+                           vector<uint32_t>& labels,
+                           const vector<uint8_t>& mask) const
     {
-      for (auto n : adjacency[node]) {
-        if (!labels[n]) {
-          node = n;
-          return true;
+      const size_t num_elements = adjacency.size();
+      UnionFind forest (num_elements);
+
+      auto merge = [&] (const size_t from, const size_t to) {
+        for (size_t i = from; i != to; ++i) {
+          if (mask[i]) {
+            for (auto j : adjacency.forward (i)) {
+              if (mask[j])
+                forest.merge (i, j);
+            }
+          }
         }
+      };
+
+      const size_t block_size = 4096;
+      if (multithreaded && num_elements > block_size) {
+        size_t next_block = 0;
+        auto source = [&] (size_t& out) { out = next_block; next_block += block_size; return (out < num_elements); };
+        auto sink = [&] (const size_t& in) { merge (in, std::min (in + block_size, num_elements)); return true; };
+        Thread::run_queue (source, size_t(), Thread::multi (sink));
+      } else {
+        merge (0, num_elements);
       }
-      return false;
-    }
 
-
-
-    void Connector::depth_first_search (const uint32_t root,
-                                        Cluster& cluster,
-                                        vector<uint32_t>& labels) const
-    {
-      uint32_t node = root;
-      std::stack<uint32_t> stack;
-      while (true) {
-        labels[node] = cluster.label;
-        stack.push (node);
-        cluster.size++;
-        if (next_neighbour (node, labels)) {
-          continue;
-        } else {
-          do {
-            if (stack.top() == root)
-              return;
-            stack.pop();
-            node = stack.top();
-          } while (!next_neighbour (node, labels));
+      // The root of each cluster is its element with the lowest index,
+      //   and is therefore always encountered before any other member
+      labels.assign (num_elements, 0);
+      for (size_t i = 0; i != num_elements; ++i) {
+        if (mask[i]) {
+          const size_t root = forest.find (i);
+          if (root == i) {
+            if (clusters.size() == std::numeric_limits<uint32_t>::max())
+              throw Exception ("The number of clusters is larger than can be labelled with an unsigned 32bit integer.");
+            clusters.push_back (Cluster (clusters.size() + 1));
+            labels[i] = clusters.size();
+          } else {
+            labels[i] = labels[root];
+          }
+          ++clusters[labels[i]-1].size;
         }
       }
     }
@@ -25,7 +25,6 @@
 #include "filter/base.h"
 #include "misc/voxel2vector.h"
 
-#include <stack>
 #include <iostream>
 
 
@@ -53,6 +52,19 @@ namespace MR
           public:
             typedef Voxel2Vector::index_t index_t;
 
+            // Lightweight view of the (sorted) list of elements adjacent to a particular element
+            class Neighbours
+            { NOMEMALIGN
+              public:
+                Neighbours (const index_t* first, const index_t* last) : first (first), last (last) { }
+                const index_t* begin() const { return first; }
+                const index_t* end() const { return last; }
+                size_t size() const { return last - first; }
+              private:
+                const index_t* first;
+                const index_t* last;
+            };
+
             Adjacency() :
                 use_26_neighbours (false),
                 enabled_axes (3, true) { }
@@ -61,33 +73,52 @@ namespace MR
               if (axis > enabled_axes.size())
                 enabled_axes.resize (axis+1, false);
               enabled_axes[axis] = value;
-              data.clear();
+              clear();
             }
 
             void set_axes (const vector<bool>& i) {
               enabled_axes = i;
-              data.clear();
+              clear();
             }
 
             void initialise (const Header&, const Voxel2Vector&);
 
-            const vector<index_t>& operator[] (const size_t index) const {
+            // All elements adjacent to element \a index
+            Neighbours operator[] (const size_t index) const {
+              assert (size());
+              assert (index < size());
+              return Neighbours (data.data() + offsets[index], data.data() + offsets[index+1]);
+            }
+
+            // Only those elements adjacent to element \a index that have a greater index;
+            //   visiting these for all elements visits every adjacency exactly once
+            Neighbours forward (const size_t index) const {
               assert (size());
               assert (index < size());
-              return data[index];
+              return Neighbours (data.data() + forward_offsets[index], data.data() + offsets[index+1]);
             }
 
             void set_26_adjacency (const bool i) {
               use_26_neighbours = i;
-              data.clear();
+              clear();
             }
 
-            size_t size() const { return data.size(); }
+            size_t size() const { return offsets.size() ? offsets.size() - 1 : 0; }
 
           private:
             bool use_26_neighbours;
             vector<bool> enabled_axes;
-            vector<vector<index_t>> data;
+            // Adjacency stored in compressed form: the neighbours of element i
+            //   are data[offsets[i]] to data[offsets[i+1]-1], in increasing order;
+            //   those with index greater than i begin at data[forward_offsets[i]]
+            vector<size_t> offsets, forward_offsets;
+            vector<index_t> data;
+
+            void clear() {
+              offsets.clear();
+              forward_offsets.clear();
+              data.clear();
+            }
         } adjacency;
 
 
@@ -112,7 +143,12 @@ namespace MR
 
 
 
-        Connector () { }
+        Connector () : multithreaded (false) { }
+
+        // Perform the union pass across multiple threads; this should only be
+        //   enabled if the caller is not itself invoking run() from multiple
+        //   threads concurrently (e.g. across permutations)
+        void set_multithreaded (const bool i) { multithreaded = i; }
 
         // Perform connected components on vectorized binary data
         void run (vector<Cluster>&, vector<uint32_t>&) const;
@@ -123,17 +159,14 @@ namespace MR
 
       private:
 
-        // Utility functions that perform the actual connected
-        //   components functionality
-        bool next_neighbour (uint32_t&, vector<uint32_t>&) const;
-        template <class VectorType>
-        bool next_neighbour (uint32_t&, vector<uint32_t>&,
-                             const VectorType&, const float) const;
+        bool multithreaded;
 
-        void depth_first_search (const uint32_t, Cluster&, vector<uint32_t>&) const;
-        template <class VectorType>
-        void depth_first_search (const uint32_t, Cluster&, vector<uint32_t>&,
-                                 const VectorType&, const float) const;
+        // Label connected components among those elements for which mask is non-zero
+        // Adjacent elements are first merged within a disjoint-set forest; labels
+        //   are then assigned in order of the lowest element index within each
+        //   cluster, which provides the same labelling as a depth-first search
+        //   seeded from each unlabelled element in turn
+        void label (vector<Cluster>&, vector<uint32_t>&, const vector<uint8_t>&) const;
 
 
     };
@@ -147,63 +180,10 @@ namespace MR
                          const float threshold) const
     {
       assert (adjacency.size());
-      labels.resize (adjacency.size(), 0);
-      uint32_t current_label = 0;
-      for (uint32_t i = 0; i < labels.size(); i++) {
-        // This node has not been already clustered and is above threshold
-        if (!labels[i] && data[i] > threshold) {
-          Cluster cluster (++current_label);
-          depth_first_search (i, cluster, labels, data, threshold);
-          clusters.push_back (cluster);
-        }
-      }
-      if (clusters.size() > std::numeric_limits<uint32_t>::max())
-        throw Exception ("The number of clusters is larger than can be labelled with an unsigned 32bit integer.");
-    }
-
-
-
-    template <class VectorType>
-    bool Connector::next_neighbour (uint32_t& node,
-                                    vector<uint32_t>& labels,
-                                    const VectorType& data,
-                                    const float threshold) const
-    {
-      for (auto n : adjacency[node]) {
-        if (!labels[n] && data[n] > threshold) {
-          node = n;
-          return true;
-        }
-      }
-      return false;
-    }
-
-
-
-    template <class VectorType>
-    void Connector::depth_first_search (const uint32_t root,
-                                        Cluster& cluster,
-                                        vector<uint32_t>& labels,
-                                        const VectorType& data,
-                                        const float threshold) const
-    {
-      uint32_t node = root;
-      std::stack<uint32_t> stack;
-      while (true) {
-        labels[node] = cluster.label;
-        stack.push (node);
-        cluster.size++;
-        if (next_neighbour (node, labels, data, threshold)) {
-          continue;
-        } else {
-          do {
-            if (stack.top() == root)
-              return;
-            stack.pop();
-            node = stack.top();
-          } while (!next_neighbour (node, labels, data, threshold));
-        }
-      }
+      vector<uint8_t> mask (adjacency.size());
+      for (size_t i = 0; i != mask.size(); ++i)
+        mask[i] = data[i] > threshold;
+      label (clusters, labels, mask);
     }
 
 
@@ -257,6 +237,7 @@ namespace MR
           Voxel2Vector v2v (in, *this);
 
           Connector connector;
+          connector.set_multithreaded (true);
           connector.adjacency.set_axes (enabled_axes);
           connector.adjacency.set_26_adjacency (do_26_connectivity);
           connector.adjacency.initialise (in, v2v);
@@ -22,6 +22,7 @@
 #include <unsupported/Eigen/FFT>
 
 #include "datatype.h"
+#include "math/fft.h"
 #include "memory.h"
 #include "image.h"
 #include "algo/copy.h"
@@ -99,8 +100,10 @@ namespace MR
                   break;
                 }
               }
-              FFTKernel<decltype(temp)> kernel (temp, *axis, inverse);
-              ThreadedLoop (temp, axes, 1).run (kernel);
+              // all lines along the innermost remaining axis are transformed in one batch:
+              auto loop = ThreadedLoop (temp, axes, 1);
+              FFTKernel<decltype(temp)> kernel (temp, *axis, loop.inner_axes[0], inverse);
+              loop.run_outer (kernel);
               if (progress) ++(*progress);
             }
 
@@ -128,30 +131,33 @@ namespace MR
         template <class ComplexImageType>
         class FFTKernel { MEMALIGN(FFTKernel)
           public:
-            FFTKernel (const ComplexImageType& voxel, const size_t FFT_axis, const bool inverse_FFT) :
+            FFTKernel (const ComplexImageType& voxel, const size_t FFT_axis, const size_t batch_axis, const bool inverse_FFT) :
                 vox (voxel),
-                data_in (vox.size (FFT_axis)),
-                data_out (data_in.size()),
+                fft (vox.size (FFT_axis)),
+                data (vox.size (batch_axis), vox.size (FFT_axis)),
                 axis (FFT_axis),
+                batch_axis (batch_axis),
                 inverse (inverse_FFT) { }
 
             void operator () (const Iterator& pos) {
               assign_pos_of (pos).to (vox);
               for (vox.index(axis) = 0; vox.index(axis) < vox.size(axis); ++vox.index(axis))
-                data_in[vox.index(axis)] = cdouble (vox.value());
+                for (vox.index(batch_axis) = 0; vox.index(batch_axis) < vox.size(batch_axis); ++vox.index(batch_axis))
+                  data (ssize_t (vox.index(batch_axis)), ssize_t (vox.index(axis))) = cdouble (vox.value());
               if (inverse)
-                fft.inv (data_out, data_in);
+                fft.inverse (data);
               else
-                fft.fwd (data_out, data_in);
+                fft.forward (data);
               for (vox.index(axis) = 0; vox.index(axis) < vox.size(axis); ++vox.index(axis))
-                vox.value() = typename ComplexImageType::value_type (data_out[vox.index(axis)]);
+                for (vox.index(batch_axis) = 0; vox.index(batch_axis) < vox.size(batch_axis); ++vox.index(batch_axis))
+                  vox.value() = typename ComplexImageType::value_type (data (ssize_t (vox.index(batch_axis)), ssize_t (vox.index(axis))));
             }
 
           protected:
             ComplexImageType vox;
-            Eigen::Matrix<cdouble, Eigen::Dynamic, 1> data_in, data_out;
-            Eigen::FFT<double> fft;
-            size_t axis;
+            Math::BatchFFT<double> fft;
+            Math::BatchFFT<double>::array_type data;
+            size_t axis, batch_axis;
             bool inverse;
         };
 
@@ -88,6 +88,12 @@ namespace MR
           stdev = stdevs;
         }
 
+        //! use a recursive approximation to the Gaussian smoothing kernel
+        /*! \sa Smooth::set_recursive() */
+        void set_recursive (bool use_recursive) {
+          smoother.set_recursive (use_recursive);
+        }
+
 
         template <class InputImageType, class OutputImageType>
         void operator() (InputImageType& in, OutputImageType& out)
@@ -95,6 +101,7 @@ namespace MR
           if (magnitude) {
             Gradient full_gradient (in, false);
             full_gradient.set_stdev (stdev);
+            full_gradient.set_recursive (smoother.is_recursive());
             full_gradient.compute_wrt_scanner (wrt_scanner);
             full_gradient.set_message (message);
             auto temp = Image<float>::scratch (full_gradient, "full 3D gradient image");
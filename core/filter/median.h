@@ -17,8 +17,12 @@
 #ifndef __image_filter_median_h__
 #define __image_filter_median_h__
 
+#include <cmath>
+
 #include "image.h"
+#include "algo/loop.h"
 #include "algo/threaded_copy.h"
+#include "algo/threaded_loop.h"
 #include "adapter/median.h"
 #include "filter/base.h"
 
@@ -30,6 +34,16 @@ namespace MR
     @{ */
 
     /*! Smooth images using median filtering.
+     *
+     * Where the image intensities are all integers spanning a range of at
+     * most \c max_bins values (e.g. masks and label images), the filter
+     * uses a sliding-window histogram (Huang, Perreault & Hebert), with
+     * per-column histograms that are updated incrementally as the window
+     * moves from one row to the next. The cost per voxel then no longer
+     * depends on the in-plane extent of the kernel, and only linearly on
+     * its extent along the third axis. Other data are processed by
+     * sorting the full neighbourhood of each voxel, unless approximate
+     * filtering is requested (see set_approximate()).
      *
      * Typical usage:
      * \code
@@ -82,8 +96,19 @@ namespace MR
           extent = ext;
         }
 
+        //! Allow a fast approximate median for non-integer data.
+        //! Intensities are quantised into max_bins levels spanning the
+        //! intensity range of the image, so that the histogram-based
+        //! filter can be used; the output is then only accurate to within
+        //! half a quantisation step.
+        void set_approximate (bool value) {
+          approximate = value;
+        }
+
         template <class InputImageType, class OutputImageType>
         void operator() (InputImageType& in, OutputImageType& out) {
+          if (histogram_median (in, out))
+            return;
           Adapter::Median<InputImageType> median (in, extent);
           if (message.size())
             threaded_copy_with_progress_message (message, median, out);
@@ -91,8 +116,257 @@ namespace MR
             threaded_copy (median, out);
         }
 
+        //! the maximum number of histogram bins used for the histogram-based filter
+        static constexpr size_t max_bins = 4096;
+
     protected:
         vector<uint32_t> extent;
+        bool approximate = false;
+
+        static constexpr uint16_t nan_bin = std::numeric_limits<uint16_t>::max();
+
+
+        template <class InputImageType, class OutputImageType>
+        bool histogram_median (InputImageType& in, OutputImageType& out)
+        {
+          using value_type = typename InputImageType::value_type;
+          if (in.ndim() < 3 || (extent.size() != 1 && extent.size() != 3))
+            return false;
+
+          default_type min = std::numeric_limits<default_type>::infinity(), max = -min;
+          bool integer = true;
+          for (auto l = Loop (in) (in); l; ++l) {
+            const default_type value = in.value();
+            if (std::isnan (value))
+              continue;
+            if (!std::isfinite (value))
+              return false;
+            min = std::min (min, value);
+            max = std::max (max, value);
+            integer = integer && value == std::round (value);
+            if (!integer && !approximate)
+              return false;
+          }
+          if (min > max)
+            min = max = 0.0;
+
+          // bins hold either each integer value in the range, or equal-width intervals:
+          const bool exact = (integer || min == max) && max - min < max_bins;
+          if (!exact && !approximate)
+            return false;
+          const size_t num_bins = exact ? size_t (max - min) + 1 : max_bins;
+          const default_type bin_width = exact ? 1.0 : (max - min) / max_bins;
+
+          vector<default_type> bin_values (num_bins);
+          for (size_t b = 0; b < num_bins; ++b)
+            bin_values[b] = exact ? min + b : min + (b + 0.5) * bin_width;
+
+          auto bins = std::make_shared<vector<uint16_t>> (voxel_count (in));
+          for (auto l = Loop (in) (in); l; ++l) {
+            const default_type value = in.value();
+            (*bins)[voxel_offset (in)] = std::isnan (value) ? nan_bin :
+              uint16_t (std::min (num_bins-1, size_t ((value - min) / bin_width)));
+          }
+
+          vector<uint32_t> ext (extent.size() == 1 ? vector<uint32_t> (3, extent[0]) : extent);
+          for (auto& e : ext)
+            e = (e-1)/2;
+
+          vector<size_t> outer_axes;
+          for (size_t axis = 2; axis < out.ndim(); ++axis)
+            outer_axes.push_back (axis);
+
+          HistogramKernel<OutputImageType, value_type> kernel (out, bins, bin_values, ext);
+          if (message.size())
+            ThreadedLoop (message, out, outer_axes, { 0, 1 }).run_outer (kernel);
+          else
+            ThreadedLoop (out, outer_axes, { 0, 1 }).run_outer (kernel);
+          return true;
+        }
+
+
+        // offset of the current voxel within a buffer covering the whole image, with axis 0 contiguous
+        template <class ImageType>
+        static size_t voxel_offset (const ImageType& image) {
+          size_t offset = 0;
+          for (size_t axis = image.ndim(); axis-- > 0;)
+            offset = offset * image.size (axis) + image.index (axis);
+          return offset;
+        }
+
+
+        // computes the median over each row of voxels along axis 0, given
+        // the histogram bin of each voxel. Each column histogram covers the
+        // neighbourhood along axes 1 & 2 of one voxel in the row, and the
+        // window histogram is the sum of the column histograms within the
+        // kernel extent along axis 0. Both are held at two levels: the
+        // coarse histogram is kept up to date as the window slides, while
+        // each segment of the fine histogram is only brought up to date
+        // when the median falls within it.
+        template <class ImageType, typename ValueType>
+        class HistogramKernel { MEMALIGN(HistogramKernel)
+          public:
+            HistogramKernel (const ImageType& image, std::shared_ptr<vector<uint16_t>> bins,
+                const vector<default_type>& bin_values, const vector<uint32_t>& extent) :
+                image (image),
+                bins (bins),
+                bin_values (bin_values),
+                extent (extent),
+                num_bins (bin_values.size()),
+                segment_size (1),
+                nx (image.size(0)),
+                ny (image.size(1)),
+                nz (image.size(2)) {
+                  while (segment_size*segment_size < num_bins)
+                    segment_size *= 2;
+                  num_segments = (num_bins + segment_size - 1) / segment_size;
+                }
+
+            void operator() (const Iterator& pos)
+            {
+              assign_pos_of (pos).to (image);
+              image.index(0) = image.index(1) = 0;
+              const ssize_t z = image.index(2);
+              // offset of the start of the current volume:
+              image.index(2) = 0;
+              const size_t volume = voxel_offset (image);
+              image.index(2) = z;
+
+              column_fine.assign (nx * num_bins, 0);
+              column_coarse.assign (nx * num_segments, 0);
+              column_count.assign (nx, 0);
+              fine.resize (num_bins);
+              coarse.resize (num_segments);
+              updated.resize (num_segments);
+
+              const ssize_t z_from = std::max (z - ssize_t(extent[2]), ssize_t(0));
+              const ssize_t z_to = std::min (z + ssize_t(extent[2]) + 1, nz);
+              auto update_columns = [&] (const ssize_t y, const int32_t delta) {
+                for (ssize_t k = z_from; k < z_to; ++k) {
+                  const uint16_t* row = bins->data() + volume + nx*(y + ny*k);
+                  for (ssize_t x = 0; x < nx; ++x) {
+                    if (row[x] == nan_bin)
+                      continue;
+                    column_fine[x*num_bins + row[x]] += delta;
+                    column_coarse[x*num_segments + row[x]/segment_size] += delta;
+                    column_count[x] += delta;
+                  }
+                }
+              };
+
+              for (ssize_t y = 0; y < std::min (ssize_t(extent[1]), ny); ++y)
+                update_columns (y, 1);
+
+              for (image.index(1) = 0; image.index(1) < ny; ++image.index(1)) {
+                const ssize_t y = image.index(1);
+                if (y + ssize_t(extent[1]) < ny)
+                  update_columns (y + extent[1], 1);
+                if (y - ssize_t(extent[1]) > 0)
+                  update_columns (y - extent[1] - 1, -1);
+                process_row();
+              }
+            }
+
+          protected:
+            ImageType image;
+            std::shared_ptr<vector<uint16_t>> bins;
+            const vector<default_type> bin_values;
+            const vector<uint32_t> extent;
+            const size_t num_bins;
+            size_t segment_size, num_segments;
+            const ssize_t nx, ny, nz;
+            vector<uint32_t> column_fine, column_coarse, column_count;
+            vector<uint32_t> fine, coarse;
+            vector<ssize_t> updated;
+            ssize_t x, from, to;
+            size_t count;
+
+            void process_row ()
+            {
+              std::fill (coarse.begin(), coarse.end(), 0);
+              std::fill (updated.begin(), updated.end(), std::numeric_limits<ssize_t>::min());
+              count = 0;
+              from = 0;
+              to = -1;
+              while (to < std::min (ssize_t(extent[0]), nx-1))
+                add_coarse (++to, 1);
+
+              for (x = 0; x < nx; ++x) {
+                if (x > 0) {
+                  if (x + ssize_t(extent[0]) < nx)
+                    add_coarse (++to, 1);
+                  if (x - ssize_t(extent[0]) > 0)
+                    add_coarse (from++, -1);
+                }
+
+                image.index(0) = x;
+                if (!count) {
+                  image.value() = std::numeric_limits<ValueType>::quiet_NaN();
+                  continue;
+                }
+                // as for Math::median(), average the two middle values if the count is even:
+                const size_t upper = find (count/2);
+                const size_t lower = (count & 1U) ? upper : find (count/2 - 1);
+                image.value() = ValueType ((bin_values[upper] + bin_values[lower]) / 2.0);
+              }
+            }
+
+            void add_coarse (const ssize_t c, const int32_t sign)
+            {
+              const uint32_t* source = column_coarse.data() + c*num_segments;
+              for (size_t n = 0; n < num_segments; ++n)
+                coarse[n] += sign * source[n];
+              if (sign > 0)
+                count += column_count[c];
+              else
+                count -= column_count[c];
+            }
+
+            void add_fine (const ssize_t c, const size_t s, const int32_t sign)
+            {
+              const uint32_t* source = column_fine.data() + c*num_bins + s*segment_size;
+              uint32_t* target = fine.data() + s*segment_size;
+              const size_t size = std::min (segment_size, num_bins - s*segment_size);
+              for (size_t n = 0; n < size; ++n)
+                target[n] += sign * source[n];
+            }
+
+            // bring segment s of the fine histogram up to date with the current window,
+            // either incrementally or from scratch, whichever involves fewer columns:
+            void update_segment (const size_t s)
+            {
+              const ssize_t last = updated[s];
+              if (last == x)
+                return;
+              if (last < 0 || 2*(x - last) > to - from + 1) {
+                std::fill (fine.begin() + s*segment_size, fine.begin() + std::min ((s+1)*segment_size, num_bins), 0);
+                for (ssize_t c = from; c <= to; ++c)
+                  add_fine (c, s, 1);
+              }
+              else {
+                for (ssize_t n = last+1; n <= x; ++n) {
+                  if (n + ssize_t(extent[0]) < nx)
+                    add_fine (n + extent[0], s, 1);
+                  if (n - ssize_t(extent[0]) > 0)
+                    add_fine (n - extent[0] - 1, s, -1);
+                }
+              }
+              updated[s] = x;
+            }
+
+            // the bin holding the value of the given rank within the window
+            size_t find (size_t rank)
+            {
+              size_t s = 0;
+              for (; rank >= coarse[s]; ++s)
+                rank -= coarse[s];
+              update_segment (s);
+              size_t b = s*segment_size;
+              for (; rank >= fine[b]; ++b)
+                rank -= fine[b];
+              return b;
+            }
+        };
     };
     //! @}
   }
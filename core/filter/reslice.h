@@ -19,6 +19,7 @@
 
 #include "adapter/reslice.h"
 #include "algo/threaded_copy.h"
+#include "algo/threaded_loop.h"
 #include "datatype.h"
 
 namespace MR
@@ -26,6 +27,163 @@ namespace MR
   namespace Filter
   {
 
+    //! \cond skip
+    namespace
+    {
+      // interpolators exposing their weights for the current position (i.e.
+      //   Interp::Linear & Interp::Cubic) can be used with __ReslicePlan:
+      template <class InterpType>
+        class has_weights { NOMEMALIGN
+          typedef char yes[1], no[2];
+          template<typename C> static yes& test(decltype (std::declval<C&>().weights(), 0));
+          template<typename C> static no&  test(...);
+          public:
+          static bool const value = sizeof(test<InterpType>(0)) == sizeof(yes);
+        };
+
+
+
+      // resample a whole output row along axis 0 at a time for 4D images:
+      //   the sample positions, interpolation weights and (clamped) indices
+      //   of the contributing voxels are computed once for the row, and then
+      //   applied to all volumes, with the values for all volumes gathered in
+      //   one go for each contributing voxel
+      template <class InterpType, class ImageTypeSource, class ImageTypeDestination>
+        class __ReslicePlan { MEMALIGN(__ReslicePlan<InterpType,ImageTypeSource,ImageTypeDestination>)
+          public:
+            using value_type = typename ImageTypeSource::value_type;
+            using out_value_type = typename ImageTypeDestination::value_type;
+            using weights_type = typename InterpType::weights_type;
+            using coefficients_type = typename InterpType::coefficients_type;
+            using weights_table_type = Eigen::Matrix<typename weights_type::Scalar, weights_type::RowsAtCompileTime, Eigen::Dynamic>;
+
+            static constexpr ssize_t taps_per_axis = InterpType::taps_per_axis;
+            static constexpr ssize_t taps = taps_per_axis * taps_per_axis * taps_per_axis;
+
+            __ReslicePlan (const ImageTypeSource& source, const transform_type& direct_transform, const value_type value_when_out_of_bounds) :
+              interp (source, value_when_out_of_bounds),
+              source (source),
+              direct_transform (direct_transform),
+              num_volumes (source.size(3)) { }
+
+            void operator() (ImageTypeDestination& destination) {
+              const ssize_t nx = destination.size (0);
+              if (in_bounds.size() != size_t (nx)) {
+                in_bounds.resize (nx);
+                indices.resize (3 * taps_per_axis * nx);
+                weights.resize (Eigen::NoChange, nx);
+                values.resize (taps * num_volumes);
+                rows.resize (nx * num_volumes);
+              }
+
+              // compute the interpolation weights and voxel indices for the row:
+              const ssize_t y = destination.index (1), z = destination.index (2);
+              for (ssize_t x = 0; x < nx; ++x) {
+                in_bounds[x] = interp.voxel (direct_transform * Eigen::Vector3d (x, y, z));
+                if (in_bounds[x]) {
+                  weights.col (x) = interp.weights();
+                  ssize_t* index = &indices[3 * taps_per_axis * x];
+                  for (size_t axis = 0; axis < 3; ++axis)
+                    for (ssize_t t = 0; t < taps_per_axis; ++t)
+                      *index++ = clamp (interp.first_tap (axis) + t, source.size (axis));
+                }
+              }
+
+              // apply to all volumes:
+              for (ssize_t x = 0; x < nx; ++x) {
+                if (!in_bounds[x]) {
+                  for (size_t v = 0; v < num_volumes; ++v)
+                    rows[v*nx + x] = out_value_type (interp.out_of_bounds_value);
+                  continue;
+                }
+                gather (&indices[3 * taps_per_axis * x]);
+                const weights_type w (weights.col (x));
+                coefficients_type coeff_vec;
+                for (size_t v = 0; v < num_volumes; ++v) {
+                  for (ssize_t t = 0; t < taps; ++t)
+                    coeff_vec[t] = values[t*num_volumes + v];
+                  rows[v*nx + x] = out_value_type (coeff_vec.dot (w));
+                }
+              }
+
+              destination.index (0) = 0;
+              for (size_t v = 0; v < num_volumes; ++v) {
+                destination.index (3) = v;
+                set_row (destination, 0, &rows[v*nx], nx);
+              }
+            }
+
+          private:
+            InterpType interp;
+            ImageTypeSource source;
+            const transform_type direct_transform;
+            const size_t num_volumes;
+            vector<bool> in_bounds;
+            vector<ssize_t> indices;
+            weights_table_type weights;
+            vector<value_type> values;
+            vector<out_value_type> rows;
+
+            static ssize_t clamp (ssize_t x, ssize_t dim) {
+              if (x < 0) return 0;
+              if (x >= dim) return (dim-1);
+              return x;
+            }
+
+            // read the values of all volumes for each contributing voxel:
+            void gather (const ssize_t* index) {
+              source.index (3) = 0;
+              size_t n = 0;
+              for (ssize_t z = 0; z < taps_per_axis; ++z) {
+                source.index (2) = index[2*taps_per_axis + z];
+                for (ssize_t y = 0; y < taps_per_axis; ++y) {
+                  source.index (1) = index[taps_per_axis + y];
+                  for (ssize_t x = 0; x < taps_per_axis; ++x) {
+                    source.index (0) = index[x];
+                    get_row (source, 3, &values[n], num_volumes);
+                    n += num_volumes;
+                  }
+                }
+              }
+            }
+        };
+
+
+
+      template <template <class ImageType> class Interpolator, class ImageTypeDestination, class ImageTypeSource>
+        inline typename std::enable_if<has_weights<Interpolator<ImageTypeSource>>::value, bool>::type
+        __reslice_rows (
+            const std::string& message,
+            const Adapter::Reslice<Interpolator, ImageTypeSource>& reslicer,
+            ImageTypeSource& source,
+            ImageTypeDestination& destination,
+            const typename ImageTypeSource::value_type value_when_out_of_bounds)
+        {
+          if (reslicer.is_oversampled() || source.ndim() != 4 || destination.ndim() != 4 ||
+              source.size(3) < 2 || destination.size(3) != source.size(3))
+            return false;
+          ThreadedLoop (message, destination, 1, 3).run (
+              __ReslicePlan<Interpolator<ImageTypeSource>, ImageTypeSource, ImageTypeDestination> (source, reslicer.voxel_transform(), value_when_out_of_bounds),
+              destination);
+          return true;
+        }
+
+      template <template <class ImageType> class Interpolator, class ImageTypeDestination, class ImageTypeSource>
+        inline typename std::enable_if<!has_weights<Interpolator<ImageTypeSource>>::value, bool>::type
+        __reslice_rows (
+            const std::string&,
+            const Adapter::Reslice<Interpolator, ImageTypeSource>&,
+            ImageTypeSource&,
+            ImageTypeDestination&,
+            const typename ImageTypeSource::value_type)
+        {
+          return false;
+        }
+    }
+    //! \endcond
+
+
+
     //! convenience function to regrid one Image onto another
     /*! This function resamples (regrids) the Image \a source onto the
      * Image& \a destination, using the templated interpolator class.
@@ -53,7 +211,12 @@ namespace MR
           const typename ImageTypeDestination::value_type value_when_out_of_bounds = Interp::Base<ImageTypeDestination>::default_out_of_bounds_value())
       {
         Adapter::Reslice<Interpolator, ImageTypeSource> interp (source, destination, transform, oversampling, value_when_out_of_bounds);
-        threaded_copy_with_progress_message ("reslicing \"" + source.name() + "\"", interp, destination, 0, source.ndim(), 2);
+        const std::string message ("reslicing \"" + source.name() + "\"");
+        // for 4D images with linear & cubic interpolation and no oversampling,
+        // process whole rows at a time, computing the interpolation weights
+        // only once for all volumes:
+        if (!__reslice_rows<Interpolator> (message, interp, source, destination, value_when_out_of_bounds))
+          threaded_copy_with_progress_message (message, interp, destination, 0, source.ndim(), 2);
       }
 
 
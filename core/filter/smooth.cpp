@@ -0,0 +1,40 @@
+/* Copyright (c) 2008-2024 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include "filter/smooth.h"
+#include "file/config.h"
+
+namespace MR
+{
+  namespace Filter
+  {
+
+    bool Smooth::default_recursive ()
+    {
+      //CONF option: SmoothRecursive
+      //CONF default: 0 (false)
+      //CONF Whether Gaussian smoothing (as used in mrregister, and for the
+      //CONF gradient and smooth filters in mrfilter) should use a recursive
+      //CONF approximation to the full Gaussian kernel, rather than direct
+      //CONF convolution with a truncated kernel. The cost of the recursive
+      //CONF filter is independent of the width of the kernel, making it
+      //CONF much faster for large smoothing extents.
+      static const bool value = File::Config::get_bool ("SmoothRecursive", false);
+      return value;
+    }
+
+  }
+}
@@ -17,10 +17,13 @@
 #ifndef __image_filter_gaussian_h__
 #define __image_filter_gaussian_h__
 
+#include <complex>
+
 #include "memory.h"
 #include "image.h"
 #include "algo/copy.h"
 #include "algo/threaded_copy.h"
+#include "algo/threaded_loop.h"
 #include "adapter/gaussian1D.h"
 #include "filter/base.h"
 
@@ -42,6 +45,12 @@ namespace MR
      * smooth_filter (input, output);
      *
      * \endcode
+     *
+     * By default, the image is convolved with a Gaussian kernel truncated
+     * at the specified extent (see set_extent()), at a cost that grows with
+     * the width of the kernel. Alternatively, a recursive approximation to
+     * the full Gaussian can be used (see set_recursive()), whose cost is
+     * independent of the width of the kernel.
      */
 
     class Smooth : public Base
@@ -54,7 +63,8 @@ namespace MR
             extent (3, 0),
             stdev (3, 0.0),
             stride_order (Stride::order (in)),
-            zero_boundary (false)
+            zero_boundary (false),
+            recursive (default_recursive())
         {
           for (int i = 0; i < 3; i++)
             stdev[i] = in.spacing(i);
@@ -66,7 +76,9 @@ namespace MR
             Base (in),
             extent (3, 0),
             stdev (3, 0.0),
-            stride_order (Stride::order (in))
+            stride_order (Stride::order (in)),
+            zero_boundary (false),
+            recursive (default_recursive())
         {
           set_stdev (stdev_in);
           datatype() = DataType::Float32;
@@ -99,6 +111,20 @@ namespace MR
           zero_boundary = do_zero_boundary;
         }
 
+        //! use a recursive (IIR) approximation to the Gaussian kernel
+        /*! This uses a third-order recursive filter (Young & van Vliet),
+         * with a causal and an anti-causal pass along each line, so that the
+         * cost is independent of the width of the kernel. Note that this
+         * approximates the full Gaussian, rather than one truncated at the
+         * kernel extent. It is only used for axes with no explicit kernel
+         * extent, and a standard deviation of at least two voxels; other axes
+         * are smoothed by direct convolution. The default is set by the
+         * SmoothRecursive config file option. */
+        void set_recursive (bool use_recursive) {
+          recursive = use_recursive;
+        }
+        bool is_recursive () const { return recursive; }
+
         //! Set the standard deviation of the Gaussian defined in mm.
         //! This must be set as a single value to be used for the first 3 dimensions
         //! or separate values, one for each dimension. (Default: 1 voxel)
@@ -136,7 +162,13 @@ namespace MR
           }
 
           for (size_t dim = 0; dim < 3; dim++) {
-            if (stdev[dim] > 0) {
+            if (stdev[dim] > 0 && use_recursive (*in, dim)) {
+              DEBUG ("smoothing image along dimension " + str(dim) + " using recursive filter");
+              smooth_recursive (*in, dim);
+              if (progress)
+                ++(*progress);
+            }
+            else if (stdev[dim] > 0) {
               DEBUG ("creating scratch image for smoothing image along dimension " + str(dim));
               out = make_shared<Image<ValueType> > (Image<ValueType>::scratch (input));
               Adapter::Gaussian1D<Image<ValueType> > gaussian (*in, stdev[dim], dim, extent[dim], zero_boundary);
@@ -163,7 +195,13 @@ namespace MR
           }
 
           for (size_t dim = 0; dim < 3; dim++) {
-            if (stdev[dim] > 0) {
+            if (stdev[dim] > 0 && use_recursive (in_and_output, dim)) {
+              DEBUG ("smoothing dimension " + str(dim) + " in place using recursive filter");
+              smooth_recursive (in_and_output, dim);
+              if (progress)
+                ++(*progress);
+            }
+            else if (stdev[dim] > 0) {
               vector<size_t> axes (in_and_output.ndim(), dim);
               size_t axdim = 1;
               for (size_t i = 0; i < in_and_output.ndim(); ++i) {
@@ -184,7 +222,32 @@ namespace MR
         vector<uint32_t> extent;
         vector<default_type> stdev;
         const vector<size_t> stride_order;
-        bool zero_boundary;
+        bool zero_boundary, recursive;
+
+        static bool default_recursive ();
+
+        template <class ImageType>
+        bool use_recursive (const ImageType& image, size_t dim) const {
+          return recursive && !extent[dim] && stdev[dim] >= 2.0 * image.spacing (dim);
+        }
+
+        // process lines along dim in bundles, with the lines in each bundle
+        // adjacent along the axis (other than dim) with the smallest stride:
+        template <class ImageType>
+        void smooth_recursive (ImageType& image, size_t dim) {
+          size_t line_axis = dim;
+          vector<size_t> outer_axes;
+          for (const auto axis : Stride::order (image)) {
+            if (axis == dim)
+              continue;
+            if (line_axis == dim)
+              line_axis = axis;
+            else
+              outer_axes.push_back (axis);
+          }
+          RecursiveSmoothFunctor1D<ImageType> smooth (image, stdev[dim], dim, line_axis, outer_axes, zero_boundary);
+          ThreadedLoop (image, outer_axes, 0).run_outer (smooth);
+        }
 
         template <class ImageType>
           class SmoothFunctor1D { MEMALIGN (SmoothFunctor1D)
@@ -284,6 +347,180 @@ namespace MR
             ssize_t buffer_size;
             Eigen::VectorXd buffer;
           };
+
+
+
+        // Recursive Gaussian smoothing along a single axis, using a
+        // third-order filter in the form of Young & van Vliet (Signal
+        // Processing, 1995), with a causal and an anti-causal pass.
+        // Lines are processed in bundles, held as the rows of an array, so
+        // that each step of the recursion operates on a contiguous vector of
+        // values (one per line). The image is treated as zero beyond its
+        // boundaries, with the anti-causal pass initialised accordingly
+        // (Triggs & Sdika, IEEE TSP, 2006), and the result normalised by the
+        // response to an image of ones - equivalent to the renormalisation of
+        // the kernel at the boundaries by SmoothFunctor1D. Non-finite values
+        // are excluded in the same way.
+        template <class ImageType>
+          class RecursiveSmoothFunctor1D { MEMALIGN (RecursiveSmoothFunctor1D)
+          public:
+            using value_type = typename ImageType::value_type;
+            using array_type = Eigen::Array<default_type, Eigen::Dynamic, Eigen::Dynamic>;
+
+            RecursiveSmoothFunctor1D (const ImageType& image,
+                                      default_type stdev,
+                                      size_t axis,
+                                      size_t line_axis,
+                                      const vector<size_t>& outer_axes,
+                                      bool zero_boundary) :
+                image (image),
+                axis (axis),
+                line_axis (line_axis),
+                outer_axes (outer_axes),
+                zero_boundary (zero_boundary),
+                num_samples (image.size (axis)),
+                num_lines (image.size (line_axis)),
+                row (num_lines),
+                lines (num_lines, num_samples + 6),
+                mask (num_lines, num_samples + 6)
+            {
+              // filter coefficients from the poles of van Vliet, Young &
+              // Verbeek (ICPR, 1998), optimised for a standard deviation of 2
+              // voxels, scaled to match the requested standard deviation:
+              const default_type sigma = stdev / image.spacing (axis);
+              assert (sigma >= 2.0);
+              const std::complex<default_type> poles[3] = { { 1.40098, 1.00236 }, { 1.40098, -1.00236 }, { 1.85132, 0.0 } };
+              auto variance = [&] (default_type q) {
+                default_type result = 0.0;
+                for (const auto& pole : poles) {
+                  const auto d = std::pow (pole, 1.0/q);
+                  result += std::real (2.0 * d / ((d - 1.0) * (d - 1.0)));
+                }
+                return result;
+              };
+              default_type q_min = 0.0, q_max = sigma;
+              for (size_t n = 0; n < 64; ++n) {
+                const default_type q = 0.5 * (q_min + q_max);
+                if (variance (q) < sigma*sigma)
+                  q_min = q;
+                else
+                  q_max = q;
+              }
+              std::complex<default_type> p[3];
+              for (size_t n = 0; n < 3; ++n)
+                p[n] = 1.0 / std::pow (poles[n], 2.0 / (q_min + q_max));
+              a[0] = std::real (p[0] + p[1] + p[2]);
+              a[1] = -std::real (p[0]*p[1] + p[0]*p[2] + p[1]*p[2]);
+              a[2] = std::real (p[0]*p[1]*p[2]);
+              B = 1.0 - (a[0] + a[1] + a[2]);
+
+              // state of the anti-causal pass beyond the end of the line,
+              // given the last three outputs of the causal pass, assuming
+              // zero input beyond the end of the line: computed by running
+              // the free response of both passes until it has decayed
+              const size_t tail = std::ceil (20.0 * sigma) + 100;
+              for (size_t j = 0; j < 3; ++j) {
+                vector<default_type> u (tail + 3, 0.0), v (tail + 3, 0.0);
+                u[2-j] = 1.0;
+                for (size_t t = 3; t < tail; ++t)
+                  u[t] = a[0]*u[t-1] + a[1]*u[t-2] + a[2]*u[t-3];
+                for (size_t t = tail-1; t >= 3; --t)
+                  v[t] = B*u[t] + a[0]*v[t+1] + a[1]*v[t+2] + a[2]*v[t+3];
+                for (size_t i = 0; i < 3; ++i)
+                  M(i,j) = v[3+i];
+              }
+
+              // response to a line of ones, for normalisation:
+              array_type ones (1, num_samples + 6);
+              ones.setZero();
+              ones.middleCols (3, num_samples).setOnes();
+              filter (ones);
+              norm = ones.middleCols (3, num_samples).inverse();
+            }
+
+            RecursiveSmoothFunctor1D (const RecursiveSmoothFunctor1D& that) :
+                image (that.image),
+                axis (that.axis),
+                line_axis (that.line_axis),
+                outer_axes (that.outer_axes),
+                zero_boundary (that.zero_boundary),
+                num_samples (that.num_samples),
+                num_lines (that.num_lines),
+                B (that.B),
+                a { that.a[0], that.a[1], that.a[2] },
+                M (that.M),
+                norm (that.norm),
+                row (num_lines),
+                lines (num_lines, num_samples + 6),
+                mask (num_lines, num_samples + 6) { }
+
+            // process the bundle of lines at the position of the outer axes in pos
+            void operator() (const Iterator& pos) {
+              assign_pos_of (pos, outer_axes).to (image);
+              image.index (line_axis) = 0;
+              for (ssize_t k = 0; k < num_samples; ++k) {
+                image.index (axis) = k;
+                get_row (image, line_axis, row.data(), num_lines);
+                lines.col (k+3) = row.template cast<default_type>();
+              }
+
+              lines.leftCols (3).setZero();
+              if (lines.middleCols (3, num_samples).isFinite().all()) {
+                filter (lines);
+                lines.middleCols (3, num_samples).rowwise() *= norm;
+              }
+              else {
+                mask.setZero();
+                mask.middleCols (3, num_samples) = lines.middleCols (3, num_samples).isFinite().template cast<default_type>();
+                lines.middleCols (3, num_samples) = (mask.middleCols (3, num_samples) > 0.0).select (lines.middleCols (3, num_samples), 0.0);
+                filter (lines);
+                filter (mask);
+                // as for direct convolution, the result is undefined if
+                // (practically) no finite values contribute to it:
+                lines.middleCols (3, num_samples) = (mask.middleCols (3, num_samples) > min_weight).select (
+                    lines.middleCols (3, num_samples) / mask.middleCols (3, num_samples),
+                    std::numeric_limits<default_type>::quiet_NaN());
+              }
+
+              if (zero_boundary) {
+                lines.col (3).setZero();
+                lines.col (num_samples + 2).setZero();
+              }
+
+              for (ssize_t k = 0; k < num_samples; ++k) {
+                image.index (axis) = k;
+                row = lines.col (k+3).template cast<value_type>();
+                set_row (image, line_axis, row.data(), num_lines);
+              }
+            }
+
+          private:
+            static constexpr default_type min_weight = 1.0e-3;
+            ImageType image;
+            const size_t axis, line_axis;
+            const vector<size_t> outer_axes;
+            const bool zero_boundary;
+            const ssize_t num_samples, num_lines;
+            default_type B, a[3];
+            Eigen::Matrix<default_type, 3, 3> M;
+            Eigen::Array<default_type, 1, Eigen::Dynamic> norm;
+            Eigen::Array<value_type, Eigen::Dynamic, 1> row;
+            array_type lines, mask;
+
+            // causal and anti-causal passes along the rows of x, in place;
+            // the data are held in columns [3, num_samples+3), with the three
+            // columns either side used to hold the state of each pass
+            void filter (array_type& x) const {
+              const ssize_t end = num_samples + 3;
+              x.leftCols (3).setZero();
+              for (ssize_t k = 3; k < end; ++k)
+                x.col (k) = B*x.col (k) + a[0]*x.col (k-1) + a[1]*x.col (k-2) + a[2]*x.col (k-3);
+              for (ssize_t i = 0; i < 3; ++i)
+                x.col (end+i) = M(i,0)*x.col (end-1) + M(i,1)*x.col (end-2) + M(i,2)*x.col (end-3);
+              for (ssize_t k = end-1; k >= 3; --k)
+                x.col (k) = B*x.col (k) + a[0]*x.col (k+1) + a[1]*x.col (k+2) + a[2]*x.col (k+3);
+            }
+          };
     };
     //! @}
   }
@@ -85,20 +85,16 @@ namespace MR
     {
       File::OFStream out (H.name(), std::ios::out | std::ios::binary);
 
-      out << "mrtrix image\n";
-
-      write_mrtrix_header (H, out);
-
       bool single_file = Path::has_suffix (H.name(), ".mif");
 
       int64_t offset = 0;
-      out << "file: ";
-      if (single_file) {
-        offset = int64_t(out.tellp()) + int64_t(18);
-        offset += ((4 - (offset % 4)) % 4);
-        out << ". " << offset << "\nEND\n";
+      if (single_file)
+        offset = write_mrtrix_single_file_header (H, out);
+      else {
+        out << "mrtrix image\n";
+        write_mrtrix_header (H, out);
+        out << "file: " << Path::basename (H.name().substr (0, H.name().size()-4) + ".dat") << "\n";
       }
-      else out << Path::basename (H.name().substr (0, H.name().size()-4) + ".dat") << "\n";
 
       out.close();
 
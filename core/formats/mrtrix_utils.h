@@ -54,6 +54,12 @@ namespace MR
     template <class StreamType>
       void write_mrtrix_header (const Header&, StreamType&);
 
+    // Write the complete header of a single-file (.mif) image to a stream, with the
+    //   'file' entry pointing to the data immediately following the header (aligned
+    //   to 4 bytes); returns the offset to the start of the image data
+    template <class StreamType>
+      int64_t write_mrtrix_single_file_header (const Header&, StreamType&);
+
 
     vector<ssize_t> parse_axes (size_t ndim, const std::string& specifier);
 
@@ -183,6 +189,20 @@ namespace MR
 
 
 
+    template <class StreamType>
+      int64_t write_mrtrix_single_file_header (const Header& H, StreamType& out)
+      {
+        out << "mrtrix image\n";
+        write_mrtrix_header (H, out);
+        out << "file: ";
+        int64_t offset = int64_t(out.tellp()) + int64_t(18);
+        offset += ((4 - (offset % 4)) % 4);
+        out << ". " << offset << "\nEND\n";
+        return offset;
+      }
+
+
+
 
 
   }
@@ -19,9 +19,13 @@
 #include "signal_handler.h"
 #include "file/utils.h"
 #include "file/path.h"
+#include "file/key_value.h"
+#include "file/config.h"
 #include "header.h"
+#include "image_io/default.h"
 #include "image_io/pipe.h"
 #include "formats/list.h"
+#include "formats/mrtrix_utils.h"
 
 namespace MR
 {
@@ -36,13 +40,38 @@ namespace MR
         H.name() = name;
       }
       else {
-        if (!File::is_tempfile (H.name()))
+        if (!File::is_tempfile (H.name()) && !ImageIO::Pipe::is_shared_memory (H.name()))
           return std::unique_ptr<ImageIO::Base>();
       }
 
       if (H.name().empty())
         throw Exception ("no filename supplied to standard input (broken pipe?)");
 
+      if (ImageIO::Pipe::is_shared_memory (H.name())) {
+        int fd;
+        H.name() = ImageIO::Pipe::acquire_shared_memory (H.name(), fd);
+        try {
+          File::KeyValue::Reader kv (H.name(), "mrtrix image");
+          read_mrtrix_header (H, kv);
+
+          std::string fname;
+          size_t offset;
+          get_mrtrix_file_path (H, "file", fname, offset);
+          if (fname != H.name())
+            throw Exception ("piped image \"" + H.name() + "\" does not contain its own data");
+
+          std::unique_ptr<ImageIO::Base> original_handler (new ImageIO::Default (H));
+          original_handler->files.push_back (File::Entry (fname, offset));
+          std::unique_ptr<ImageIO::Pipe> io_handler (new ImageIO::Pipe (std::move (*original_handler)));
+          io_handler->hold_shared_memory (fd);
+          return std::move (io_handler);
+        }
+        catch (...) {
+          ::close (fd);
+          throw;
+        }
+      }
+
       if (ImageIO::Pipe::delete_piped_images)
         SignalHandler::mark_file_for_deletion (H.name());
 
@@ -66,6 +95,15 @@ namespace MR
       if (isatty (STDOUT_FILENO))
         throw Exception ("attempt to pipe image to standard output (this will leave temporary files behind)");
 
+      H.name() = ImageIO::Pipe::create_shared_memory();
+      if (H.name().size()) {
+        H.ndim() = num_axes;
+        for (size_t i = 0; i < H.ndim(); i++)
+          if (H.size (i) < 1)
+            H.size(i) = 1;
+        return true;
+      }
+
       H.name() = File::create_tempfile (0, "mif");
 
       SignalHandler::mark_file_for_deletion (H.name());
@@ -78,6 +116,35 @@ namespace MR
 
     std::unique_ptr<ImageIO::Base> Pipe::create (Header& H) const
     {
+      if (ImageIO::Pipe::is_shared_memory (H.name())) {
+        // as MRtrix::create() for a single-file image, but without any
+        // checks on the file name, since the file already exists:
+        std::ofstream out (H.name(), std::ios::out | std::ios::binary);
+        if (!out)
+          throw Exception ("error opening piped image \"" + H.name() + "\": " + strerror (errno));
+
+        const int64_t offset = write_mrtrix_single_file_header (H, out);
+        out.close();
+
+        //CONF option: PipeStreaming
+        //CONF default: 1 (true)
+        //CONF Whether commands that support it (e.g. mrcalc, mrconvert)
+        //CONF should hand images piped via shared memory (see
+        //CONF PipeSharedMemory) over to the receiving command as soon as
+        //CONF processing starts, rather than once it has completed. This
+        //CONF allows successive commands in a pipeline to run concurrently,
+        //CONF with each one processing the data as they become available.
+        int64_t file_size = offset + footprint(H);
+        if (ImageIO::Pipe::stream_piped_images && File::Config::get_bool ("PipeStreaming", true))
+          file_size = ImageIO::Stream::control_offset (file_size) + ImageIO::Stream::control_size;
+
+        File::resize (H.name(), file_size);
+        std::unique_ptr<ImageIO::Base> original_handler (new ImageIO::Default (H));
+        original_handler->files.push_back (File::Entry (H.name(), offset));
+        std::unique_ptr<ImageIO::Pipe> io_handler (new ImageIO::Pipe (std::move (*original_handler)));
+        return std::move (io_handler);
+      }
+
       std::unique_ptr<ImageIO::Base> original_handler (mrtrix_handler.create (H));
       std::unique_ptr<ImageIO::Pipe> io_handler (new ImageIO::Pipe (std::move (*original_handler)));
       return std::move (io_handler);
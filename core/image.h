@@ -24,6 +24,7 @@
 #include "debug.h"
 #include "header.h"
 #include "image_io/fetch_store.h"
+#include "image_io/stream.h"
 #include "image_helpers.h"
 #include "formats/mrtrix_utils.h"
 #include "algo/copy.h"
@@ -94,6 +95,35 @@ namespace MR
           else buffer->set_value (data_offset, val);
         }
 
+        //! read \a count voxel values along \a axis, starting from the current location
+        /*! the values are written into \a data, which must have room for at
+         * least \a count elements. The current position is left unchanged.
+         * For images accessed via indirect IO, the conversion from the
+         * datatype on file is performed for the whole run in a single call,
+         * avoiding the per-voxel overhead of get_value(). */
+        void get_row (size_t axis, ValueType* data, size_t count) const {
+          assert (get_index (axis) + ssize_t (count) <= size (axis));
+          if (data_pointer) {
+            size_t offset = data_offset;
+            for (size_t n = 0; n < count; ++n, offset += stride (axis))
+              data[n] = Raw::fetch_native<ValueType> (data_pointer, offset);
+          }
+          else
+            buffer->get_values (data_offset, stride (axis), data, count);
+        }
+        //! write \a count voxel values along \a axis, starting from the current location
+        /*! \sa get_row() */
+        void set_row (size_t axis, const ValueType* data, size_t count) {
+          assert (get_index (axis) + ssize_t (count) <= size (axis));
+          if (data_pointer) {
+            size_t offset = data_offset;
+            for (size_t n = 0; n < count; ++n, offset += stride (axis))
+              Raw::store_native<ValueType> (data[n], data_pointer, offset);
+          }
+          else
+            buffer->set_values (data_offset, stride (axis), data, count);
+        }
+
         //! use for debugging
         friend std::ostream& operator<< (std::ostream& stream, const Image& V) {
           stream << "\"" << V.name() << "\", datatype " << DataType::from<Image::value_type>().specifier() << ", index [ ";
@@ -226,7 +256,8 @@ namespace MR
         Buffer& operator= (const Buffer&) = delete;
         Buffer& operator= (Buffer&&) = default;
         Buffer (const Buffer& b) :
-          Header (b), fetch_func (b.fetch_func), store_func (b.store_func) { }
+          Header (b), fetch_func (b.fetch_func), store_func (b.store_func),
+          fetch_row_func (b.fetch_row_func), store_row_func (b.store_row_func) { }
 
 
         FORCE_INLINE ValueType get_value (size_t offset) const {
@@ -239,6 +270,37 @@ namespace MR
           store_func (val, io->segment (nseg), offset - nseg*io->segment_size(), intensity_offset(), intensity_scale());
         }
 
+        //! read \a count values, \a stride elements apart, starting at \a offset
+        void get_values (size_t offset, ssize_t stride, ValueType* data, size_t count) const {
+          if (io->get_stream())
+            io->get_stream()->acquire (offset, stride, count);
+          while (count) {
+            const size_t nseg = offset / io->segment_size();
+            const size_t local = offset - nseg*io->segment_size();
+            const size_t n = run_within_segment (local, stride, count);
+            fetch_row_func (io->segment (nseg), local, stride, data, n, intensity_offset(), intensity_scale());
+            data += n;
+            count -= n;
+            offset += n*stride;
+          }
+        }
+
+        //! write \a count values, \a stride elements apart, starting at \a offset
+        void set_values (size_t offset, ssize_t stride, const ValueType* data, size_t count) const {
+          const size_t start = offset, total = count;
+          while (count) {
+            const size_t nseg = offset / io->segment_size();
+            const size_t local = offset - nseg*io->segment_size();
+            const size_t n = run_within_segment (local, stride, count);
+            store_row_func (data, io->segment (nseg), local, stride, n, intensity_offset(), intensity_scale());
+            data += n;
+            count -= n;
+            offset += n*stride;
+          }
+          if (io->get_stream())
+            io->get_stream()->release (start, stride, total);
+        }
+
         std::unique_ptr<uint8_t[]> data_buffer;
         void* get_data_pointer ();
 
@@ -247,9 +309,32 @@ namespace MR
       protected:
         std::function<ValueType(const void*,size_t,default_type,default_type)> fetch_func;
         std::function<void(ValueType,void*,size_t,default_type,default_type)> store_func;
+        __fetch_row_func<ValueType> fetch_row_func;
+        __store_row_func<ValueType> store_row_func;
 
         void set_fetch_store_functions () {
           __set_fetch_store_functions (fetch_func, store_func, datatype());
+          __set_fetch_store_row_functions (fetch_row_func, store_row_func, datatype());
+
+          // piped image still being written by another process: wait for
+          // each voxel to become available before reading it
+          ImageIO::Stream* stream = io->get_stream();
+          if (stream && !io->is_image_new() && !stream->is_complete()) {
+            auto fetch = fetch_func;
+            fetch_func = [stream,fetch] (const void* data, size_t offset, default_type intensity_offset, default_type intensity_scale) {
+              stream->acquire (offset, 1, 1);
+              return fetch (data, offset, intensity_offset, intensity_scale);
+            };
+          }
+        }
+
+        //! number of elements of a run starting at \a local that lie within the same segment
+        size_t run_within_segment (size_t local, ssize_t stride, size_t count) const {
+          if (io->nsegments() == 1 || stride == 0)
+            return count;
+          if (stride > 0)
+            return std::min (count, (io->segment_size() - 1 - local) / stride + 1);
+          return std::min (count, local / (-stride) + 1);
         }
     };
 
@@ -340,6 +425,10 @@ namespace MR
       if (!io->is_file_backed()) // this is a scratch image
         return io->segment(0);
 
+      // piped image being streamed: all access must go via the IO handler
+      if (io->get_stream() && !io->get_stream()->is_complete())
+        return nullptr;
+
       // check whether we can still do direct IO
       // if so, return address where mapped
       if (io->nsegments() == 1 && datatype() == DataType::from<ValueType>() && intensity_offset() == 0.0 && intensity_scale() == 1.0)
@@ -416,7 +505,8 @@ namespace MR
       if (!buffer.unique())
         throw Exception ("FIXME: don't invoke 'with_direct_io()' on images if other copies exist!");
 
-      bool preload = ( buffer->datatype() != DataType::from<ValueType>() ) || ( buffer->get_io()->files.size() > 1 );
+      bool preload = ( buffer->datatype() != DataType::from<ValueType>() ) || ( buffer->get_io()->files.size() > 1 )
+        || ( buffer->get_io()->get_stream() && !buffer->get_io()->get_stream()->is_complete() );
       if (with_strides.size()) {
         auto new_strides = Stride::get_actual (Stride::get_nearest_match (*this, with_strides), *this);
         preload |= ( new_strides != Stride::get (*this) );
@@ -178,6 +178,16 @@ namespace MR
       static bool const value = is_image_type<ImageType>::value && !is_pure_image<ImageType>::value;
     };
 
+  //! convenience function for SFINAE on images providing bulk row access via get_row() / set_row()
+  template<typename ImageType>
+    class has_row_access { NOMEMALIGN
+      typedef char yes[1], no[2];
+      template<typename C> static yes& test(decltype (std::declval<C&>().get_row (0, nullptr, 0), 0));
+      template<typename C> static no&  test(...);
+      public:
+      static bool const value = sizeof(test<ImageType>(0)) == sizeof(yes);
+    };
+
 
 
 
@@ -477,6 +487,57 @@ namespace MR
 
 
 
+  //! \cond skip
+  namespace {
+
+    template <class ImageType>
+      FORCE_INLINE auto __get_row (ImageType& image, size_t axis, typename ImageType::value_type* data, size_t count, int)
+      -> decltype (image.get_row (axis, data, count), void()) { image.get_row (axis, data, count); }
+
+    template <class ImageType>
+      FORCE_INLINE void __get_row (ImageType& image, size_t axis, typename ImageType::value_type* data, size_t count, ...) {
+        const ssize_t start = image.index (axis);
+        for (size_t n = 0; n < count; ++n, ++image.index (axis))
+          data[n] = image.value();
+        image.index (axis) = start;
+      }
+
+    template <class ImageType>
+      FORCE_INLINE auto __set_row (ImageType& image, size_t axis, const typename ImageType::value_type* data, size_t count, int)
+      -> decltype (image.set_row (axis, data, count), void()) { image.set_row (axis, data, count); }
+
+    template <class ImageType>
+      FORCE_INLINE void __set_row (ImageType& image, size_t axis, const typename ImageType::value_type* data, size_t count, ...) {
+        const ssize_t start = image.index (axis);
+        for (size_t n = 0; n < count; ++n, ++image.index (axis))
+          image.value() = data[n];
+        image.index (axis) = start;
+      }
+
+  }
+  //! \endcond
+
+  //! read \a count values along \a axis from the current position of \a image into \a data
+  /*! this uses the bulk Image::get_row() method where available, avoiding the
+   * per-voxel conversion overhead of indirect IO, and falls back to per-voxel
+   * access otherwise (e.g. for Adapter classes). The position of \a image is
+   * left unchanged. */
+  template <class ImageType>
+    FORCE_INLINE void get_row (ImageType& image, size_t axis, typename ImageType::value_type* data, size_t count)
+    {
+      __get_row (image, axis, data, count, 0);
+    }
+
+  //! write \a count values from \a data along \a axis, starting from the current position of \a image
+  /*! \sa get_row() */
+  template <class ImageType>
+    FORCE_INLINE void set_row (ImageType& image, size_t axis, const typename ImageType::value_type* data, size_t count)
+    {
+      __set_row (image, axis, data, count, 0);
+    }
+
+
+
   namespace Helper
   {
 
@@ -16,6 +16,8 @@
 
 #include "image_io/base.h"
 #include "header.h"
+#include "progressbar.h"
+#include "thread_queue.h"
 
 namespace MR
 {
@@ -56,6 +58,50 @@ namespace MR
     }
 
 
+
+    void Base::for_each_file (const std::string& message, std::function<void(size_t)> functor) const
+    {
+      if (files.size() < 2) {
+        for (size_t n = 0; n < files.size(); ++n)
+          functor (n);
+        return;
+      }
+
+      class Source { NOMEMALIGN
+        public:
+          Source (size_t count, const std::string& message) :
+            count (count), current (0),
+            progress (message, count) { }
+          bool operator() (size_t& index) {
+            if (current >= count)
+              return false;
+            index = current++;
+            ++progress;
+            return true;
+          }
+        private:
+          const size_t count;
+          size_t current;
+          ProgressBar progress;
+      };
+
+      class Sink { NOMEMALIGN
+        public:
+          Sink (std::function<void(size_t)>& functor) : functor (functor) { }
+          bool operator() (const size_t& index) {
+            functor (index);
+            return true;
+          }
+        private:
+          std::function<void(size_t)>& functor;
+      };
+
+      Source source (files.size(), message);
+      Sink sink (functor);
+      Thread::run_queue (source, Thread::batch (size_t(), 4), Thread::multi (sink));
+    }
+
+
   }
 }
 
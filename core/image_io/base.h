@@ -19,6 +19,7 @@
 
 #include <cassert>
 #include <cstdint>
+#include <functional>
 #include <unistd.h>
 
 #include "memory.h"
@@ -41,6 +42,8 @@ namespace MR
   namespace ImageIO
   {
 
+    class Stream;
+
     class Base
     { NOMEMALIGN
       public:
@@ -84,6 +87,12 @@ namespace MR
           check();
           return segsize;
         }
+        //! the progress of an image streamed from another process
+        /*! this is only set for piped images (see ImageIO::Pipe) that may
+         * still be in the process of being written; nullptr otherwise */
+        Stream* get_stream () const {
+          return stream.get();
+        }
 
         vector<File::Entry> files;
 
@@ -103,11 +112,21 @@ namespace MR
       protected:
         size_t segsize;
         vector<std::unique_ptr<uint8_t[]>> addresses;
+        std::shared_ptr<Stream> stream;
         bool is_new, writable;
 
         void check () const {
           assert (addresses.size());
         }
+
+        //! invoke \a functor for the index of each entry in \a files, using multiple threads
+        /*! This is intended for handlers that need to copy or reformat the
+         * contents of many independent files into a single RAM buffer (e.g.
+         * DICOM series); \a functor must therefore only write to the region
+         * of the buffer corresponding to its own file. Progress is reported
+         * using \a message. */
+        void for_each_file (const std::string& message, std::function<void(size_t)> functor) const;
+
         virtual void load (const Header& header, size_t buffer_size) = 0;
         virtual void unload (const Header& header) = 0;
     };
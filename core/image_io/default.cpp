@@ -43,7 +43,9 @@ namespace MR
       if (files.size() * double (bytes_per_segment) >= double (std::numeric_limits<size_t>::max()))
         throw Exception ("image \"" + header.name() + "\" is larger than maximum accessible memory");
 
-      if (files.size() > MAX_FILES_PER_IMAGE)
+      if (files.size() > 1 && segments_are_contiguous (header))
+        map_contiguous (header);
+      else if (files.size() > MAX_FILES_PER_IMAGE)
         copy_to_mem (header);
       else
         map_files (header);
@@ -90,6 +92,36 @@ namespace MR
 
 
 
+    bool Default::segments_are_contiguous (const Header& header) const
+    {
+      if (header.datatype().bits() * segsize != 8 * size_t (bytes_per_segment))
+        return false;
+      for (size_t n = 1; n < files.size(); ++n) {
+        if (files[n].name != files[0].name ||
+            files[n].start != files[0].start + int64_t(n) * bytes_per_segment)
+          return false;
+      }
+      return true;
+    }
+
+
+
+    void Default::map_contiguous (const Header& header)
+    {
+      // segments stored back-to-back within the same file (e.g. multi-frame
+      // DICOM): a single mapping covers the entire image, no copy required
+      DEBUG ("mapping " + str(files.size()) + " contiguous segments of image \"" + header.name() + "\" as single region");
+      mmaps.resize (1);
+      addresses.resize (1);
+      mmaps[0].reset (new File::MMap (files[0], writable, !is_new, files.size() * bytes_per_segment));
+      addresses[0].reset (mmaps[0]->address());
+      segsize *= files.size();
+    }
+
+
+
+
+
     void Default::copy_to_mem (const Header& header)
     {
       DEBUG ("loading image \"" + header.name() + "\"...");
@@ -100,10 +132,10 @@ namespace MR
 
       if (is_new) memset (addresses[0].get(), 0, files.size() * bytes_per_segment);
       else {
-        for (size_t n = 0; n < files.size(); n++) {
-          File::MMap file (files[n], false, false, bytes_per_segment);
-          memcpy (addresses[0].get() + n*bytes_per_segment, file.address(), bytes_per_segment);
-        }
+        for_each_file ("loading image \"" + shorten (header.name()) + "\"", [&] (size_t n) {
+            File::MMap file (files[n], false, false, bytes_per_segment);
+            memcpy (addresses[0].get() + n*bytes_per_segment, file.address(), bytes_per_segment);
+        });
       }
 
       if (addresses.size() > 1)
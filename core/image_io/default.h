@@ -43,8 +43,11 @@ namespace MR
         virtual void unload (const Header&);
 
         void map_files (const Header&);
+        void map_contiguous (const Header&);
         void copy_to_mem (const Header&);
 
+        bool segments_are_contiguous (const Header&) const;
+
     };
 
   }
@@ -97,42 +97,76 @@ namespace MR
 
 
 
-    // for single-byte types:
+    // conversion of individual values:
 
-    template <typename RAMType, typename DiskType>
+    template <typename RAMType, class Format>
       RAMType __fetch (const void* data, size_t i, default_type offset, default_type scale) {
-        return round_func<RAMType> (scale_from_storage (Raw::fetch<DiskType> (data, i), offset, scale));
+        return round_func<RAMType> (scale_from_storage (Format::fetch (data, i), offset, scale));
       }
 
-    template <typename RAMType, typename DiskType>
+    template <typename RAMType, class Format>
       void __store (RAMType val, void* data, size_t i, default_type offset, default_type scale) {
-        return Raw::store<DiskType> (round_func<DiskType> (scale_to_storage (val, offset, scale)), data, i);
+        Format::store (round_func<typename Format::type> (scale_to_storage (val, offset, scale)), data, i);
       }
 
-    // for little-endian multi-byte types:
 
-    template <typename RAMType, typename DiskType>
-      RAMType __fetch_LE (const void* data, size_t i, default_type offset, default_type scale) {
-        return round_func<RAMType> (scale_from_storage (Raw::fetch_LE<DiskType> (data, i), offset, scale));
+
+    // for runs of values:
+    // the conversion is identical to that performed by the per-voxel
+    // functions above, but the loop is visible to the compiler, allowing it
+    // to inline the byte-swapping and scaling, and to vectorise the
+    // contiguous (unit stride) case.
+
+    template <typename RAMType, class Format>
+      void __fetch_row (const void* data, size_t i, ssize_t stride, RAMType* out, size_t count, default_type offset, default_type scale) {
+        if (stride == 1) {
+          for (size_t n = 0; n < count; ++n)
+            out[n] = round_func<RAMType> (scale_from_storage (Format::fetch (data, i+n), offset, scale));
+        }
+        else {
+          for (size_t n = 0; n < count; ++n, i += stride)
+            out[n] = round_func<RAMType> (scale_from_storage (Format::fetch (data, i), offset, scale));
+        }
       }
 
-    template <typename RAMType, typename DiskType>
-      void __store_LE (RAMType val, void* data, size_t i, default_type offset, default_type scale) {
-        return Raw::store_LE<DiskType> (round_func<DiskType> (scale_to_storage (val, offset, scale)), data, i);
+    template <typename RAMType, class Format>
+      void __store_row (const RAMType* in, void* data, size_t i, ssize_t stride, size_t count, default_type offset, default_type scale) {
+        using DiskType = typename Format::type;
+        if (stride == 1) {
+          for (size_t n = 0; n < count; ++n)
+            Format::store (round_func<DiskType> (scale_to_storage (in[n], offset, scale)), data, i+n);
+        }
+        else {
+          for (size_t n = 0; n < count; ++n, i += stride)
+            Format::store (round_func<DiskType> (scale_to_storage (in[n], offset, scale)), data, i);
+        }
       }
 
 
-    // for big-endian multi-byte types:
 
-    template <typename RAMType, typename DiskType>
-      RAMType __fetch_BE (const void* data, size_t i, default_type offset, default_type scale) {
-        return round_func<RAMType> (scale_from_storage (Raw::fetch_BE<DiskType> (data, i), offset, scale));
-      }
+    // visitors to bind the functions above for the datatype on file:
 
-    template <typename RAMType, typename DiskType>
-      void __store_BE (RAMType val, void* data, size_t i, default_type offset, default_type scale) {
-        return Raw::store_BE<DiskType> (round_func<DiskType> (scale_to_storage (val, offset, scale)), data, i);
-      }
+    template <typename ValueType>
+      struct __bind_fetch_store { NOMEMALIGN
+        std::function<ValueType(const void*,size_t,default_type,default_type)>& fetch_func;
+        std::function<void(ValueType,void*,size_t,default_type,default_type)>& store_func;
+        template <class Format>
+          void operator() (Format) {
+            fetch_func = __fetch<ValueType,Format>;
+            store_func = __store<ValueType,Format>;
+          }
+      };
+
+    template <typename ValueType>
+      struct __bind_fetch_store_row { NOMEMALIGN
+        __fetch_row_func<ValueType>& fetch_row_func;
+        __store_row_func<ValueType>& store_row_func;
+        template <class Format>
+          void operator() (Format) {
+            fetch_row_func = __fetch_row<ValueType,Format>;
+            store_row_func = __store_row<ValueType,Format>;
+          }
+      };
 
 
   }
@@ -146,103 +180,17 @@ namespace MR
         std::function<ValueType(const void*,size_t,default_type,default_type)>& fetch_func,
         std::function<void(ValueType,void*,size_t,default_type,default_type)>& store_func,
         DataType datatype) {
+      ImageIO::visit (datatype, __bind_fetch_store<ValueType> { fetch_func, store_func });
+    }
 
-      switch (datatype()) {
-        case DataType::Bit:
-          fetch_func = __fetch<ValueType,bool>;
-          store_func = __store<ValueType,bool>;
-          return;
-        case DataType::Int8:
-          fetch_func = __fetch<ValueType,int8_t>;
-          store_func = __store<ValueType,int8_t>;
-          return;
-        case DataType::UInt8:
-          fetch_func = __fetch<ValueType,uint8_t>;
-          store_func = __store<ValueType,uint8_t>;
-          return;
-        case DataType::Int16LE:
-          fetch_func = __fetch_LE<ValueType,int16_t>;
-          store_func = __store_LE<ValueType,int16_t>;
-          return;
-        case DataType::UInt16LE:
-          fetch_func = __fetch_LE<ValueType,uint16_t>;
-          store_func = __store_LE<ValueType,uint16_t>;
-          return;
-        case DataType::Int16BE:
-          fetch_func = __fetch_BE<ValueType,int16_t>;
-          store_func = __store_BE<ValueType,int16_t>;
-          return;
-        case DataType::UInt16BE:
-          fetch_func = __fetch_BE<ValueType,uint16_t>;
-          store_func = __store_BE<ValueType,uint16_t>;
-          return;
-        case DataType::Int32LE:
-          fetch_func = __fetch_LE<ValueType,int32_t>;
-          store_func = __store_LE<ValueType,int32_t>;
-          return;
-        case DataType::UInt32LE:
-          fetch_func = __fetch_LE<ValueType,uint32_t>;
-          store_func = __store_LE<ValueType,uint32_t>;
-          return;
-        case DataType::Int32BE:
-          fetch_func = __fetch_BE<ValueType,int32_t>;
-          store_func = __store_BE<ValueType,int32_t>;
-          return;
-        case DataType::UInt32BE:
-          fetch_func = __fetch_BE<ValueType,uint32_t>;
-          store_func = __store_BE<ValueType,uint32_t>;
-          return;
-        case DataType::Int64LE:
-          fetch_func = __fetch_LE<ValueType,int64_t>;
-          store_func = __store_LE<ValueType,int64_t>;
-          return;
-        case DataType::UInt64LE:
-          fetch_func = __fetch_LE<ValueType,uint64_t>;
-          store_func = __store_LE<ValueType,uint64_t>;
-          return;
-        case DataType::Int64BE:
-          fetch_func = __fetch_BE<ValueType,int64_t>;
-          store_func = __store_BE<ValueType,int64_t>;
-          return;
-        case DataType::UInt64BE:
-          fetch_func = __fetch_BE<ValueType,uint64_t>;
-          store_func = __store_BE<ValueType,uint64_t>;
-          return;
-        case DataType::Float32LE:
-          fetch_func = __fetch_LE<ValueType,float>;
-          store_func = __store_LE<ValueType,float>;
-          return;
-        case DataType::Float32BE:
-          fetch_func = __fetch_BE<ValueType,float>;
-          store_func = __store_BE<ValueType,float>;
-          return;
-        case DataType::Float64LE:
-          fetch_func = __fetch_LE<ValueType,double>;
-          store_func = __store_LE<ValueType,double>;
-          return;
-        case DataType::Float64BE:
-          fetch_func = __fetch_BE<ValueType,double>;
-          store_func = __store_BE<ValueType,double>;
-          return;
-        case DataType::CFloat32LE:
-          fetch_func = __fetch_LE<ValueType,cfloat>;
-          store_func = __store_LE<ValueType,cfloat>;
-          return;
-        case DataType::CFloat32BE:
-          fetch_func = __fetch_BE<ValueType,cfloat>;
-          store_func = __store_BE<ValueType,cfloat>;
-          return;
-        case DataType::CFloat64LE:
-          fetch_func = __fetch_LE<ValueType,cdouble>;
-          store_func = __store_LE<ValueType,cdouble>;
-          return;
-        case DataType::CFloat64BE:
-          fetch_func = __fetch_BE<ValueType,cdouble>;
-          store_func = __store_BE<ValueType,cdouble>;
-          return;
-        default:
-          throw Exception ("invalid data type in image header");
-      }
+
+
+  template <typename ValueType>
+    typename std::enable_if<is_data_type<ValueType>::value, void>::type __set_fetch_store_row_functions (
+        __fetch_row_func<ValueType>& fetch_row_func,
+        __store_row_func<ValueType>& store_row_func,
+        DataType datatype) {
+      ImageIO::visit (datatype, __bind_fetch_store_row<ValueType> { fetch_row_func, store_row_func });
     }
 
   // explicit instantiation of fetch/store methods for all types:
@@ -250,6 +198,10 @@ namespace MR
   template void __set_fetch_store_functions<ValueType> ( \
       std::function<ValueType(const void*,size_t,default_type,default_type)>& fetch_func, \
       std::function<void(ValueType,void*,size_t,default_type,default_type)>& store_func, \
+      DataType datatype); \
+  template void __set_fetch_store_row_functions<ValueType> ( \
+      __fetch_row_func<ValueType>& fetch_row_func, \
+      __store_row_func<ValueType>& store_row_func, \
       DataType datatype)
 
   __DEFINE_FETCH_STORE_FUNCTION_FOR_TYPE(bool);
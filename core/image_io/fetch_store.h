@@ -23,6 +23,92 @@
 namespace MR
 {
 
+  namespace ImageIO
+  {
+
+    //! \cond skip
+    struct NativeByteOrder { NOMEMALIGN
+      template <typename DiskType> static FORCE_INLINE DiskType fetch (const void* data, size_t i) { return Raw::fetch_native<DiskType> (data, i); }
+      template <typename DiskType> static FORCE_INLINE void store (DiskType val, void* data, size_t i) { Raw::store_native<DiskType> (val, data, i); }
+    };
+
+    struct LittleEndianByteOrder { NOMEMALIGN
+      template <typename DiskType> static FORCE_INLINE DiskType fetch (const void* data, size_t i) { return Raw::fetch_LE<DiskType> (data, i); }
+      template <typename DiskType> static FORCE_INLINE void store (DiskType val, void* data, size_t i) { Raw::store_LE<DiskType> (val, data, i); }
+    };
+
+    struct BigEndianByteOrder { NOMEMALIGN
+      template <typename DiskType> static FORCE_INLINE DiskType fetch (const void* data, size_t i) { return Raw::fetch_BE<DiskType> (data, i); }
+      template <typename DiskType> static FORCE_INLINE void store (DiskType val, void* data, size_t i) { Raw::store_BE<DiskType> (val, data, i); }
+    };
+    //! \endcond
+
+
+
+    //! compile-time description of the storage of a DataType on file
+    /*! provides the C++ type used for storage (as \c type), along with static
+     * methods to fetch & store values of that type, including any
+     * byte-swapping required. */
+    template <typename DiskType, class ByteOrder>
+      struct Format { NOMEMALIGN
+        using type = DiskType;
+        static FORCE_INLINE DiskType fetch (const void* data, size_t i) { return ByteOrder::template fetch<DiskType> (data, i); }
+        static FORCE_INLINE void store (DiskType val, void* data, size_t i) { ByteOrder::template store<DiskType> (val, data, i); }
+      };
+
+
+
+    //! invoke \a functor with the Format corresponding to \a datatype
+    /*! This allows a kernel to be instantiated once per on-disk datatype and
+     * byte order, so that the conversion from storage is resolved at
+     * compile-time and can be inlined into the kernel, rather than invoked
+     * through a type-erased function per voxel. The functor needs to provide
+     * a templated call operator of the form:
+     * \code
+     * struct MyKernel {
+     *   template <class Format>
+     *     void operator() (Format) {
+     *       using DiskType = typename Format::type;
+     *       ...
+     *       DiskType val = Format::fetch (data, i);
+     *     }
+     * };
+     * \endcode */
+    template <class Functor>
+      void visit (DataType datatype, Functor&& functor)
+      {
+        switch (datatype()) {
+          case DataType::Bit:        functor (Format<bool,NativeByteOrder>()); return;
+          case DataType::Int8:       functor (Format<int8_t,NativeByteOrder>()); return;
+          case DataType::UInt8:      functor (Format<uint8_t,NativeByteOrder>()); return;
+          case DataType::Int16LE:    functor (Format<int16_t,LittleEndianByteOrder>()); return;
+          case DataType::UInt16LE:   functor (Format<uint16_t,LittleEndianByteOrder>()); return;
+          case DataType::Int16BE:    functor (Format<int16_t,BigEndianByteOrder>()); return;
+          case DataType::UInt16BE:   functor (Format<uint16_t,BigEndianByteOrder>()); return;
+          case DataType::Int32LE:    functor (Format<int32_t,LittleEndianByteOrder>()); return;
+          case DataType::UInt32LE:   functor (Format<uint32_t,LittleEndianByteOrder>()); return;
+          case DataType::Int32BE:    functor (Format<int32_t,BigEndianByteOrder>()); return;
+          case DataType::UInt32BE:   functor (Format<uint32_t,BigEndianByteOrder>()); return;
+          case DataType::Int64LE:    functor (Format<int64_t,LittleEndianByteOrder>()); return;
+          case DataType::UInt64LE:   functor (Format<uint64_t,LittleEndianByteOrder>()); return;
+          case DataType::Int64BE:    functor (Format<int64_t,BigEndianByteOrder>()); return;
+          case DataType::UInt64BE:   functor (Format<uint64_t,BigEndianByteOrder>()); return;
+          case DataType::Float32LE:  functor (Format<float,LittleEndianByteOrder>()); return;
+          case DataType::Float32BE:  functor (Format<float,BigEndianByteOrder>()); return;
+          case DataType::Float64LE:  functor (Format<double,LittleEndianByteOrder>()); return;
+          case DataType::Float64BE:  functor (Format<double,BigEndianByteOrder>()); return;
+          case DataType::CFloat32LE: functor (Format<cfloat,LittleEndianByteOrder>()); return;
+          case DataType::CFloat32BE: functor (Format<cfloat,BigEndianByteOrder>()); return;
+          case DataType::CFloat64LE: functor (Format<cdouble,LittleEndianByteOrder>()); return;
+          case DataType::CFloat64BE: functor (Format<cdouble,BigEndianByteOrder>()); return;
+          default:
+            throw Exception ("invalid data type in image header");
+        }
+      }
+
+  }
+
+
 
   template <typename ValueType>
     typename std::enable_if<!is_data_type<ValueType>::value, void>::type __set_fetch_store_functions (
@@ -39,6 +125,28 @@ namespace MR
         DataType datatype);
 
 
+
+  //! \cond skip
+  //! functions to convert a run of \a count values, \a stride elements apart, in one call
+  template <typename ValueType>
+    using __fetch_row_func = std::function<void(const void*,size_t,ssize_t,ValueType*,size_t,default_type,default_type)>;
+  template <typename ValueType>
+    using __store_row_func = std::function<void(const ValueType*,void*,size_t,ssize_t,size_t,default_type,default_type)>;
+  //! \endcond
+
+  template <typename ValueType>
+    typename std::enable_if<!is_data_type<ValueType>::value, void>::type __set_fetch_store_row_functions (
+        __fetch_row_func<ValueType>& /*fetch_row_func*/,
+        __store_row_func<ValueType>& /*store_row_func*/,
+        DataType /*datatype*/) { }
+
+  template <typename ValueType>
+    typename std::enable_if<is_data_type<ValueType>::value, void>::type __set_fetch_store_row_functions (
+        __fetch_row_func<ValueType>& fetch_row_func,
+        __store_row_func<ValueType>& store_row_func,
+        DataType datatype);
+
+
 }
 
 #endif
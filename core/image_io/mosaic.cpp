@@ -17,7 +17,6 @@
 #include <limits>
 
 #include "app.h"
-#include "progressbar.h"
 #include "header.h"
 #include "image_io/mosaic.h"
 
@@ -44,26 +43,26 @@ namespace MR
       if (!addresses[0])
         throw Exception ("failed to allocate memory for image \"" + header.name() + "\"");
 
-      ProgressBar progress ("reformatting DICOM mosaic images", slices*files.size());
-      uint8_t* data = addresses[0].get();
-      for (size_t n = 0; n < files.size(); n++) {
-        File::MMap file (files[n], false, false, m_xdim * m_ydim * header.datatype().bytes());
-        size_t nx = 0, ny = 0;
-        for (size_t z = 0; z < slices; z++) {
-          size_t ox = nx*xdim;
-          size_t oy = ny*ydim;
-          for (size_t y = 0; y < ydim; y++) {
-            memcpy (data, file.address() + header.datatype().bytes() * (ox + m_xdim* (y+oy)), xdim * header.datatype().bytes());
-            data += xdim * header.datatype().bytes();
+      const size_t bytes = header.datatype().bytes();
+      const size_t mosaic_bytes = m_xdim * m_ydim * bytes;
+      for_each_file ("reformatting DICOM mosaic images", [&] (size_t n) {
+          File::MMap file (files[n], false, false, mosaic_bytes);
+          uint8_t* data = addresses[0].get() + n * bytes_per_segment;
+          size_t nx = 0, ny = 0;
+          for (size_t z = 0; z < slices; z++) {
+            size_t ox = nx*xdim;
+            size_t oy = ny*ydim;
+            for (size_t y = 0; y < ydim; y++) {
+              memcpy (data, file.address() + bytes * (ox + m_xdim* (y+oy)), xdim * bytes);
+              data += xdim * bytes;
+            }
+            nx++;
+            if (nx >= m_xdim / xdim) {
+              nx = 0;
+              ny++;
+            }
           }
-          nx++;
-          if (nx >= m_xdim / xdim) {
-            nx = 0;
-            ny++;
-          }
-          ++progress;
-        }
-      }
+      });
 
       segsize = std::numeric_limits<size_t>::max();
     }
@@ -14,18 +14,272 @@
  * For more details, see http://www.mrtrix.org/.
  */
 
+#include <climits>
+#include <cstdlib>
 #include <limits>
+#include <map>
+#include <mutex>
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#ifdef __linux__
+# include <dirent.h>
+# include <sys/mman.h>
+# include <sys/inotify.h>
+# include <sys/socket.h>
+# include <sys/wait.h>
+#endif
 
+#include "app.h"
 #include "signal_handler.h"
 #include "header.h"
+#include "stride.h"
+#include "file/config.h"
 #include "image_io/pipe.h"
 
+#ifdef __linux__
+extern char** environ;
+#endif
+
 namespace MR
 {
   namespace ImageIO
   {
 
+    namespace
+    {
+
+      // the name given to anonymous shared memory files holding piped images,
+      // as reported by procfs:
+      const std::string shared_memory_name = "mrtrix-piped-image";
+      const std::string shared_memory_link_prefix = "/memfd:" + shared_memory_name;
+
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+
+      // an image in shared memory only exists for as long as some process
+      // holds it open. To allow the sending command to exit as soon as it is
+      // done, the image is handed over to a minimal keeper process, which
+      // holds on to it until the receiving command has opened it.
+      //
+      // The keeper is started along with the shared memory, so that the
+      // command can fall back to a temporary file if this fails. It is a
+      // fresh instance of the executable (so as not to hold on to the memory
+      // and files of the sending command), which is diverted into
+      // run_keeper() on start-up via the environment variables below. The
+      // file descriptors of the shared memory, of an inotify watch on it,
+      // and of a socket back to the sending command are passed on the
+      // command line of the keeper, as "memory,watch,control,timeout_ms".
+      // Over the socket, the keeper first reports that it is ready; the
+      // sending command then requests the hand-over once it has finished
+      // accessing the image itself, which the keeper acknowledges. If the
+      // sending command exits without handing the image over, the keeper
+      // exits too.
+      const char* const keeper_env = "MRTRIX_PIPE_KEEPER";
+      const char* const keeper_message_env = "MRTRIX_PIPE_KEEPER_MESSAGE";
+
+      class Keeper
+      { NOMEMALIGN
+        public:
+          pid_t pid;
+          int memory, control;
+      };
+      std::map<std::string, Keeper> keepers;
+      std::mutex keepers_mutex;
+
+
+      // entry point of the keeper process; only uses system calls, since
+      // this runs during static initialisation of the library
+      void run_keeper (const char* spec)
+      {
+        int memory, watch, control, timeout_ms;
+        if (sscanf (spec, "%d,%d,%d,%d", &memory, &watch, &control, &timeout_ms) != 4)
+          _exit (1);
+        const char* message = getenv (keeper_message_env);
+
+        // release the standard streams, so that processes waiting on them
+        // are not held up; standard error is retained to report a timeout,
+        // unless it is itself a pipe (e.g. captured by the shell):
+        const int null_fd = ::open ("/dev/null", O_RDWR);
+        dup2 (null_fd, STDIN_FILENO);
+        dup2 (null_fd, STDOUT_FILENO);
+        struct stat stderr_stat;
+        if (fstat (STDERR_FILENO, &stderr_stat) || S_ISFIFO (stderr_stat.st_mode) || S_ISSOCK (stderr_stat.st_mode))
+          dup2 (null_fd, STDERR_FILENO);
+
+        // drop any other file inherited from the sending command:
+        DIR* dir = opendir ("/proc/self/fd");
+        if (dir) {
+          struct dirent* entry;
+          while ((entry = readdir (dir))) {
+            const int fd = atoi (entry->d_name);
+            if (fd > STDERR_FILENO && fd != memory && fd != watch && fd != control && fd != dirfd (dir))
+              ::close (fd);
+          }
+          closedir (dir);
+        }
+
+        auto send = [&] (char c) { return ::send (control, &c, 1, MSG_NOSIGNAL) == 1; };
+        auto receive = [&] () {
+          char c = 0;
+          ssize_t n;
+          while ((n = ::read (control, &c, 1)) < 0 && errno == EINTR)
+            continue;
+          return n == 1 ? c : char(0);
+        };
+
+        if (!send ('r') || receive() != 'g')
+          _exit (0);
+
+        // any access up to this point was by the sending command itself:
+        char events[4096];
+        while (::read (watch, events, sizeof (events)) > 0)
+          continue;
+        if (!send ('a'))
+          _exit (0);
+        ::close (control);
+
+        struct pollfd watch_poll = { watch, POLLIN, 0 };
+        int status;
+        while ((status = poll (&watch_poll, 1, timeout_ms)) < 0 && errno == EINTR)
+          continue;
+        if (status == 0 && message) {
+          const ssize_t written = ::write (STDERR_FILENO, message, strlen (message));
+          (void) written;
+        }
+        _exit (0);
+      }
+
+      class KeeperStartup
+      { NOMEMALIGN
+        public:
+          KeeperStartup () {
+            const char* spec = getenv (keeper_env);
+            if (spec)
+              run_keeper (spec);
+          }
+      } keeper_startup;
+
+
+
+      // start the keeper for the shared memory file \a memory, accessible via \a path
+      bool start_keeper (const int memory, const std::string& path)
+      {
+        //CONF option: PipeSharedMemoryTimeout
+        //CONF default: 600
+        //CONF The time in seconds for which an image piped via shared memory
+        //CONF (see PipeSharedMemory) is held once the sending command has
+        //CONF completed, if no command opens it (e.g. if the output of the
+        //CONF sending command was captured by the shell, rather than piped
+        //CONF straight into another MRtrix3 command). The image is discarded
+        //CONF with a warning once this time has elapsed; set to 0 to hold such
+        //CONF images indefinitely.
+        const int timeout = File::Config::get_int ("PipeSharedMemoryTimeout", 600);
+        const int timeout_ms = timeout > 0 ? 1000 * std::min (timeout, std::numeric_limits<int>::max() / 1000) : -1;
+
+        const int watch = inotify_init1 (IN_CLOEXEC | IN_NONBLOCK);
+        if (watch < 0 || inotify_add_watch (watch, path.c_str(), IN_OPEN) < 0) {
+          DEBUG ("unable to monitor shared memory for piped image (" + std::string (strerror (errno)) + ")");
+          if (watch >= 0)
+            ::close (watch);
+          return false;
+        }
+
+        int control[2];
+        if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, control)) {
+          DEBUG ("unable to communicate with keeper of piped image (" + std::string (strerror (errno)) + ")");
+          ::close (watch);
+          return false;
+        }
+
+        // everything needed by the child process must be prepared beforehand,
+        // since memory should not be allocated after forking a multi-threaded process:
+        vector<std::string> env_strings;
+        for (char** e = environ; *e; ++e) {
+          if (strncmp (*e, keeper_env, strlen (keeper_env)))
+            env_strings.push_back (*e);
+        }
+        env_strings.push_back (std::string (keeper_env) + "=" + str(memory) + "," + str(watch) + "," + str(control[1]) + "," + str(timeout_ms));
+        env_strings.push_back (std::string (keeper_message_env) + "=" + App::NAME + ": [WARNING] image piped to standard output "
+            "was not opened by any command within " + str(timeout) + " seconds, and has been discarded "
+            "(see config file option PipeSharedMemoryTimeout)\n");
+        vector<char*> env;
+        for (auto& e : env_strings)
+          env.push_back (&e[0]);
+        env.push_back (nullptr);
+        std::string name = App::NAME;
+        char* argv[] = { &name[0], nullptr };
+
+        const pid_t pid = fork();
+        if (pid == 0) {
+          for (const int fd : { memory, watch, control[1] })
+            fcntl (fd, F_SETFD, 0);
+          execve ("/proc/self/exe", argv, env.data());
+          _exit (127);
+        }
+        ::close (watch);
+        ::close (control[1]);
+
+        char ready = 0;
+        ssize_t n = -1;
+        if (pid > 0) {
+          while ((n = ::read (control[0], &ready, 1)) < 0 && errno == EINTR)
+            continue;
+        }
+        if (n != 1 || ready != 'r') {
+          DEBUG ("unable to start keeper process for piped image");
+          ::close (control[0]);
+          if (pid > 0)
+            waitpid (pid, nullptr, 0);
+          return false;
+        }
+
+        std::lock_guard<std::mutex> lock (keepers_mutex);
+        keepers[path] = { pid, memory, control[0] };
+        return true;
+      }
+
+#endif
+
+
+
+      // hand the image in shared memory over to its keeper; returns the path
+      // via which the receiving process can access the image.
+      std::string hand_over_shared_memory (const std::string& path)
+      {
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+        Keeper keeper;
+        {
+          std::lock_guard<std::mutex> lock (keepers_mutex);
+          auto entry = keepers.find (path);
+          if (entry == keepers.end())
+            throw Exception ("no keeper process for piped image \"" + path + "\"");
+          keeper = entry->second;
+          keepers.erase (entry);
+        }
+
+        const char request = 'g';
+        char reply = 0;
+        bool success = ::send (keeper.control, &request, 1, MSG_NOSIGNAL) == 1;
+        if (success) {
+          ssize_t n;
+          while ((n = ::read (keeper.control, &reply, 1)) < 0 && errno == EINTR)
+            continue;
+          success = n == 1 && reply == 'a';
+        }
+        ::close (keeper.control);
+        ::close (keeper.memory);
+        if (!success)
+          throw Exception ("error handing over piped image \"" + path + "\": keeper process not responding");
+        return "/proc/" + str (keeper.pid) + "/fd/" + str (keeper.memory);
+#else
+        return path;
+#endif
+      }
+
+    }
+
+
     void Pipe::load (const Header& header, size_t)
     {
       assert (files.size() == 1);
@@ -37,25 +291,160 @@ namespace MR
       if (double (bytes_per_segment) >= double (std::numeric_limits<size_t>::max()))
         throw Exception ("image \"" + header.name() + "\" is larger than maximum accessible memory");
 
-      mmap.reset (new File::MMap (files[0], writable, !is_new, bytes_per_segment));
+      // a control block following the data indicates that the image is
+      // being streamed:
+      const int64_t control = Stream::control_offset (files[0].start + bytes_per_segment);
+      struct stat file_stat;
+      const bool streamed = is_shared_memory (files[0].name) &&
+        !stat (files[0].name.c_str(), &file_stat) && file_stat.st_size >= control + Stream::control_size;
+
+      mmap.reset (new File::MMap (files[0], writable, !is_new,
+            streamed ? control + Stream::control_size - files[0].start : bytes_per_segment));
       addresses.resize (1);
       addresses[0].reset (mmap->address());
+
+      if (streamed) {
+        uint8_t* control_address = mmap->address() + (control - files[0].start);
+        if (is_new) {
+          // data are stored slab by slab along the outermost axis in memory:
+          const auto strides = Stride::get_actual (Stride::get (header), header);
+          size_t slab_size = segsize;
+          for (size_t axis = 0, outermost = 0; axis < header.ndim(); ++axis) {
+            if (header.size (axis) > 1 && size_t (std::abs (strides[axis])) > outermost)
+              slab_size = outermost = std::abs (strides[axis]);
+          }
+          stream.reset (new Stream (control_address, segsize, slab_size));
+          // hand the image over straight away:
+          std::cout << hand_over_shared_memory (files[0].name) << std::endl;
+        }
+        else if (Stream::is_valid (control_address)) {
+          stream.reset (new Stream (control_address));
+          DEBUG ("piped image \"" + files[0].name + "\" is being streamed");
+        }
+      }
     }
 
 
     void Pipe::unload (const Header&)
     {
       if (mmap) {
-        mmap.reset();
-        if (is_new) {
-          std::cout << files[0].name << "\n";
-          SignalHandler::unmark_file_for_deletion (files[0].name);
+        if (stream) {
+          // image was handed over on creation; signal that it is complete,
+          // unless this is due to an error:
+          if (is_new)
+            stream->finish (!std::uncaught_exception());
+          stream.reset();
+          mmap.reset();
         }
+        else if (is_new) {
+          mmap.reset();
+          if (is_shared_memory (files[0].name))
+            std::cout << hand_over_shared_memory (files[0].name) << "\n";
+          else {
+            std::cout << files[0].name << "\n";
+            SignalHandler::unmark_file_for_deletion (files[0].name);
+          }
+        }
+        else
+          mmap.reset();
         addresses[0].release();
       }
+      // the mapping is gone, so the reference to a received image is no longer needed:
+      release_shared_memory();
     }
 
     bool Pipe::delete_piped_images = true;
+    bool Pipe::stream_piped_images = false;
+
+
+
+    std::string Pipe::create_shared_memory ()
+    {
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+      //CONF option: PipeSharedMemory
+      //CONF default: 1 (true)
+      //CONF Whether images piped between MRtrix3 commands should be passed
+      //CONF via anonymous shared memory rather than via temporary files in
+      //CONF TmpFileDir (Linux only). This avoids writing and re-reading the
+      //CONF image through the filesystem. Once the sending command completes,
+      //CONF the image is held in memory by a minimal background process until
+      //CONF the receiving command opens it (see PipeSharedMemoryTimeout).
+      //CONF Temporary files are used regardless if standard output is not a
+      //CONF pipe.
+      if (!File::Config::get_bool ("PipeSharedMemory", true))
+        return std::string();
+
+      struct stat stdout_stat;
+      if (fstat (STDOUT_FILENO, &stdout_stat) || !S_ISFIFO (stdout_stat.st_mode))
+        return std::string();
+
+      const int fd = memfd_create (shared_memory_name.c_str(), MFD_CLOEXEC);
+      if (fd < 0) {
+        DEBUG (std::string ("unable to create shared memory for piped image (") + strerror (errno) + "); using temporary file");
+        return std::string();
+      }
+
+      // the receiving process will access the image via procfs:
+      const std::string path = "/proc/" + str (getpid()) + "/fd/" + str (fd);
+      if (access (path.c_str(), R_OK | W_OK)) {
+        DEBUG ("unable to access shared memory for piped image via \"" + path + "\"; using temporary file");
+        ::close (fd);
+        return std::string();
+      }
+
+      if (!start_keeper (fd, path)) {
+        DEBUG ("using temporary file for piped image");
+        ::close (fd);
+        return std::string();
+      }
+
+      DEBUG ("piped image held in shared memory at \"" + path + "\"");
+      return path;
+#else
+      return std::string();
+#endif
+    }
+
+
+
+    bool Pipe::is_shared_memory (const std::string& name)
+    {
+#ifdef __linux__
+      // only claim file descriptors referring to shared memory created by
+      // create_shared_memory(), not any file accessed via procfs:
+      if (name.compare (0, 6, "/proc/") || name.find ("/fd/") == std::string::npos)
+        return false;
+      char target[PATH_MAX];
+      const ssize_t length = readlink (name.c_str(), target, sizeof (target));
+      return length > 0 && std::string (target, length).compare (0, shared_memory_link_prefix.size(), shared_memory_link_prefix) == 0;
+#else
+      return false;
+#endif
+    }
+
+
+
+    std::string Pipe::acquire_shared_memory (const std::string& name, int& fd)
+    {
+      // hold our own reference to the file, so that it persists once the
+      // sending process exits:
+      fd = ::open (name.c_str(), O_RDWR | O_CLOEXEC);
+      if (fd < 0)
+        fd = ::open (name.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0)
+        throw Exception ("error accessing piped image \"" + name + "\": " + strerror (errno));
+      return "/proc/" + str (getpid()) + "/fd/" + str (fd);
+    }
+
+
+
+    void Pipe::release_shared_memory ()
+    {
+      if (shared_memory_fd >= 0) {
+        ::close (shared_memory_fd);
+        shared_memory_fd = -1;
+      }
+    }
 
   }
 }
@@ -19,6 +19,7 @@
 
 #include "memory.h"
 #include "image_io/base.h"
+#include "image_io/stream.h"
 #include "file/mmap.h"
 
 namespace MR
@@ -33,8 +34,44 @@ namespace MR
 
         static bool delete_piped_images;
 
+        //! whether images piped to standard output may be streamed
+        /*! If set, piped images held in shared memory are handed over to the
+         * receiving command as soon as they are created, which can then
+         * process the data as they become available (see ImageIO::Stream).
+         * This should only be set by commands that write each voxel of their
+         * output images exactly once, using row access (e.g. via
+         * threaded_copy() or Image::set_row()), ideally in the order in which
+         * they are stored. */
+        static bool stream_piped_images;
+
+        //! create an anonymous shared memory file to hold a piped image
+        /*! This also starts the process that holds on to the image once this
+         * process has completed, until the receiving command opens it.
+         * Returns the path to the file as accessible to this process, or an
+         * empty string if this transport is disabled or unavailable (in which
+         * case a temporary file should be used instead). */
+        static std::string create_shared_memory ();
+
+        //! whether \a name refers to a piped image held in shared memory
+        static bool is_shared_memory (const std::string& name);
+
+        //! gain access to a piped image held in shared memory by another process
+        /*! returns the path to the file as accessible to this process, which
+         * remains valid once the other process has exited for as long as the
+         * file descriptor \a fd is held open (see hold_shared_memory()). */
+        static std::string acquire_shared_memory (const std::string& name, int& fd);
+
+        //! take ownership of the file descriptor \a fd returned by acquire_shared_memory()
+        /*! the file is closed once the image has been unloaded. */
+        void hold_shared_memory (int fd) { shared_memory_fd = fd; }
+
+        ~Pipe () { release_shared_memory(); }
+
       protected:
         std::unique_ptr<File::MMap> mmap;
+        int shared_memory_fd = -1;
+
+        void release_shared_memory ();
 
         virtual void load (const Header&, size_t);
         virtual void unload (const Header&);
@@ -14,22 +14,187 @@
  * For more details, see http://www.mrtrix.org/.
  */
 
+#include <atomic>
 #include <memory>
+#include <unistd.h>
+#ifndef MRTRIX_WINDOWS
+# include <sys/mman.h>
+#endif
 
 #include "image_io/scratch.h"
 #include "header.h"
+#include "stride.h"
+#include "thread.h"
+#include "file/config.h"
 
 namespace MR
 {
   namespace ImageIO
   {
 
+    namespace
+    {
+
+      constexpr size_t min_mapped_size = 4 << 20;
+      constexpr size_t huge_page_size = 2 << 20;
+
+
+
+      // fault in all pages of a freshly mapped buffer, handing out slabs
+      // to threads in memory order as ThreadedLoop does:
+      class FirstTouch { NOMEMALIGN
+        public:
+          struct Shared { NOMEMALIGN
+            uint8_t* data;
+            size_t size, slab_size, page_size;
+            std::atomic<size_t> next;
+          };
+
+          FirstTouch (Shared& shared) : shared (shared) { }
+
+          void execute () {
+            size_t start;
+            while ((start = shared.slab_size * shared.next++) < shared.size) {
+              const size_t end = std::min (start + shared.slab_size, shared.size);
+              for (size_t n = start; n < end; n += shared.page_size)
+                shared.data[n] = 0;
+            }
+          }
+
+        protected:
+          Shared& shared;
+      };
+
+    }
+
+
+
+    Scratch::Allocation& Scratch::allocation ()
+    {
+      //CONF option: ScratchHugePages
+      //CONF default: none
+      //CONF Whether to back large scratch images (such as the deformation
+      //CONF fields used in mrregister) with huge pages, reducing the cost of
+      //CONF page faults and TLB misses (Linux only). Valid values are: none;
+      //CONF transparent, to request transparent huge pages from the kernel
+      //CONF (if enabled on the system); or explicit, to use huge pages
+      //CONF reserved via hugetlbfs, falling back to regular pages if none are
+      //CONF available.
+
+      //CONF option: ScratchParallelInit
+      //CONF default: 1 (true)
+      //CONF Whether the memory for large scratch images should be
+      //CONF initialised using multiple threads, in the same order as it will
+      //CONF subsequently be processed. On NUMA systems, this ensures the
+      //CONF memory is distributed across the nodes of the threads that will
+      //CONF use it.
+      static Allocation policy = [] {
+        Allocation policy = { Allocation::HugePages::None, File::Config::get_bool ("ScratchParallelInit", true) };
+        const std::string huge_pages = lowercase (File::Config::get ("ScratchHugePages", "none"));
+        if (huge_pages == "transparent")
+          policy.huge_pages = Allocation::HugePages::Transparent;
+        else if (huge_pages == "explicit")
+          policy.huge_pages = Allocation::HugePages::Explicit;
+        else if (huge_pages != "none")
+          WARN ("invalid value \"" + huge_pages + "\" for config file entry \"ScratchHugePages\" - ignored");
+        return policy;
+      }();
+      return policy;
+    }
+
+
+
+    std::unique_ptr<Scratch::Mapping> Scratch::map (const Header& header, size_t size)
+    {
+#ifdef MRTRIX_WINDOWS
+      return std::unique_ptr<Mapping>();
+#else
+      const auto& policy = allocation();
+      const size_t page_size = sysconf (_SC_PAGESIZE);
+      std::unique_ptr<Mapping> mapping;
+
+# ifdef MAP_HUGETLB
+      if (policy.huge_pages == Allocation::HugePages::Explicit) {
+        const size_t huge_size = huge_page_size * ((size + huge_page_size - 1) / huge_page_size);
+        void* address = mmap (nullptr, huge_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (address != MAP_FAILED)
+          mapping.reset (new Mapping (address, huge_size));
+        else
+          DEBUG ("unable to allocate explicit huge pages for scratch buffer (" + std::string (strerror (errno)) + "); using regular pages");
+      }
+# endif
+
+      if (!mapping) {
+        size = page_size * ((size + page_size - 1) / page_size);
+        void* address = mmap (nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (address == MAP_FAILED)
+          return mapping;
+        mapping.reset (new Mapping (address, size));
+# ifdef MADV_HUGEPAGE
+        if (policy.huge_pages != Allocation::HugePages::None)
+          madvise (address, size, MADV_HUGEPAGE);
+# endif
+      }
+
+      // anonymous mappings are zero-filled by the kernel, so the pages only
+      // need to be faulted in; the mapping is already owned at this point,
+      // so it will be unmapped if the threads throw:
+      if (policy.parallel_init) {
+        size_t outer_size = 1;
+        const auto strides = Stride::get (header);
+        for (size_t axis = 0, outermost = 0; axis < header.ndim(); ++axis) {
+          if (header.size (axis) > 1 && size_t (std::abs (strides[axis])) > outermost) {
+            outermost = std::abs (strides[axis]);
+            outer_size = header.size (axis);
+          }
+        }
+        FirstTouch::Shared shared = { mapping->address, mapping->size,
+          page_size * std::max (size_t(1), mapping->size / (outer_size * page_size)), page_size, { 0 } };
+        FirstTouch first_touch (shared);
+        Thread::run (Thread::multi (first_touch), "scratch buffer initialisation").wait();
+      }
+
+      return mapping;
+#endif
+    }
+
+
+
+    Scratch::Mapping::~Mapping ()
+    {
+#ifndef MRTRIX_WINDOWS
+      munmap (address, size);
+#endif
+    }
+
+
+
+    Scratch::~Scratch ()
+    {
+      // the mapping is unmapped by its own destructor; it must not also be
+      // deleted by Base::addresses:
+      if (mapping && addresses.size())
+        addresses[0].release();
+    }
+
+
+
     bool Scratch::is_file_backed () const { return false; }
 
     void Scratch::load (const Header& header, size_t buffer_size)
     {
       assert (buffer_size);
       DEBUG ("allocating scratch buffer for image \"" + header.name() + "\"...");
+
+      if (buffer_size >= min_mapped_size) {
+        mapping = map (header, buffer_size);
+        if (mapping) {
+          addresses.emplace_back();
+          addresses[0].reset (mapping->address);
+          return;
+        }
+      }
+
       try {
         addresses.push_back (std::unique_ptr<uint8_t[]> (new uint8_t [buffer_size]));
         memset (addresses[0].get(), 0, buffer_size);
@@ -43,12 +208,14 @@ namespace MR
     {
       if (addresses.size()) {
         DEBUG ("deleting scratch buffer for image \"" + header.name() + "\"...");
+        if (mapping) {
+          addresses[0].release();
+          mapping.reset();
+          return;
+        }
         addresses[0].reset();
       }
     }
 
   }
 }
-
-
-
@@ -29,10 +29,53 @@ namespace MR
     { NOMEMALIGN
       public:
         Scratch (const Header& header) : Base (header) { }
+        ~Scratch ();
 
         virtual bool is_file_backed () const;
 
+        //! how memory is allocated for large scratch images
+        struct Allocation { NOMEMALIGN
+          enum class HugePages { None, Transparent, Explicit };
+          //! whether to back the buffer with huge pages (Linux only)
+          HugePages huge_pages;
+          //! whether to fault the buffer in using multiple threads
+          /*! The buffer is divided into slabs along its outermost axis,
+           * which are handed out to the threads in order, in the same way
+           * as ThreadedLoop hands out positions along the outer axes. On
+           * NUMA systems, the memory is therefore mostly allocated on the
+           * nodes of the threads that will subsequently process it. */
+          bool parallel_init;
+        };
+
+        //! the allocation policy applied to scratch images
+        /*! This is initialised from the ScratchHugePages &
+         * ScratchParallelInit config file options, and can be modified to
+         * affect all scratch images subsequently allocated. Only buffers of
+         * at least 4MB are affected; smaller buffers are allocated on the
+         * heap. */
+        static Allocation& allocation ();
+
       protected:
+        //! an anonymous memory mapping backing a large scratch buffer
+        /*! The mapping is unmapped when this is destroyed. Its address is
+         * also held in Base::addresses, from which it must be released
+         * rather than deleted. */
+        class Mapping { NOMEMALIGN
+          public:
+            Mapping (void* address, size_t size) :
+              address (static_cast<uint8_t*> (address)),
+              size (size) { }
+            Mapping (const Mapping&) = delete;
+            Mapping& operator= (const Mapping&) = delete;
+            ~Mapping ();
+
+            uint8_t* const address;
+            const size_t size;
+        };
+        std::unique_ptr<Mapping> mapping;
+
+        static std::unique_ptr<Mapping> map (const Header& header, size_t size);
+
         virtual void load (const Header&, size_t);
         virtual void unload (const Header&);
     };
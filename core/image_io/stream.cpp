@@ -0,0 +1,162 @@
+/* Copyright (c) 2008-2024 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+#ifndef MRTRIX_WINDOWS
+# include <signal.h>
+#endif
+
+#include "exception.h"
+#include "image_io/stream.h"
+
+namespace MR
+{
+  namespace ImageIO
+  {
+
+    namespace
+    {
+      constexpr uint64_t stream_magic = 0x6d61657274736d6dULL; // "mmstream"
+      constexpr uint32_t state_writing = 0, state_complete = 1, state_failed = 2;
+    }
+
+
+
+    Stream::Stream (uint8_t* control, size_t voxel_count, size_t slab_size) :
+      block (reinterpret_cast<Block*> (control)),
+      is_source (true),
+      voxel_count (voxel_count),
+      slab_size (std::max (slab_size, size_t(1))),
+      num_slabs ((voxel_count + this->slab_size - 1) / this->slab_size),
+      num_published (0),
+      slab_written (new std::atomic<size_t> [num_slabs])
+    {
+      static_assert (sizeof (Block) <= size_t (control_size), "stream control block too large");
+      for (size_t n = 0; n < num_slabs; ++n)
+        slab_written[n] = 0;
+      new (block) Block;
+      block->magic = stream_magic;
+      block->source_pid = getpid();
+      block->available = 0;
+      block->state = state_writing;
+    }
+
+
+
+    Stream::Stream (uint8_t* control) :
+      block (reinterpret_cast<Block*> (control)),
+      is_source (false),
+      voxel_count (0),
+      slab_size (0),
+      num_slabs (0),
+      num_published (0) { }
+
+
+
+    bool Stream::is_valid (const uint8_t* control)
+    {
+      return reinterpret_cast<const Block*> (control)->magic == stream_magic;
+    }
+
+
+
+    bool Stream::is_complete () const
+    {
+      return block->state.load (std::memory_order_acquire) == state_complete;
+    }
+
+
+
+    void Stream::release (size_t offset, ssize_t stride, size_t count)
+    {
+      if (!is_source)
+        return;
+
+      while (count) {
+        const size_t slab = offset / slab_size;
+        size_t n = count;
+        if (stride > 0)
+          n = std::min (count, ((slab+1)*slab_size - 1 - offset) / stride + 1);
+        else if (stride < 0)
+          n = std::min (count, (offset - slab*slab_size) / (-stride) + 1);
+
+        if (slab_written[slab].fetch_add (n) + n == voxels_in_slab (slab))
+          publish();
+
+        offset += n*stride;
+        count -= n;
+      }
+    }
+
+
+
+    void Stream::publish ()
+    {
+      std::lock_guard<std::mutex> lock (mutex);
+      const size_t previous = num_published;
+      while (num_published < num_slabs && slab_written[num_published] == voxels_in_slab (num_published))
+        ++num_published;
+      if (num_published > previous)
+        block->available.store (std::min (num_published * slab_size, voxel_count), std::memory_order_release);
+    }
+
+
+
+    void Stream::finish (bool success)
+    {
+      if (!is_source)
+        return;
+      if (success) {
+        block->available.store (voxel_count, std::memory_order_release);
+        block->state.store (state_complete, std::memory_order_release);
+      }
+      else
+        block->state.store (state_failed, std::memory_order_release);
+    }
+
+
+
+    void Stream::wait_for (size_t offset) const
+    {
+      auto delay = std::chrono::microseconds (50);
+      auto since_check = std::chrono::microseconds (0);
+      while (offset >= block->available.load (std::memory_order_acquire)) {
+        if (block->state.load (std::memory_order_acquire) == state_failed)
+          throw Exception ("command sending piped image failed");
+
+#ifndef MRTRIX_WINDOWS
+        // the sending process may have been terminated without getting the
+        // chance to flag the failure:
+        if (since_check >= std::chrono::milliseconds (200)) {
+          if (kill (pid_t (block->source_pid), 0) && errno == ESRCH
+              && offset >= block->available.load (std::memory_order_acquire)
+              && block->state.load (std::memory_order_acquire) != state_complete)
+            throw Exception ("command sending piped image terminated unexpectedly");
+          since_check = std::chrono::microseconds (0);
+        }
+#endif
+
+        std::this_thread::sleep_for (delay);
+        since_check += delay;
+        delay = std::min (2*delay, std::chrono::microseconds (5000));
+      }
+    }
+
+  }
+}
+
@@ -0,0 +1,110 @@
+/* Copyright (c) 2008-2024 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#ifndef __image_io_stream_h__
+#define __image_io_stream_h__
+
+#include <atomic>
+#include <mutex>
+
+#include "memory.h"
+#include "types.h"
+
+namespace MR
+{
+  namespace ImageIO
+  {
+
+    //! track the progress of an image streamed from one process to another
+    /*! This allows a piped image to be handed over to the receiving command
+     * while the sending command is still writing it (see ImageIO::Pipe).
+     * The data are divided into slabs along the outermost axis in memory;
+     * once all voxels in a slab have been written, and all preceding slabs
+     * are complete, the slab is published to the receiving process via a
+     * small control block held in shared memory alongside the image data.
+     *
+     * On the sending side, only voxels written via row access (i.e.
+     * Image::set_row(), as used by threaded_copy()) are accounted for, and
+     * each voxel must be written exactly once. Any data written otherwise
+     * only become available once the image is closed.
+     *
+     * On the receiving side, any attempt to read a voxel waits until that
+     * voxel has been published. */
+    class Stream
+    { NOMEMALIGN
+      public:
+        //! the size of the control block in bytes
+        static constexpr int64_t control_size = 64;
+        //! the byte offset of the control block for data ending at \a data_end
+        static int64_t control_offset (int64_t data_end) {
+          return (data_end + control_size - 1) & ~(control_size - 1);
+        }
+
+        //! initialise the control block at \a control for an image being sent
+        Stream (uint8_t* control, size_t voxel_count, size_t slab_size);
+        //! attach to the control block at \a control of an image being received
+        Stream (uint8_t* control);
+
+        //! whether the control block at \a control was initialised by a sending process
+        static bool is_valid (const uint8_t* control);
+
+        //! whether all data are available
+        bool is_complete () const;
+
+        //! wait until \a count values, \a stride elements apart, starting at \a offset are available
+        /*! this has no effect for the sending process. */
+        FORCE_INLINE void acquire (size_t offset, ssize_t stride, size_t count) const {
+          if (is_source || !count)
+            return;
+          const size_t last = stride < 0 ? offset : offset + (count-1)*stride;
+          if (last >= block->available.load (std::memory_order_acquire))
+            wait_for (last);
+        }
+
+        //! record that \a count values, \a stride elements apart, starting at \a offset have been written
+        /*! this has no effect for the receiving process. */
+        void release (size_t offset, ssize_t stride, size_t count);
+
+        //! mark the image as complete, or as failed if \a success is false
+        void finish (bool success);
+
+      protected:
+        struct Block { NOMEMALIGN
+          uint64_t magic;
+          int64_t source_pid;
+          std::atomic<uint64_t> available;
+          std::atomic<uint32_t> state;
+        };
+
+        Block* block;
+        const bool is_source;
+        size_t voxel_count, slab_size, num_slabs, num_published;
+        std::unique_ptr<std::atomic<size_t>[]> slab_written;
+        std::mutex mutex;
+
+        size_t voxels_in_slab (size_t slab) const {
+          return std::min (slab_size, voxel_count - slab*slab_size);
+        }
+
+        void publish ();
+        void wait_for (size_t offset) const;
+    };
+
+  }
+}
+
+#endif
+
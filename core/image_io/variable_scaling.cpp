@@ -17,7 +17,6 @@
 #include <limits>
 
 #include "app.h"
-#include "progressbar.h"
 #include "header.h"
 #include "image_io/variable_scaling.h"
 
@@ -44,20 +43,17 @@ namespace MR
       if (!addresses[0])
         throw Exception ("failed to allocate memory for image \"" + header.name() + "\"");
 
-      ProgressBar progress ("rescaling DICOM images", files.size());
       float32* data = reinterpret_cast<float32*> (addresses[0].get());
-      for (size_t n = 0; n < files.size(); n++) {
-        const float offset = scale_factors[n].offset;
-        const float scale = scale_factors[n].scale;
-        File::MMap file (files[n], false, false, sizeof(uint16_t) * voxels_per_segment);
-        const uint16_t* from = reinterpret_cast<uint16_t*> (file.address());
-
-        for (size_t i = 0; i < voxels_per_segment; i++)
-          data[i] = offset + scale * from[i];
-
-        data += voxels_per_segment;
-        ++progress;
-      }
+      for_each_file ("rescaling DICOM images", [&] (size_t n) {
+          const float offset = scale_factors[n].offset;
+          const float scale = scale_factors[n].scale;
+          File::MMap file (files[n], false, false, sizeof(uint16_t) * voxels_per_segment);
+          const uint16_t* from = reinterpret_cast<uint16_t*> (file.address());
+          float32* to = data + n * voxels_per_segment;
+
+          for (size_t i = 0; i < voxels_per_segment; i++)
+            to[i] = offset + scale * from[i];
+      });
 
     }
 
@@ -208,8 +208,23 @@ namespace MR
           return coeff_matrix * weights_vec;
         }
 
+        //! the number of voxels along each axis contributing to an interpolated value
+        static constexpr ssize_t taps_per_axis = 4;
+        using weights_type = Eigen::Matrix<value_type, 64, 1>;
+        using coefficients_type = Eigen::Matrix<value_type, 64, 1>;
+
+        //! the interpolation weights for the current position, as set by voxel()
+        /*! these apply to the 4x4x4 voxels starting from first_tap(), in
+         * order of increasing index along axis 0, then 1, then 2. This allows
+         * the weights to be computed once and applied to multiple volumes,
+         * as done in Filter::reslice(). */
+        const weights_type& weights () const { return weights_vec; }
+
+        //! the index along \a axis of the first voxel contributing to the current position
+        ssize_t first_tap (size_t axis) const { return ssize_t (std::floor (P[axis])-1); }
+
       protected:
-        Eigen::Matrix<value_type, 64, 1> weights_vec;
+        weights_type weights_vec;
     };
 
 
@@ -245,8 +245,21 @@ namespace MR
           return coeff_matrix * factors;
         }
 
+        //! the number of voxels along each axis contributing to an interpolated value
+        static constexpr ssize_t taps_per_axis = 2;
+        using weights_type = Eigen::Matrix<coef_type, 8, 1>;
+        using coefficients_type = Eigen::Matrix<value_type, 8, 1>;
+
+        //! the interpolation weights for the current position, as set by voxel()
+        /*! these apply to the 2x2x2 voxels starting from first_tap(), in
+         * order of increasing index along axis 0, then 1, then 2. */
+        const weights_type& weights () const { return factors; }
+
+        //! the index along \a axis of the first voxel contributing to the current position
+        ssize_t first_tap (size_t axis) const { return ssize_t (std::floor (P[axis])); }
+
       protected:
-        Eigen::Matrix<coef_type, 8, 1> factors;
+        weights_type factors;
     };
 
 
@@ -0,0 +1,286 @@
+/* Copyright (c) 2008-2024 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#ifndef __math_fft_h__
+#define __math_fft_h__
+
+#include <complex>
+#ifdef EIGEN_FFTW_DEFAULT
+# include <unsupported/Eigen/FFT>
+#endif
+
+#include "types.h"
+#include "math/math.h"
+
+namespace MR
+{
+  namespace Math
+  {
+
+    //! compute the FFT of many lines of the same length at once
+    /*! The lines to be transformed are held in the rows of a column-major
+     * array, so that the corresponding element of all lines are contiguous
+     * in memory. The transform is a mixed-radix Stockham autosort FFT
+     * (radices 4, 2, 3 & 5, with a generic butterfly for any other prime
+     * factor), where each butterfly operates on all lines at once; this
+     * allows the arithmetic to be vectorised across lines, and amortises
+     * the twiddle factor computations over the whole batch. Results match
+     * those of Eigen::FFT to within rounding error.
+     *
+     * In builds configured with FFTW (EIGEN_FFTW_DEFAULT), double-precision
+     * transforms are instead passed to FFTW one line at a time through
+     * Eigen::FFT; only the double-precision FFTW library is linked, so
+     * other precisions still use the internal transform.
+     *
+     * As for Eigen::FFT, the inverse transform is scaled by 1/N.
+     *
+     * Each instance holds its own working buffers, so a separate instance
+     * should be used in each thread. */
+    template <typename ValueType>
+    class BatchFFT
+    { MEMALIGN(BatchFFT<ValueType>)
+      public:
+        using value_type = ValueType;
+        using complex_type = std::complex<ValueType>;
+        using array_type = Eigen::Array<complex_type, Eigen::Dynamic, Eigen::Dynamic>;
+        using real_array_type = Eigen::Array<value_type, Eigen::Dynamic, Eigen::Dynamic>;
+
+        BatchFFT (const size_t N = 0) { set_size (N); }
+        // the FFTW plans held by Eigen::FFT cannot be shared between copies:
+        BatchFFT (const BatchFFT& that) : BatchFFT (that.n) { }
+        BatchFFT& operator= (const BatchFFT& that) { set_size (that.n); return *this; }
+
+        //! set the length of the lines to be transformed
+        void set_size (const size_t N)
+        {
+          if (N == n)
+            return;
+          n = N;
+          stages.clear();
+          size_t remaining = n, L = 1;
+          while (remaining > 1) {
+            size_t radix = 0;
+            for (auto p : { 4, 2, 3, 5 }) {
+              if (remaining % p == 0) {
+                radix = p;
+                break;
+              }
+            }
+            if (!radix)
+              for (radix = 7; remaining % radix; radix += 2);
+            remaining /= radix;
+            stages.emplace_back (radix, L, remaining);
+            L *= radix;
+          }
+#ifdef EIGEN_FFTW_DEFAULT
+          // create the FFTW plans up front, since FFTW planning is not thread-safe:
+          if (use_fftw && n) {
+            line_in.setZero (n);
+            fftw.fwd (line_out, line_in);
+            fftw.inv (line_out, line_in);
+          }
+#endif
+        }
+
+        size_t size () const { return n; }
+
+        //! forward FFT of each row of \a data, in place
+        void forward (array_type& data) { transform (data, false); }
+        //! inverse FFT of each row of \a data, in place
+        void inverse (array_type& data) { transform (data, true); }
+
+        //! forward FFT of each row of the real array \a in
+        /*! Pairs of rows are packed as the real & imaginary parts of a
+         * single complex line, and the transforms of both recovered from
+         * the Hermitian symmetry of their spectra, halving the number of
+         * lines to be transformed. The full spectrum is stored in \a out. */
+        void forward (const real_array_type& in, array_type& out)
+        {
+          assert (size_t (in.cols()) == n);
+          const ssize_t batch = in.rows(), pairs = (batch+1) / 2;
+          packed.resize (pairs, n);
+          for (size_t k = 0; k < n; ++k) {
+            for (ssize_t b = 0; b < batch/2; ++b)
+              packed(b,k) = complex_type (in(2*b,k), in(2*b+1,k));
+            if (batch & 1)
+              packed(pairs-1,k) = complex_type (in(batch-1,k), value_type(0));
+          }
+
+          forward (packed);
+
+          out.resize (batch, n);
+          for (size_t k = 0; k < n; ++k) {
+            const size_t kc = k ? n-k : 0;
+            for (ssize_t b = 0; b < pairs; ++b) {
+              const complex_type z = packed(b,k), zc = std::conj (packed(b,kc));
+              out(2*b,k) = value_type(0.5) * (z + zc);
+              if (2*b+1 < batch) {
+                const complex_type d = z - zc;
+                out(2*b+1,k) = complex_type (value_type(0.5) * d.imag(), value_type(-0.5) * d.real());
+              }
+            }
+          }
+        }
+
+
+      protected:
+        class Stage { MEMALIGN(Stage)
+          public:
+            Stage (const size_t radix, const size_t L, const size_t R) :
+                radix (radix), L (L), R (R),
+                twiddles (L * radix),
+                roots (radix)
+            {
+              for (size_t k = 0; k < L; ++k)
+                for (size_t q = 0; q < radix; ++q)
+                  twiddles[k*radix + q] = std::polar (value_type(1), value_type (-2.0 * Math::pi * q * k / double (L * radix)));
+              for (size_t q = 0; q < radix; ++q)
+                roots[q] = std::polar (value_type(1), value_type (-2.0 * Math::pi * q / double (radix)));
+            }
+
+            // radix of this stage, length of the sub-transforms on input, and number of them on output
+            size_t radix, L, R;
+            vector<complex_type> twiddles, roots;
+        };
+
+        using block_type = Eigen::Map<Eigen::Array<complex_type, Eigen::Dynamic, 1>>;
+
+        size_t n = 0;
+        vector<Stage> stages;
+        array_type buffer, packed;
+        Eigen::Array<complex_type, Eigen::Dynamic, 1> work;
+
+#ifdef EIGEN_FFTW_DEFAULT
+        static constexpr bool use_fftw = std::is_same<value_type,double>::value;
+        Eigen::FFT<double> fftw;
+        Eigen::Matrix<cdouble, Eigen::Dynamic, 1> line_in, line_out;
+
+        void transform_fftw (array_type& data, const bool inverse)
+        {
+          for (ssize_t b = 0; b < data.rows(); ++b) {
+            for (size_t k = 0; k < n; ++k)
+              line_in[k] = data(b,k);
+            if (inverse)
+              fftw.inv (line_out, line_in);
+            else
+              fftw.fwd (line_out, line_in);
+            for (size_t k = 0; k < n; ++k)
+              data(b,k) = complex_type (line_out[k]);
+          }
+        }
+#endif
+
+
+        void transform (array_type& data, const bool inverse)
+        {
+          assert (size_t (data.cols()) == n);
+#ifdef EIGEN_FFTW_DEFAULT
+          if (use_fftw) {
+            transform_fftw (data, inverse);
+            return;
+          }
+#endif
+          buffer.resize (data.rows(), n);
+          bool in_buffer = false;
+          for (const auto& stage : stages) {
+            if (in_buffer)
+              run_stage (stage, buffer.data(), data.data(), data.rows(), inverse);
+            else
+              run_stage (stage, data.data(), buffer.data(), data.rows(), inverse);
+            in_buffer = !in_buffer;
+          }
+          if (in_buffer)
+            data.swap (buffer);
+          if (inverse)
+            data *= value_type (1.0 / n);
+        }
+
+
+        // The input holds, for each of the R*radix residues r and each frequency k < L, the
+        // length-L DFTs of the subsequences x[r + j*R*radix], at position (k*R*radix + r);
+        // the output holds the same for length L*radix, at position (k*R + r).
+        void run_stage (const Stage& stage, complex_type* in, complex_type* out, const ssize_t batch, const bool inverse)
+        {
+          const size_t p = stage.radix, L = stage.L;
+          const ssize_t block = stage.R * batch;
+          auto input  = [&] (size_t k, size_t q) { return block_type (in  + (k*p + q) * block, block); };
+          auto output = [&] (size_t k, size_t c) { return block_type (out + (k + L*c) * block, block); };
+          auto twiddle = [&] (size_t k, size_t q) { return inverse ? std::conj (stage.twiddles[k*p + q]) : stage.twiddles[k*p + q]; };
+
+          work.resize (p * block);
+          auto a = [&] (size_t q) { return block_type (work.data() + q * block, block); };
+
+          for (size_t k = 0; k < L; ++k) {
+            a(0) = input (k, 0);
+            for (size_t q = 1; q < p; ++q) {
+              if (k)
+                a(q) = twiddle (k, q) * input (k, q);
+              else
+                a(q) = input (k, q);
+            }
+
+            switch (p) {
+              case 2:
+                output (k, 0) = a(0) + a(1);
+                output (k, 1) = a(0) - a(1);
+                break;
+              case 3: {
+                const complex_type j (value_type(0), inverse ? value_type(1) : value_type(-1));
+                const complex_type half (value_type(0.5)), s (value_type (std::sin (2.0 * Math::pi / 3.0)));
+                output (k, 0) = a(0) + (a(1) + a(2));
+                output (k, 1) = (a(0) - half * (a(1) + a(2))) + (j * s) * (a(1) - a(2));
+                output (k, 2) = (a(0) - half * (a(1) + a(2))) - (j * s) * (a(1) - a(2));
+                break;
+              }
+              case 4: {
+                const complex_type j (value_type(0), inverse ? value_type(1) : value_type(-1));
+                output (k, 0) = (a(0) + a(2)) + (a(1) + a(3));
+                output (k, 2) = (a(0) + a(2)) - (a(1) + a(3));
+                output (k, 1) = (a(0) - a(2)) + j * (a(1) - a(3));
+                output (k, 3) = (a(0) - a(2)) - j * (a(1) - a(3));
+                break;
+              }
+              case 5: {
+                const complex_type j (value_type(0), inverse ? value_type(1) : value_type(-1));
+                const complex_type c1 (value_type (std::cos (2.0 * Math::pi / 5.0))), c2 (value_type (std::cos (4.0 * Math::pi / 5.0)));
+                const complex_type s1 (j * value_type (std::sin (2.0 * Math::pi / 5.0))), s2 (j * value_type (std::sin (4.0 * Math::pi / 5.0)));
+                output (k, 0) = a(0) + (a(1) + a(4)) + (a(2) + a(3));
+                output (k, 1) = (a(0) + c1 * (a(1) + a(4)) + c2 * (a(2) + a(3))) + (s1 * (a(1) - a(4)) + s2 * (a(2) - a(3)));
+                output (k, 4) = (a(0) + c1 * (a(1) + a(4)) + c2 * (a(2) + a(3))) - (s1 * (a(1) - a(4)) + s2 * (a(2) - a(3)));
+                output (k, 2) = (a(0) + c2 * (a(1) + a(4)) + c1 * (a(2) + a(3))) + (s2 * (a(1) - a(4)) - s1 * (a(2) - a(3)));
+                output (k, 3) = (a(0) + c2 * (a(1) + a(4)) + c1 * (a(2) + a(3))) - (s2 * (a(1) - a(4)) - s1 * (a(2) - a(3)));
+                break;
+              }
+              default:
+                for (size_t c = 0; c < p; ++c) {
+                  auto o = output (k, c);
+                  o = a(0);
+                  for (size_t q = 1; q < p; ++q) {
+                    const complex_type w = stage.roots[(q*c) % p];
+                    o += (inverse ? std::conj (w) : w) * a(q);
+                  }
+                }
+            }
+          }
+        }
+
+    };
+
+  }
+}
+
+#endif
+
@@ -0,0 +1,142 @@
+/* Copyright (c) 2008-2024 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#ifndef __math_quantile_sketch_h__
+#define __math_quantile_sketch_h__
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "types.h"
+#include "math/rng.h"
+
+
+namespace MR
+{
+  namespace Math
+  {
+
+    //! estimate quantiles of a stream of values using bounded memory
+    /*! This implements the KLL sketch (Karnin, Lang & Liberty, 2016):
+     * values are held in a hierarchy of compactors, where each item at level
+     * \e h stands in for 2^h of the original values. Whenever the sketch
+     * reaches its capacity, the lowest full compactor is sorted, and every
+     * other item (starting from a random offset) promoted to the next level.
+     *
+     * Memory usage is bounded by roughly 3 \a k values irrespective of the
+     * number of values inserted, and the rank error of the estimated
+     * quantiles is of the order of 1/\a k. Sketches can be merged, so
+     * values can be accumulated in multiple threads and combined at the
+     * end. */
+    class QuantileSketch { NOMEMALIGN
+      public:
+        using value_type = float;
+
+        QuantileSketch (size_t k = 2048) :
+          k (k), count (0), num_items (0), capacity_total (0),
+          levels (1) {
+            update_capacity();
+          }
+
+        //! the number of values inserted into the sketch
+        size_t size () const { return count; }
+
+        void operator() (value_type value) {
+          levels[0].push_back (value);
+          ++count;
+          if (++num_items >= capacity_total)
+            compress();
+        }
+
+        //! add the contents of \a other into this sketch
+        void merge (const QuantileSketch& other) {
+          if (other.levels.size() > levels.size())
+            levels.resize (other.levels.size());
+          for (size_t h = 0; h < other.levels.size(); ++h)
+            levels[h].insert (levels[h].end(), other.levels[h].begin(), other.levels[h].end());
+          count += other.count;
+          num_items += other.num_items;
+          update_capacity();
+          while (num_items >= capacity_total)
+            compress();
+        }
+
+        //! estimate the value at quantile \a q (between 0 and 1)
+        value_type quantile (default_type q) const {
+          if (!num_items)
+            return std::numeric_limits<value_type>::quiet_NaN();
+          vector<std::pair<value_type,size_t>> items;
+          items.reserve (num_items);
+          for (size_t h = 0; h < levels.size(); ++h)
+            for (const auto& value : levels[h])
+              items.push_back ({ value, size_t(1) << h });
+          std::sort (items.begin(), items.end());
+          const default_type target = q * count;
+          size_t cumulative = 0;
+          for (const auto& item : items) {
+            cumulative += item.second;
+            if (cumulative > target)
+              return item.first;
+          }
+          return items.back().first;
+        }
+
+      protected:
+        const size_t k;
+        size_t count, num_items, capacity_total;
+        vector<vector<value_type>> levels;
+        RNG rng;
+
+        // capacities decrease geometrically by a factor of 2/3 from the top level down:
+        size_t capacity (size_t h) const {
+          const default_type depth = levels.size() - h - 1;
+          return std::max (size_t(2), size_t (std::ceil (k * std::pow (2.0/3.0, depth))));
+        }
+
+        void update_capacity () {
+          capacity_total = 0;
+          for (size_t h = 0; h < levels.size(); ++h)
+            capacity_total += capacity (h);
+        }
+
+        void compress () {
+          for (size_t h = 0; h < levels.size(); ++h) {
+            if (levels[h].size() < capacity (h))
+              continue;
+            if (h+1 == levels.size()) {
+              levels.emplace_back();
+              update_capacity();
+            }
+            // if the number of items is odd, leave the largest one behind:
+            std::sort (levels[h].begin(), levels[h].end());
+            const size_t num_pairs = levels[h].size() / 2;
+            const size_t offset = rng() & 1U;
+            auto& next = levels[h+1];
+            for (size_t n = 0; n < num_pairs; ++n)
+              next.push_back (levels[h][2*n + offset]);
+            levels[h].erase (levels[h].begin(), levels[h].begin() + 2*num_pairs);
+            num_items -= num_pairs;
+            return;
+          }
+        }
+    };
+
+  }
+}
+
+#endif
+
@@ -0,0 +1,123 @@
+/* Copyright (c) 2008-2024 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#ifndef __misc_union_find_h__
+#define __misc_union_find_h__
+
+
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <stdint.h>
+
+#include "exception.h"
+#include "mrtrix.h"
+
+
+
+namespace MR {
+
+
+
+  //! a disjoint-set forest that may be modified concurrently by multiple threads
+  /*! The UnionFind class stores, for each of a fixed number of elements, the
+   * index of its parent within a forest of trees; elements belonging to the
+   * same tree belong to the same set. Initially each element forms its own
+   * set.
+   *
+   * Both find() and merge() are lock-free, and may therefore be invoked
+   * concurrently from multiple threads (for instance, from within a
+   * ThreadedLoop). Trees are always linked such that the root of the merged
+   * set is the lowest index of all of its elements; hence, once all merges
+   * are complete, the root of any set is independent of the order in which
+   * the merges were performed. */
+  class UnionFind { NOMEMALIGN
+
+    public:
+      using index_type = uint32_t;
+
+      UnionFind (const size_t size) :
+          num (size)
+      {
+        if (size > size_t(std::numeric_limits<index_type>::max()))
+          throw Exception ("Too many elements (" + str(size) + ") for union-find data structure");
+        parents.reset (new std::atomic<index_type> [size]);
+        reset();
+      }
+
+      //! the number of elements
+      size_t size () const { return num; }
+
+      //! revert to each element forming its own set
+      void reset ()
+      {
+        for (size_t i = 0; i != num; ++i)
+          parents[i].store (index_type(i), std::memory_order_relaxed);
+      }
+
+      //! whether element \a i is the root of its set
+      bool is_root (const index_type i) const
+      {
+        assert (i < num);
+        return parents[i].load (std::memory_order_relaxed) == i;
+      }
+
+      //! get the root of the set to which element \a i belongs
+      /*! Path halving is performed along the way. */
+      index_type find (index_type i)
+      {
+        assert (i < num);
+        while (true) {
+          index_type parent = parents[i].load (std::memory_order_relaxed);
+          if (parent == i)
+            return i;
+          const index_type grandparent = parents[parent].load (std::memory_order_relaxed);
+          if (grandparent != parent)
+            parents[i].compare_exchange_weak (parent, grandparent, std::memory_order_relaxed);
+          i = grandparent;
+        }
+      }
+
+      //! merge the sets to which elements \a a and \a b belong
+      /*! \returns true if the two elements previously belonged to different sets */
+      bool merge (index_type a, index_type b)
+      {
+        while (true) {
+          a = find (a);
+          b = find (b);
+          if (a == b)
+            return false;
+          if (a < b)
+            std::swap (a, b);
+          // Link the root with the higher index beneath the other; this only
+          //   succeeds if it has not in the meantime been linked elsewhere
+          index_type expected = a;
+          if (parents[a].compare_exchange_strong (expected, b, std::memory_order_relaxed))
+            return true;
+        }
+      }
+
+    private:
+      const size_t num;
+      std::unique_ptr<std::atomic<index_type>[]> parents;
+
+  };
+
+
+
+}
+
+#endif
@@ -40,7 +40,13 @@ namespace MR
     + Argument ("image").type_image_in ()
 
     + Option ("ignorezero",
-        "ignore zero values during statistics calculation");
+        "ignore zero values during statistics calculation")
+
+    + Option ("approximate",
+        "estimate the median using a fixed-size quantile sketch, rather than "
+        "storing and sorting all values. This bounds the memory required "
+        "irrespective of image size, at the expense of a small error in the "
+        "median (typically well below 0.1% in terms of rank).");
 
   }
 
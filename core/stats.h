@@ -21,6 +21,7 @@
 #include "app.h"
 #include "file/ofstream.h"
 #include "math/median.h"
+#include "math/quantile_sketch.h"
 
 
 namespace MR
@@ -38,7 +39,7 @@ namespace MR
 
     class Stats { NOMEMALIGN
       public:
-        Stats (const bool is_complex = false, const bool ignorezero = false) :
+        Stats (const bool is_complex = false, const bool ignorezero = false, const bool approximate_median = false) :
             mean (0.0, 0.0),
             delta (0.0, 0.0),
             delta2 (0.0, 0.0),
@@ -49,7 +50,8 @@ namespace MR
             max (-INFINITY, -INFINITY),
             count (0),
             is_complex (is_complex),
-            ignore_zero (ignorezero) { }
+            ignore_zero (ignorezero),
+            approximate_median (approximate_median) { }
 
 
         void operator() (complex_type val) {
@@ -64,11 +66,32 @@ namespace MR
             mean += cdouble(delta.real() / count, delta.imag() / count);
             delta2 = val - mean;
             m2 += cdouble(delta.real() * delta2.real(), delta.imag() * delta2.imag());
-            if (!is_complex)
-              values.push_back(val.real());
+            if (!is_complex) {
+              if (approximate_median)
+                sketch (val.real());
+              else
+                values.push_back(val.real());
+            }
           }
         }
 
+        //! combine with statistics accumulated separately (e.g. in another thread)
+        void merge (const Stats& other) {
+          if (!other.count)
+            return;
+          min = complex_type (std::min (min.real(), other.min.real()), std::min (min.imag(), other.min.imag()));
+          max = complex_type (std::max (max.real(), other.max.real()), std::max (max.imag(), other.max.imag()));
+          // pairwise update of mean & sum of squared deviations (Chan et al.):
+          const value_type total = count + other.count;
+          const value_type weight = value_type (count) * value_type (other.count) / total;
+          delta = other.mean - mean;
+          mean += cdouble(delta.real() * other.count / total, delta.imag() * other.count / total);
+          m2 += other.m2 + cdouble(delta.real() * delta.real() * weight, delta.imag() * delta.imag() * weight);
+          count += other.count;
+          values.insert (values.end(), other.values.begin(), other.values.end());
+          sketch.merge (other.sketch);
+        }
+
         template <class ImageType> void print (ImageType& ima, const vector<std::string>& fields) {
 
           if (count > 1) {
@@ -87,7 +110,7 @@ namespace MR
             }
             for (size_t n = 0; n < fields.size(); ++n) {
               if (fields[n] == "mean") std::cout << str(mean) << " ";
-              else if (fields[n] == "median") std::cout << ( values.size() > 0 ? str(Math::median (values)) : "N/A" ) << " ";
+              else if (fields[n] == "median") std::cout << ( count > 0 ? str(median()) : "N/A" ) << " ";
               else if (fields[n] == "std") std::cout << ( count > 1 ? str(std) : "N/A" ) << " ";
               else if (fields[n] == "std_rv") std::cout << ( count > 1 ? str(std_rv) : "N/A" ) << " ";
               else if (fields[n] == "min") std::cout << str(min) << " ";
@@ -116,7 +139,7 @@ namespace MR
             if (!is_complex) {
               std::cout << " " << std::setw(width) << std::right;
               if (count)
-                std::cout << Math::median (values);
+                std::cout << median();
               else
                 std::cout << "N/A";
             }
@@ -131,8 +154,13 @@ namespace MR
       private:
         complex_type mean, delta, delta2, m2, std, std_rv, min, max;
         size_t count;
-        const bool is_complex, ignore_zero;
+        const bool is_complex, ignore_zero, approximate_median;
         vector<float> values;
+        Math::QuantileSketch sketch;
+
+        float median () {
+          return approximate_median ? sketch.quantile (0.5) : Math::median (values);
+        }
     };
 
 
@@ -70,6 +70,14 @@ namespace MR {
 
           void operator() (in_column_type, const value_type, out_column_type) const override;
 
+          bool provides_adjacency () const override { return true; }
+          bool supra_threshold (const value_type value, const value_type T) const override {
+            return std::isfinite (value) && value >= T;
+          }
+          void get_neighbours (const size_t index, vector<size_t>& neighbours) const override {
+            neighbours = (*adjacency)[index];
+          }
+
         protected:
           std::shared_ptr< vector< vector<size_t> > > adjacency;
           value_type threshold;
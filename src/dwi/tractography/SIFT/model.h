@@ -117,7 +117,7 @@ namespace MR
                   fixel_counts (master.fixels.size(), 0)
               {
                 mapper.set_upsample_ratio (upsample_ratio);
-                mapper.set_use_precise_mapping (true);
+                mapper.set_use_precise_or_exact_mapping();
               }
               TrackMappingWorker (const TrackMappingWorker& that) :
                   master (that.master),
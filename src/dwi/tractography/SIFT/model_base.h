@@ -243,7 +243,7 @@ namespace MR
           Mapping::TrackLoader loader (file, count);
           Mapping::TrackMapperBase mapper (Fixel_map<Fixel>::header(), dirs);
           mapper.set_upsample_ratio (Mapping::determine_upsample_ratio (Fixel_map<Fixel>::header(), properties, 0.1));
-          mapper.set_use_precise_mapping (true);
+          mapper.set_use_precise_or_exact_mapping();
           Thread::run_queue (
               loader,
               Thread::batch (Tractography::Streamline<float>()),
@@ -16,6 +16,8 @@
 
 #include "dwi/tractography/mapping/mapper.h"
 
+#include "file/config.h"
+
 
 namespace MR {
 namespace DWI {
@@ -25,6 +27,29 @@ namespace Mapping {
 
 
 
+void TrackMapperBase::set_use_precise_or_exact_mapping ()
+{
+  //CONF option: TrackMappingExact
+  //CONF default: 0 (false)
+  //CONF Whether commands that quantify the length of streamlines within
+  //CONF each voxel or fixel (tcksift, tcksift2, tck2fixel,
+  //CONF fixelconnectivity and afdconnectivity) should compute the exact
+  //CONF length of each streamline polyline within each voxel (as with
+  //CONF tckmap -exact), rather than that of an upsampled Hermite spline
+  //CONF (as with tckmap -precise). Exact mapping is faster, but moves a
+  //CONF small fraction of length across voxel boundaries relative to the
+  //CONF default behaviour.
+  static const bool exact = File::Config::get_bool ("TrackMappingExact", false);
+  if (exact)
+    set_use_exact_mapping (true);
+  else
+    set_use_precise_mapping (true);
+}
+
+
+
+
+
 void TrackMapperBase::voxelise (const Streamline<>& tck, SetVoxel& voxels) const
 {
   Eigen::Vector3i vox;
@@ -62,6 +62,7 @@ namespace MR {
                 scanner2voxel (Transform(template_image).scanner2voxel.cast<float>()),
                 map_zero      (false),
                 precise       (false),
+                exact         (false),
                 ends_only     (false),
                 upsampler     (1) { }
 
@@ -71,6 +72,7 @@ namespace MR {
                 scanner2voxel (Transform(template_image).scanner2voxel.cast<float>()),
                 map_zero      (false),
                 precise       (false),
+                exact         (false),
                 ends_only     (false),
                 dixel_plugin  (new DixelMappingPlugin (dirs)),
                 upsampler     (1) { }
@@ -87,11 +89,28 @@ namespace MR {
             void set_use_precise_mapping (const bool i) {
               if (i && ends_only)
                 throw Exception ("Cannot do precise mapping and endpoint mapping together");
+              if (i && exact)
+                throw Exception ("Cannot do precise mapping and exact mapping together");
               precise = i;
             }
+            void set_use_exact_mapping (const bool i) {
+              if (i && ends_only)
+                throw Exception ("Cannot do exact mapping and endpoint mapping together");
+              if (i && precise)
+                throw Exception ("Cannot do precise mapping and exact mapping together");
+              exact = i;
+            }
+            //! use precise mapping, or exact mapping if set in the config file
+            /*! For commands that quantify the length of streamlines within
+             * each voxel or fixel (SIFT, tck2fixel, fixel-fixel connectivity
+             * and afdconnectivity); see the TrackMappingExact config file
+             * option. */
+            void set_use_precise_or_exact_mapping ();
             void set_map_ends_only (const bool i) {
               if (i && precise)
                 throw Exception ("Cannot do precise mapping and endpoint mapping together");
+              if (i && exact)
+                throw Exception ("Cannot do exact mapping and endpoint mapping together");
               ends_only = i;
             }
 
@@ -117,6 +136,11 @@ namespace MR {
                 if (in.empty())
                   return true;
                 if (preprocess (in, out) || map_zero) {
+                  if (exact) {
+                    voxelise_exact (in, out);
+                    postprocess (in, out);
+                    return true;
+                  }
                   Streamline<> temp;
                   upsampler (in, temp);
                   if (precise)
@@ -137,6 +161,7 @@ namespace MR {
             const Eigen::Transform<float,3,Eigen::AffineCompact> scanner2voxel;
             bool map_zero;
             bool precise;
+            bool exact;
             bool ends_only;
 
             std::shared_ptr<DixelMappingPlugin> dixel_plugin;
@@ -150,16 +175,20 @@ namespace MR {
             //   streamline tangent, and forces normalisation of the contribution from
             //   each streamline to each voxel it traverses
             // Third version is the 'precise' mapping as described in the SIFT paper
-            // Fourth method only maps the streamline endpoints
+            // Fourth version gives the exact length of the streamline within each voxel,
+            //   treating it as a polyline: each segment between successive vertices is
+            //   traversed voxel-by-voxel (Amanatides & Woo, 1987), so no upsampling is needed
+            // Fifth method only maps the streamline endpoints
             void voxelise (const Streamline<>&, SetVoxel&) const;
             template <class Cont> void voxelise         (const Streamline<>&, Cont&) const;
             template <class Cont> void voxelise_precise (const Streamline<>&, Cont&) const;
+            template <class Cont> void voxelise_exact   (const Streamline<>&, Cont&) const;
             template <class Cont> void voxelise_ends    (const Streamline<>&, Cont&) const;
 
             virtual bool preprocess  (const Streamline<>& tck, SetVoxelExtras& out) const { out.factor = 1.0; return true; }
             virtual void postprocess (const Streamline<>& tck, SetVoxelExtras& out) const { }
 
-            // Used by voxelise() and voxelise_precise() to increment the relevant set
+            // Used by voxelise(), voxelise_precise() and voxelise_exact() to increment the relevant set
             inline void add_to_set (SetVoxel&   , const Eigen::Vector3i&, const Eigen::Vector3d&, const default_type) const;
             inline void add_to_set (SetVoxelDEC&, const Eigen::Vector3i&, const Eigen::Vector3d&, const default_type) const;
             inline void add_to_set (SetVoxelDir&, const Eigen::Vector3i&, const Eigen::Vector3d&, const default_type) const;
@@ -292,6 +321,81 @@ namespace MR {
 
 
 
+        template <class Cont>
+          void TrackMapperBase::voxelise_exact (const Streamline<>& tck, Cont& out) const
+          {
+
+            using point_type = Streamline<>::point_type;
+
+            if (tck.size() < 2)
+              return;
+
+            // The voxel currently being traversed, the point at which the streamline entered it,
+            //   and the length of streamline within it so far; these carry over between segments
+            Eigen::Vector3i this_voxel = round (scanner2voxel * tck.front());
+            point_type p_voxel_entry = tck.front();
+            default_type length = 0.0;
+
+            auto exit_voxel = [&] (const point_type& p_voxel_exit) {
+              if (length > 0.0 && check (this_voxel, info)) {
+                const Eigen::Vector3d traversal_vector = (p_voxel_exit - p_voxel_entry).cast<default_type>().normalized();
+                if (std::isfinite (traversal_vector[0]))
+                  add_to_set (out, this_voxel, traversal_vector, length);
+              }
+              p_voxel_entry = p_voxel_exit;
+              length = 0.0;
+            };
+
+            Eigen::Vector3f start_voxel = scanner2voxel * tck.front();
+            for (size_t p = 1; p != tck.size(); ++p) {
+
+              const point_type& start = tck[p-1];
+              const point_type& end = tck[p];
+              const Eigen::Vector3f end_voxel = scanner2voxel * end;
+              const Eigen::Vector3f delta = end_voxel - start_voxel;
+              const default_type segment_length = (end - start).norm();
+
+              // For each axis: the fraction of the segment at which the next voxel boundary is
+              //   crossed, the fraction of the segment between successive boundaries, and the
+              //   direction of travel; voxel boundaries lie half-way between voxel centres
+              Eigen::Vector3d t_max, t_delta;
+              Eigen::Vector3i step;
+              for (size_t axis = 0; axis != 3; ++axis) {
+                if (delta[axis] > 0.0f) {
+                  step[axis] = 1;
+                  t_delta[axis] = 1.0 / delta[axis];
+                  t_max[axis] = (this_voxel[axis] + 0.5 - start_voxel[axis]) / delta[axis];
+                } else if (delta[axis] < 0.0f) {
+                  step[axis] = -1;
+                  t_delta[axis] = -1.0 / delta[axis];
+                  t_max[axis] = (this_voxel[axis] - 0.5 - start_voxel[axis]) / delta[axis];
+                } else {
+                  step[axis] = 0;
+                  t_delta[axis] = t_max[axis] = std::numeric_limits<default_type>::infinity();
+                }
+              }
+
+              default_type t = 0.0;
+              ssize_t axis;
+              while (t_max.minCoeff (&axis) < 1.0) {
+                const default_type t_cross = std::max (t, t_max[axis]);
+                length += (t_cross - t) * segment_length;
+                exit_voxel (start + Streamline<>::value_type (t_cross) * (end - start));
+                this_voxel[axis] += step[axis];
+                t_max[axis] += t_delta[axis];
+                t = t_cross;
+              }
+              length += (1.0 - t) * segment_length;
+
+              start_voxel = end_voxel;
+            }
+
+            exit_voxel (tck.back());
+
+          }
+
+
+
         template <class Cont>
           void TrackMapperBase::voxelise_ends (const Streamline<>& tck, Cont& out) const
           {
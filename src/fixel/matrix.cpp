@@ -205,7 +205,7 @@ namespace MR
         DWI::Tractography::Mapping::TrackLoader loader (track_file, num_tracks, "computing fixel-fixel connectivity matrix");
         DWI::Tractography::Mapping::TrackMapperBase mapper (index_image);
         mapper.set_upsample_ratio (DWI::Tractography::Mapping::determine_upsample_ratio (index_image, properties, 0.333f));
-        mapper.set_use_precise_mapping (true);
+        mapper.set_use_precise_or_exact_mapping();
         TrackProcessor track_processor (mapper, index_image, directions_image, fixel_mask, angular_threshold);
         init_matrix_type connectivity_matrix (Fixel::get_number_of_fixels (index_image));
         Thread::run_queue (loader,
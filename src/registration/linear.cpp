@@ -177,7 +177,11 @@ namespace MR
       + Option ("init_rotation.search.angles", "rotation angles for the local search in degrees between 0 and 180. "
                                   "(Default: 2,5,10,15,20)")
         + Argument ("angles").type_sequence_float ()
-      + Option ("init_rotation.search.scale", "relative size of the images used for the rotation search. (Default: 0.15)")
+      + Option ("init_rotation.search.scale", "relative size of the images used for the rotation search. "
+                                  "All candidate rotations are first evaluated at half this size, and the best quarter "
+                                  "re-evaluated at this size; of these, the rotation with the lowest mean squared residual "
+                                  "among those whose overlap is at least the mean overlap of the re-evaluated candidates "
+                                  "is selected. (Default: 0.15)")
         + Argument ("scale").type_float (0.0001, 1.0)
       + Option ("init_rotation.search.directions", "number of rotation axis for local search. (Default: 250)")
         + Argument ("num").type_integer (1, 10000)
@@ -192,8 +196,6 @@ namespace MR
         "or to change the cost function optimiser during registration (without the need to repeatedly resize the images). (Default: 1 == no repetition)")
         + Argument ("num or comma separated list").type_sequence_int ()
 
-      // TODO linstage.loop_density
-
       // TODO linstage.robust: Start each stage repetition with the estimated parameters from the previous stage.
       // choose parameter consensus criterion: maximum overlap, min cost
 
@@ -232,7 +234,8 @@ namespace MR
 
       + Option ("rigid_init_rotation", "initialise the rotation "
                                 "Valid choices are: \n"
-                                "search (search for the best rotation using mean squared residuals), \n" // TODO CC
+                                "search (search for the best rotation using mean squared residuals; "
+                                "for 4D images, only the first volume is used), \n" // TODO CC
                                 "moments (rotation based on directions of intensity variance with respect to centre of mass), \n"
                                 "none (default).") // TODO  This can be combined with rigid_init_translation.
         + Argument ("type").type_choice (initialisation_rotation_choices)
@@ -263,8 +266,13 @@ namespace MR
                                   "Default: l2")
         + Argument ("type").type_choice (linear_robust_estimator_choices)
 
-      // + Option ("rigid_loop_density", "density of gradient descent 1 (batch) to 0.0 (max stochastic) (Default: 1.0)")
-      //   + Argument ("num").type_sequence_float () // TODO
+      + Option ("rigid_loop_density", "the fraction of voxels used to evaluate the cost function and its gradient, "
+                                     "in the range (0.0, 1.0]. This can be specified either as a single number for all "
+                                     "multi-resolution levels, or a single value for each level. A different random subset "
+                                     "of voxels is used for each stage iteration (see -linstage.iterations). If less than 1.0 "
+                                     "at the final level, the registration is refined with an additional gradient descent "
+                                     "run using all voxels. (Default: 1.0)")
+        + Argument ("num").type_sequence_float ()
 
       // + Option ("rigid_repetitions", " ")
       //   + Argument ("num").type_sequence_int () // TODO
@@ -299,7 +307,8 @@ namespace MR
 
       + Option ("affine_init_rotation", "initialise the rotation "
                                 "Valid choices are: \n"
-                                "search (search for the best rotation using mean squared residuals), \n"
+                                "search (search for the best rotation using mean squared residuals; "
+                                "for 4D images, only the first volume is used), \n"
                                 "moments (rotation based on directions of intensity variance with respect to centre of mass), \n"
                                 "none (Default: none).") // TODO  This can be combined with affine_init_translation.
         + Argument ("type").type_choice (initialisation_rotation_choices)
@@ -331,8 +340,13 @@ namespace MR
                                   "Default: l2")
         + Argument ("type").type_choice (linear_robust_estimator_choices)
 
-      // + Option ("affine_loop_density", "density of gradient descent 1 (batch) to 0.0 (max stochastic) (Default: 1.0)")
-      //   + Argument ("num").type_sequence_float () // TODO
+      + Option ("affine_loop_density", "the fraction of voxels used to evaluate the cost function and its gradient, "
+                                     "in the range (0.0, 1.0]. This can be specified either as a single number for all "
+                                     "multi-resolution levels, or a single value for each level. A different random subset "
+                                     "of voxels is used for each stage iteration (see -linstage.iterations). If less than 1.0 "
+                                     "at the final level, the registration is refined with an additional gradient descent "
+                                     "run using all voxels. (Default: 1.0)")
+        + Argument ("num").type_sequence_float ()
 
       // + Option ("affine_repetitions", " ")
       //   + Argument ("num").type_sequence_int () // TODO
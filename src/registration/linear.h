@@ -212,8 +212,8 @@ namespace MR
 
         void set_loop_density (const vector<default_type>& loop_density_){
           for (size_t d = 0; d < loop_density_.size(); ++d)
-            if (loop_density_[d] < 0.0 or loop_density_[d] > 1.0 )
-              throw Exception ("loop density must be between 0.0 and 1.0");
+            if (loop_density_[d] <= 0.0 or loop_density_[d] > 1.0 )
+              throw Exception ("loop density must be greater than 0.0 and at most 1.0");
           if (loop_density_.size() == stages.size()) {
             for (size_t i = 0; i < stages.size (); ++i)
               stages[i].loop_density = loop_density_[i];
@@ -221,7 +221,7 @@ namespace MR
             for (size_t i = 0; i < stages.size (); ++i)
               stages[i].loop_density = loop_density_[0];
           } else
-            throw Exception ("the lmax must be defined for all stages (1 or " + str(stages.size())+")");
+            throw Exception ("the loop density must be defined for all stages (1 or " + str(stages.size())+")");
         }
 
         void set_diagnostics_image_prefix (const std::basic_string<char>& diagnostics_image_prefix) {
@@ -266,6 +266,11 @@ namespace MR
           log_stream = stream;
         }
 
+        // reuse the smoothed image2 across registrations against the same image2
+        void set_im2_cache (std::shared_ptr<MultiResolutionCache> cache) {
+          im2_cache = cache;
+        }
+
         ssize_t get_lmax () {
           ssize_t lmax=0;
           for (auto& s : stages)
@@ -419,7 +424,9 @@ namespace MR
               INFO ("smoothing image 1");
               auto im1_smoothed = Registration::multi_resolution_lmax (im1_image, stage.scale_factor, do_reorientation, stage_contrasts);
               INFO ("smoothing image 2");
-              auto im2_smoothed = Registration::multi_resolution_lmax (im2_image, stage.scale_factor, do_reorientation, stage_contrasts, &stage_contrasts);
+              auto im2_smoothed = im2_cache ?
+                  im2_cache->get<Im2ImageType> (im2_image, stage.scale_factor, do_reorientation, stage_contrasts, &stage_contrasts) :
+                  Registration::multi_resolution_lmax (im2_image, stage.scale_factor, do_reorientation, stage_contrasts, &stage_contrasts);
 
               DEBUG ("after downsampling:");
               for (const auto & mc : stage_contrasts)
@@ -504,15 +511,32 @@ namespace MR
               if (do_reorientation && stage.fod_lmax > 0)
                 evaluate.set_directions (aPSF_directions);
 
+              // if the metric is evaluated over a subset of voxels in the final
+              // stage, finish with an additional run using all voxels:
+              const bool full_density_refinement = istage + 1 == stages.size() && stage.loop_density < 1.0;
+
               INFO ("registration stage running...");
-              for (auto stage_iter = 1U; stage_iter <= stage.stage_iterations; ++stage_iter) {
-                if (stage.gd_max_iter > 0 and stage.optimisers[stage_iter - 1] == OptimiserAlgoType::bbgd) {
+              default_type last_step = 1.0;
+              for (auto stage_iter = 1U; stage_iter <= stage.stage_iterations + full_density_refinement; ++stage_iter) {
+                const OptimiserAlgoType optimiser = stage.optimisers[std::min<size_t> (stage_iter, stage.stage_iterations) - 1];
+                if (stage_iter <= stage.stage_iterations) {
+                  evaluate.resample();
+                } else {
+                  INFO ("    refining using all voxels");
+                  evaluate.set_loop_density (1.0);
+                  // continue from the step size of the previous run, rather than
+                  // starting over with steps up to the coherence length:
+                  if (last_step > 0.0)
+                    evaluate.set_initial_step (last_step);
+                }
+                if (stage.gd_max_iter > 0 and optimiser == OptimiserAlgoType::bbgd) {
                   Math::GradientDescentBB<Metric::Evaluate<MetricType, ParamType>, typename TransformType::UpdateType>
                   optim (evaluate, *transform.get_gradient_descent_updator());
                   optim.be_verbose (analyse_descent);
                   optim.precondition (optimiser_weights);
                   optim.run (stage.gd_max_iter, grad_tolerance, analyse_descent ? std::cout.rdbuf() : log_stream);
                   parameters.optimiser_update (optim, evaluate.overlap());
+                  last_step = optim.step_size() * optim.gradient_norm();
                   INFO ("    iteration: "+str(stage_iter)+"/"+str(stage.stage_iterations)+" GD iterations: "+
                   str(optim.function_evaluations())+" cost: "+str(optim.value())+" overlap: "+str(evaluate.overlap()));
                 } else if (stage.gd_max_iter > 0) {
@@ -522,6 +546,7 @@ namespace MR
                   optim.precondition (optimiser_weights);
                   optim.run (stage.gd_max_iter, grad_tolerance, analyse_descent ? std::cout.rdbuf() : log_stream);
                   parameters.optimiser_update (optim, evaluate.overlap());
+                  last_step = optim.step_size() * optim.gradient_norm();
                   INFO ("    iteration: "+str(stage_iter)+"/"+str(stage.stage_iterations)+" GD iterations: "+
                   str(optim.function_evaluations())+" cost: "+str(optim.value())+" overlap: "+str(evaluate.overlap()));
                 }
@@ -534,7 +559,7 @@ namespace MR
                 // auto params = optim.state();
                 // VAR(optim.function_evaluations());
                 // Math::check_function_gradient (evaluate, params, 0.0001, true, optimiser_weights);
-                if (stage.diagnostics_images.size()) {
+                if (stage.diagnostics_images.size() && stage_iter <= stage.stage_iterations) {
                   CONSOLE("    creating diagnostics image: " + stage.diagnostics_images[stage_iter - 1]);
                   parameters.make_diagnostics_image (stage.diagnostics_images[stage_iter - 1], File::Config::get_bool ("RegLinregDiagnosticsImageMasked", false));
                 }
@@ -580,6 +605,7 @@ namespace MR
         default_type grad_tolerance;
         default_type step_tolerance;
         std::streambuf* log_stream;
+        std::shared_ptr<MultiResolutionCache> im2_cache;
         Transform::Init::InitType init_translation_type, init_rotation_type;
         bool robust_estimate;
         bool do_reorientation;
@@ -19,9 +19,9 @@
 #define __registration_metric_cc_helper_h__
 
 #include "debug.h"
+#include "progressbar.h"
 #include "math/math.h"
 #include "image_helpers.h"
-#include "algo/neighbourhooditerator.h"
 
 namespace MR
 {
@@ -30,6 +30,145 @@ namespace MR
     namespace Metric
     {
 
+      using cc_sums_type = Eigen::Array<default_type, 6, 1>;
+
+      namespace {
+        using cc_line_type = Eigen::Array<default_type, 6, Eigen::Dynamic>;
+
+        // replace each of the n columns of data at offset, offset+stride, ... with
+        // the sum over the window [i-radius, i+radius], truncated at either end.
+        // The running sum is recomputed from scratch once per window length, to
+        // keep the accumulation of rounding errors local.
+        inline void cc_box_sum (cc_line_type& data, cc_line_type& line, const ssize_t offset, const ssize_t stride, const ssize_t n, const ssize_t radius)
+        {
+          line.resize (Eigen::NoChange, n);
+          for (ssize_t i = 0; i < n; ++i)
+            line.col(i) = data.col (offset + i*stride);
+          cc_sums_type sum;
+          for (ssize_t i = 0; i < n; ++i) {
+            if (i % (2*radius+1) == 0) {
+              sum.setZero();
+              for (ssize_t j = std::max (i-radius, ssize_t(0)); j <= std::min (i+radius, n-1); ++j)
+                sum += line.col(j);
+            }
+            else {
+              if (i+radius < n)
+                sum += line.col (i+radius);
+              if (i-radius > 0)
+                sum -= line.col (i-radius-1);
+            }
+            data.col (offset + i*stride) = sum;
+          }
+        }
+      }
+
+
+
+      //! compute the sums required for local cross-correlation over a box neighbourhood
+      /*! For each voxel, this computes the number of valid voxels within the
+       * neighbourhood of size \a extent (truncated at the image boundary),
+       * along with the sums of both intensities, of their squares and of
+       * their product over those voxels. A voxel is valid if it lies within
+       * each mask provided, and neither intensity is NaN.
+       *
+       * The sums are computed as separable running sums along each axis in
+       * turn, holding only as many slices as the extent along the third
+       * axis, so that the cost per voxel does not depend on the size of the
+       * neighbourhood. \a functor (x, y, z, sums) is then invoked for each
+       * voxel in turn, with \a sums holding [ N, S1, S2, S11, S22, S12 ]. */
+      template <class Im1ImageType, class Im2ImageType, class Im1MaskType, class Im2MaskType, class Functor>
+        void cc_local_sums (Im1ImageType im1_image,
+                            Im2ImageType im2_image,
+                            Im1MaskType im1_mask,
+                            Im2MaskType im2_mask,
+                            const vector<size_t>& extent,
+                            Functor&& functor) {
+          const ssize_t nx = im1_image.size(0), ny = im1_image.size(1), nz = im1_image.size(2);
+          const ssize_t rx = (extent[0]-1)/2, ry = (extent[1]-1)/2, rz = (extent[2]-1)/2;
+
+          // 2D neighbourhood sums for the last 2*rz+1 slices:
+          vector<cc_line_type> slices (2*rz+1, cc_line_type (6, nx*ny));
+          cc_line_type sum (cc_line_type::Zero (6, nx*ny)), line;
+
+          auto load_slice = [&] (const ssize_t z, cc_line_type& slice) {
+            im1_image.index(2) = im2_image.index(2) = z;
+            for (im1_image.index(1) = 0; im1_image.index(1) < ny; ++im1_image.index(1)) {
+              im2_image.index(1) = im1_image.index(1);
+              for (im1_image.index(0) = 0; im1_image.index(0) < nx; ++im1_image.index(0)) {
+                im2_image.index(0) = im1_image.index(0);
+                auto voxel = slice.col (im1_image.index(0) + nx*im1_image.index(1));
+                voxel.setZero();
+                if (im1_mask.valid()) {
+                  assign_pos_of (im1_image, 0, 3).to (im1_mask);
+                  if (!im1_mask.value())
+                    continue;
+                }
+                if (im2_mask.valid()) {
+                  assign_pos_of (im1_image, 0, 3).to (im2_mask);
+                  if (!im2_mask.value())
+                    continue;
+                }
+                const default_type v1 = im1_image.value();
+                const default_type v2 = im2_image.value();
+                if (std::isnan (v1) || std::isnan (v2))
+                  continue;
+                voxel << 1.0, v1, v2, v1*v1, v2*v2, v1*v2;
+              }
+            }
+            for (ssize_t y = 0; y < ny; ++y)
+              cc_box_sum (slice, line, y*nx, 1, nx, rx);
+            for (ssize_t x = 0; x < nx; ++x)
+              cc_box_sum (slice, line, x, nx, ny, ry);
+          };
+
+          // slide the window along the third axis, with slice z held in slices[z % (2*rz+1)]:
+          const ssize_t num_slices = 2*rz+1;
+          for (ssize_t z_in = 0; z_in < nz + rz; ++z_in) {
+            auto& slice = slices[z_in % num_slices];
+            if (z_in >= num_slices)
+              sum -= slice;
+            if (z_in < nz) {
+              load_slice (z_in, slice);
+              sum += slice;
+            }
+            const ssize_t z = z_in - rz;
+            if (z < 0)
+              continue;
+            if (z % num_slices == 0) {
+              sum.setZero();
+              for (ssize_t n = std::max (z-rz, ssize_t(0)); n <= std::min (z+rz, nz-1); ++n)
+                sum += slices[n % num_slices];
+            }
+            for (ssize_t y = 0; y < ny; ++y)
+              for (ssize_t x = 0; x < nx; ++x)
+                functor (x, y, z, cc_sums_type (sum.col (x + nx*y)));
+          }
+        }
+
+
+
+      //! the local means and centred cross-products from the sums computed by cc_local_sums()
+      /*! returns [ m1, m2, A, B, C ], with A = sum((I1-m1)*(I2-m2)), B = sum((I1-m1)^2)
+       * and C = sum((I2-m2)^2). Variances that only reflect rounding errors are
+       * set to zero. */
+      inline Eigen::Matrix<default_type, 5, 1> cc_statistics (const cc_sums_type& sums)
+      {
+        const default_type n = sums[0], m1 = sums[1] / n, m2 = sums[2] / n;
+        default_type A = sums[5] - m2 * sums[1];
+        default_type B = sums[3] - m1 * sums[1];
+        default_type C = sums[4] - m2 * sums[2];
+        constexpr default_type tolerance = 1.0e-12;
+        if (B <= tolerance * sums[3])
+          B = 0.0;
+        if (C <= tolerance * sums[4])
+          C = 0.0;
+        if (B == 0.0 || C == 0.0)
+          A = 0.0;
+        return (Eigen::Matrix<default_type, 5, 1>() << m1, m2, A, B, C).finished();
+      }
+
+
+
       template <class Im1ImageType, class Im2ImageType, class Im1MaskType, class Im2MaskType, class DerivedImageType>
         void cc_precompute (Im1ImageType& im1_image,
                             Im2ImageType& im2_image,
@@ -42,74 +181,36 @@ namespace MR
                             DerivedImageType& im2_meansubtr,
                             const vector<size_t>& extent) {
           // TODO check extent
-          int nmax = extent[0] * extent[1] * extent[2];
-          Eigen::VectorXd n1 = Eigen::VectorXd(nmax);
-          Eigen::VectorXd n2 = Eigen::VectorXd(nmax);
-          Eigen::Vector3d pos;
-          for (auto l = Loop("precomputing cross correlation values") (im1_image); l; ++l) {
-            pos[0] = im1_image.index(0);
-            pos[1] = im1_image.index(1);
-            pos[2] = im1_image.index(2);
-            assign_pos_of(im1_image, 0, 3).to(A, B, C, im1_meansubtr, im2_meansubtr);
-            default_type m1(0.0);
-            default_type m2(0.0);
-
-            n1.setZero();
-            n2.setZero();
-
-            int nvox(0);
-            auto niter = NeighbourhoodIterator(im1_image, extent);
-            while (niter.loop()) {
-              if (im1_mask.valid()) {
-                assign_pos_of(niter, 0, 3).to(im1_mask);
-                if (!im1_mask.value())
-                  continue;
-              }
-              if (im2_mask.valid()) {
-                assign_pos_of(niter, 0, 3).to(im2_mask);
-                if (!im2_mask.value())
-                  continue;
-              }
-              assign_pos_of(niter, 0, 3).to(im1_image);
-              assign_pos_of(niter, 0, 3).to(im2_image);
-
-              n1[nvox] = im1_image.value();
-              n2[nvox] = im2_image.value();
-
-              m1 += n1[nvox];
-              m2 += n2[nvox];
-              nvox++;
-            }
-
-            if (nvox == 0) {
-              A.value() = NaN;
-              C.value() = NaN;
-              B.value() = NaN;
-              im1_meansubtr.value() = NaN;
-              im2_meansubtr.value() = NaN;
-              continue;
-            }
-
-            // local mean subtracted
-            n1.array() -= n1.sum() / nvox;
-            n2.array() -= n2.sum() / nvox;
-            A.value() = n1.adjoint() * n2;
-            B.value() = n1.adjoint() * n1;
-            C.value() = n2.adjoint() * n2;
-
-            // reset image positions
-            im1_image.index(0) = pos[0];
-            im1_image.index(1) = pos[1];
-            im1_image.index(2) = pos[2];
-
-            im2_image.index(0) = pos[0];
-            im2_image.index(1) = pos[1];
-            im2_image.index(2) = pos[2];
-
-            im1_meansubtr.value() = im1_image.value() - m1 / nvox;
-            im2_meansubtr.value() = im2_image.value() - m2 / nvox;
-          }
-
+          ProgressBar progress ("precomputing cross correlation values", im1_image.size(2));
+          cc_local_sums (im1_image, im2_image, im1_mask, im2_mask, extent,
+              [&] (const ssize_t x, const ssize_t y, const ssize_t z, const cc_sums_type& sums) {
+                for (auto* image : { &A, &B, &C, &im1_meansubtr, &im2_meansubtr }) {
+                  image->index(0) = x;
+                  image->index(1) = y;
+                  image->index(2) = z;
+                }
+                if (sums[0] == 0.0) {
+                  A.value() = NaN;
+                  C.value() = NaN;
+                  B.value() = NaN;
+                  im1_meansubtr.value() = NaN;
+                  im2_meansubtr.value() = NaN;
+                }
+                else {
+                  const auto stats = cc_statistics (sums);
+                  A.value() = stats[2];
+                  B.value() = stats[3];
+                  C.value() = stats[4];
+
+                  im1_image.index(0) = im2_image.index(0) = x;
+                  im1_image.index(1) = im2_image.index(1) = y;
+                  im1_image.index(2) = im2_image.index(2) = z;
+                  im1_meansubtr.value() = im1_image.value() - stats[0];
+                  im2_meansubtr.value() = im2_image.value() - stats[1];
+                }
+                if (x == 0 && y == 0)
+                  ++progress;
+              });
         }
 
     }
@@ -67,13 +67,14 @@ namespace MR
             im2_mask = mask;
           }
 
+          template <class UpdateFieldType>
           void operator() (const Im1ImageType& im1_meansubtracted,
                            const Im2ImageType& im2_meansubtracted,
                            const Im2ImageType& A,
                            const Im2ImageType& B,
                            const Im2ImageType& C,
-                           Image<default_type>& im1_update,
-                           Image<default_type>& im2_update) {
+                           UpdateFieldType& im1_update,
+                           UpdateFieldType& im2_update) {
 
             if (im1_meansubtracted.index(0) == 0 || im1_meansubtracted.index(0) == im1_meansubtracted.size(0) - 1 ||
                 im1_meansubtracted.index(1) == 0 || im1_meansubtracted.index(1) == im1_meansubtracted.size(1) - 1 ||
@@ -129,8 +130,8 @@ namespace MR
             default_type i2 = im2_meansubtracted.value();
 
             // Avants eq. 6 and 7
-            Eigen::Matrix<typename Im1ImageType::value_type, 3, 1> grad =  2.0 * sfm / (sff * smm) * (
-              (i2 - sfm / smm * i1 ) * im1_gradient.value() - (i1 - sfm / sff * i2 ) * im2_gradient.value());
+            Eigen::Vector3d grad =  2.0 * sfm / (sff * smm) * (
+              (i2 - sfm / smm * i1 ) * im1_gradient.value().template cast<default_type>() - (i1 - sfm / sff * i2 ) * im2_gradient.value().template cast<default_type>());
             // TODO: add det(jacobian(Phi)))
 
             im1_update.row(3) = grad * 40.0; // TODO: normalise the update?
@@ -21,6 +21,7 @@
 #include "algo/threaded_loop.h"
 #include "algo/loop.h"
 #include "registration/transform/reorient.h"
+#include "math/rng.h"
 #include "image.h"
 
 namespace MR
@@ -72,7 +73,9 @@ namespace MR
             Evaluate (const MetricType& metric_, ParamType& parameters, typename metric_requires_initialisation<U>::yes = 0) :
               metric (metric_),
               params (parameters),
-              iteration (1) {
+              iteration (1),
+              initial_step (1.0) {
+                resample();
                 // update number of volumes
                 metric.init (parameters.im1_image, parameters.im2_image);
                 metric.set_weights(params.get_weights());
@@ -82,7 +85,11 @@ namespace MR
             Evaluate (const MetricType& metric_, ParamType& parameters, typename metric_requires_initialisation<U>::no = 0) :
               metric (metric_),
               params (parameters),
-              iteration (1) { metric.set_weights(params.get_weights()); }
+              iteration (1),
+              initial_step (1.0) {
+                resample();
+                metric.set_weights(params.get_weights());
+            }
 
             //  metric_requires_precompute<U>::yes: operator() loops over processed_image instead of midway_image
             template <class U = MetricType>
@@ -199,15 +206,10 @@ namespace MR
               // estimate (params.transformation, metric, params, overall_cost_function, gradient, x, &overlap_count);
               if (params.loop_density < 1.0) {
                 DEBUG ("stochastic gradient descent, density: " + str(params.loop_density));
-                Math::RNG rng;
-                gradient.setZero();
-                auto loop = ThreadedLoop (params.midway_image, 0, 3, 2);
                 overlap_count = 0;
-                StochasticThreadKernel <MetricType, ParamType> functor (loop.inner_axes, params.loop_density, metric, params, overall_cost_function, gradient, rng, &overlap_count);
-                {
-                  LogLevelLatch log_level (0);
-                  loop.run_outer (functor);
-                }
+                StochasticThreadKernel <MetricType, ParamType> kernel (params.loop_density, sample_seed, metric, params, overall_cost_function, gradient, &overlap_count);
+                LogLevelLatch log_level (0);
+                ThreadedLoop (params.midway_image, 0, 3).run (kernel);
               } else {
                 overlap_count = 0;
                 ThreadKernel <MetricType, ParamType> kernel (metric, params, overall_cost_function, gradient, &overlap_count);
@@ -244,13 +246,30 @@ namespace MR
 
             default_type init (Eigen::VectorXd& x) {
               params.transformation.get_parameter_vector(x);
-              return 1.0;
+              return initial_step;
             }
 
             void set_directions (const Eigen::MatrixXd& dir) {
               directions = dir;
             }
 
+            //! set the fraction of voxels used to evaluate the metric
+            void set_loop_density (default_type density) {
+              params.loop_density = density;
+            }
+
+            //! set the length of the first step of the optimiser (default: 1)
+            void set_initial_step (default_type step) {
+              initial_step = step;
+            }
+
+            //! draw a new random subset of voxels for subsequent evaluations
+            /*! the subset is kept fixed until this is called again, so that
+             * the cost function is consistent within each optimiser run. */
+            void resample () {
+              sample_seed = (uint64_t (Math::RNG::get_seed()) << 32) ^ Math::RNG::get_seed();
+            }
+
           protected:
             MetricType metric;
             ParamType params;
@@ -258,6 +277,8 @@ namespace MR
             size_t iteration;
             Eigen::MatrixXd directions;
             ssize_t overlap_count;
+            uint64_t sample_seed;
+            default_type initial_step;
 
       };
     }
@@ -22,7 +22,7 @@
 #include "algo/threaded_loop.h"
 #include "adapter/reslice.h"
 #include "filter/reslice.h"
-#include "algo/neighbourhooditerator.h"
+#include "registration/metric/cc_helper.h"
 
 namespace MR
 {
@@ -30,99 +30,6 @@ namespace MR
   {
     namespace Metric
     {
-      template <typename ImageType1, typename ImageType2>
-      struct LCCPrecomputeFunctorMasked_Naive { MEMALIGN(LCCPrecomputeFunctorMasked_Naive<ImageType1,ImageType2>)
-        template <typename MaskType, typename ImageType3>
-        void operator() (MaskType& mask, ImageType3& out) {
-          if (!mask.value())
-            return;
-          Eigen::Vector3d pos (mask.index(0), mask.index(1), mask.index(2));
-          out.index(0) = pos[0];
-          out.index(1) = pos[1];
-          out.index(2) = pos[2];
-          out.index(3) = 0;
-
-          int nmax = extent[0] * extent[1] * extent[2];
-          Eigen::VectorXd n1 = Eigen::VectorXd(nmax);
-          Eigen::VectorXd n2 = Eigen::VectorXd(nmax);
-
-          using value_type = typename ImageType3::value_type;
-          in1.index(0) = pos[0];
-          in1.index(1) = pos[1];
-          in1.index(2) = pos[2];
-          value_type value_in1 =  in1.value();
-          if (value_in1 != value_in1){ // nan in image 1, update mask
-            mask.value() = false;
-            out.row(3) = 0.0;
-            return;
-          }
-          in2.index(0) = pos[0];
-          in2.index(1) = pos[1];
-          in2.index(2) = pos[2];
-          value_type value_in2 = in2.value();
-          if (value_in2 != value_in2){ // nan in image 2, update mask
-            mask.value() = false;
-            out.row(3) = 0.0;
-            return;
-          }
-
-          n1.setZero();
-          n2.setZero();
-          auto niter = NeighbourhoodIterator(mask, extent);
-          size_t cnt = 0;
-          while(niter.loop()) {
-            mask.index(0) = niter.index(0);
-            mask.index(1) = niter.index(1);
-            mask.index(2) = niter.index(2);
-            if (!mask.value())
-              continue;
-            in1.index(0) = niter.index(0);
-            in1.index(1) = niter.index(1);
-            in1.index(2) = niter.index(2);
-            value_type val1 = in1.value();
-            if (val1 != val1){
-              continue;
-            }
-            in2.index(0) = niter.index(0);
-            in2.index(1) = niter.index(1);
-            in2.index(2) = niter.index(2);
-            value_type val2 = in2.value();
-            if (val2 != val2){
-              continue;
-            }
-
-            n1[cnt] = in1.value();
-            n2[cnt] = in2.value();
-
-            cnt++;
-          }
-          // reset the mask index
-          mask.index(0) = out.index(0);
-          mask.index(1) = out.index(1);
-          mask.index(2) = out.index(2);
-
-          if (cnt <= 0)
-            throw Exception ("FIXME: neighbourhood does not contain centre");
-
-          // local mean subtracted
-          default_type m1 = n1.sum() / cnt;
-          default_type m2 = n2.sum() / cnt;
-          n1.array() -= m1;
-          n2.array() -= m2;
-          out.row(3) = ( Eigen::Matrix<default_type,5,1>() << value_in1 - m1, value_in2 - m2, n1.adjoint() * n2, n1.adjoint() * n1, n2.adjoint() * n2 ).finished();
-        }
-
-        LCCPrecomputeFunctorMasked_Naive (const vector<size_t>& ext, ImageType1& adapter1, ImageType2& adapter2) :
-          extent(ext),
-          in1(adapter1),
-          in2(adapter2) { /* TODO check dimensions and extent */ }
-
-        protected:
-          vector<size_t> extent;
-          ImageType1 in1; // store reslice adapter in functor to avoid iterating over it when mask is false
-          ImageType2 in2; // TODO: cache interpolated values for neighbourhood iteration
-      };
-
       class LocalCrossCorrelation { MEMALIGN(LocalCrossCorrelation)
           private:
             transform_type midway_v2s;
@@ -190,17 +97,46 @@ namespace MR
 
                 const auto extent = parameters.get_extent();
 
-                // TODO unmasked CCPrecomputeFunctor.
-                // ThreadedLoop (cc_image, 0, 3).run (CCPrecomputeFunctor_Bogus(), interp1, interp2, cc_image);
                 // create a mask (all voxels true) if none given.
                 if (!cc_mask.valid()){
                   cc_mask = cc_mask_header.template get_image<bool>();
                   ThreadedLoop (cc_mask).run([](decltype(cc_mask)& m) {m.value()=true;}, cc_mask);
                 }
+
+                // resample both images onto the midway grid once, with NaN outside the mask:
+                auto values1 = Image<default_type>::scratch (cc_mask_header);
+                auto values2 = Image<default_type>::scratch (cc_mask_header);
+                ThreadedLoop (cc_mask).run ([](decltype(cc_mask)& m, decltype(interp1)& in1, decltype(interp2)& in2, Image<default_type>& v1, Image<default_type>& v2) {
+                  v1.value() = m.value() ? default_type (in1.value()) : NaN;
+                  v2.value() = m.value() ? default_type (in2.value()) : NaN;
+                }, cc_mask, interp1, interp2, values1, values2);
+
+                // local means and centred cross-products, masking out voxels where either image is NaN:
+                Image<bool> no_mask;
+                {
+                  ProgressBar progress ("precomputing cross correlation data...", cc_mask.size(2));
+                  cc_local_sums (values1, values2, no_mask, no_mask, extent,
+                      [&] (const ssize_t x, const ssize_t y, const ssize_t z, const cc_sums_type& sums) {
+                        cc_mask.index(0) = values1.index(0) = values2.index(0) = cc_image.index(0) = x;
+                        cc_mask.index(1) = values1.index(1) = values2.index(1) = cc_image.index(1) = y;
+                        cc_mask.index(2) = values1.index(2) = values2.index(2) = cc_image.index(2) = z;
+                        if (x == 0 && y == 0)
+                          ++progress;
+                        if (!cc_mask.value())
+                          return;
+                        cc_image.index(3) = 0;
+                        const default_type value1 = values1.value(), value2 = values2.value();
+                        if (std::isnan (value1) || std::isnan (value2)) { // nan in either image, update mask
+                          cc_mask.value() = false;
+                          cc_image.row(3) = 0.0;
+                          return;
+                        }
+                        const auto stats = cc_statistics (sums);
+                        cc_image.row(3) = ( Eigen::Matrix<default_type,5,1>() << value1 - stats[0], value2 - stats[1], stats[2], stats[3], stats[4] ).finished();
+                      });
+                }
                 parameters.processed_mask = cc_mask;
                 parameters.processed_mask_interp.reset (new ProcessedMaskInterpolatorType (parameters.processed_mask));
-                auto loop = ThreadedLoop ("precomputing cross correlation data...", parameters.processed_mask);
-                loop.run (LCCPrecomputeFunctorMasked_Naive<decltype(interp1), decltype(interp2)>(extent, interp1, interp2), parameters.processed_mask, cc_image);
                 parameters.processed_image = cc_image;
                 parameters.processed_image_interp.reset (new CCInterpType (parameters.processed_image));
                 // display<Image<default_type>>(parameters.processed_image);
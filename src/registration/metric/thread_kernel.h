@@ -327,61 +327,43 @@ namespace MR
             // MR::Transform transform;
       };
 
+      //! evaluate the metric over a pseudo-random subset of the voxels
+      /*! Voxels are selected by hashing their position together with \a seed,
+       * such that approximately a fraction \a density of all voxels is used.
+       * The subset depends only on the seed, so it is the same irrespective of
+       * the number of threads, and for repeated evaluations with the same
+       * seed (as required by the gradient descent step size estimates). */
       template <class MetricType, class ParamType>
-      struct StochasticThreadKernel { MEMALIGN(StochasticThreadKernel)
+      class StochasticThreadKernel { MEMALIGN(StochasticThreadKernel)
         public:
           StochasticThreadKernel (
-              const vector<size_t>& inner_axes,
               const default_type density,
+              const uint64_t seed,
               const MetricType& metric,
               const ParamType& parameters,
               Eigen::VectorXd& overall_cost_function,
-              Eigen::VectorXd& overall_grad,
-              Math::RNG& rng_engine,
-              ssize_t* overlap_count = nullptr) :
-            inner_axes (inner_axes),
-            density (density),
-            metric (metric),
-            params (parameters),
-            cost_function (overall_cost_function.size()),
-            gradient (overall_grad.size()),
-            overall_cost_function (overall_cost_function),
-            overall_gradient (overall_grad),
-            rng (rng_engine),
-            overlap_count (overlap_count)  {
-              gradient.setZero();
-              cost_function.setZero();
-              assert(inner_axes.size() >= 2);
-              assert(overall_cost_function.size() == 1);
-            }
-
-          ~StochasticThreadKernel () {
-            overall_cost_function += cost_function;
-            overall_gradient += gradient;
-          }
+              Eigen::VectorXd& overall_gradient,
+              ssize_t* overall_cnt = nullptr) :
+            threshold (density >= 1.0 ? std::numeric_limits<uint64_t>::max() : uint64_t (std::ldexp (std::max (density, 0.0), 64))),
+            seed (seed),
+            kernel (metric, parameters, overall_cost_function, overall_gradient, overall_cnt) { }
 
           void operator() (const Iterator& iter) {
-            auto engine = std::default_random_engine{static_cast<std::default_random_engine::result_type>(rng.get_seed())};
-            auto kern = ThreadKernel<MetricType, ParamType> (metric, params, cost_function, gradient, overlap_count);
-            Iterator iterator (iter);
-            assign_pos_of(iter).to(iterator);
-            auto inner_loop = Random_loop<Iterator, std::default_random_engine>(iterator, engine, inner_axes[1], (float) iterator.size(inner_axes[1]) * density);
-            for (auto j = inner_loop; j; ++j)
-              for (auto k = Loop (inner_axes[0]) (iterator); k; ++k) {
-                kern (iterator);
-              }
+            if (hash (iter) < threshold)
+              kernel (iter);
           }
+
         protected:
-          vector<size_t> inner_axes;
-          default_type density;
-          MetricType metric;
-          ParamType params;
-          Eigen::VectorXd cost_function;
-          Eigen::VectorXd gradient;
-          Eigen::VectorXd& overall_cost_function;
-          Eigen::VectorXd& overall_gradient;
-          Math::RNG rng;
-          ssize_t* overlap_count;
+          const uint64_t threshold, seed;
+          ThreadKernel<MetricType, ParamType> kernel;
+
+          // SplitMix64 finaliser applied to the seeded voxel position:
+          uint64_t hash (const Iterator& iter) const {
+            uint64_t x = seed ^ (uint64_t (iter.index(0)) | (uint64_t (iter.index(1)) << 21) | (uint64_t (iter.index(2)) << 42));
+            x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+            return x ^ (x >> 31);
+          }
       };
     }
   }
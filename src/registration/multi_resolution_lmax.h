@@ -17,6 +17,9 @@
 #ifndef __registration_multi_resolution_lmax_h__
 #define __registration_multi_resolution_lmax_h__
 
+#include <map>
+
+#include "image.h"
 #include "adapter/subset.h"
 #include "adapter/extract.h"
 #include "filter/smooth.h"
@@ -54,14 +57,10 @@ namespace MR
       return smoothed;
     }
 
-    // crop and resize images as defined in contrast: contrast[tissue].start is relative to input,
-    // contrast_updated[tissue].start is relative to cropped image. contrast and contrast_updated can be identical
-    template <class ImageType>
-    FORCE_INLINE ImageType multi_resolution_lmax (ImageType& input,
-                                                  const default_type scale_factor,
-                                                  const bool do_reorientation,
-                                                  const vector<MultiContrastSetting>& contrast,
-                                                  vector<MultiContrastSetting>* contrast_updated = nullptr)
+    // volumes of the input retained for the contrasts in contrast. If supplied, contrast_updated[tissue].start
+    // is set relative to the retained volumes. contrast and contrast_updated can be identical.
+    inline vector<uint32_t> contrast_volume_indices (const vector<MultiContrastSetting>& contrast,
+                                                     vector<MultiContrastSetting>* contrast_updated = nullptr)
     {
       vector<uint32_t> volume_indices;
       size_t start = 0;
@@ -75,6 +74,20 @@ namespace MR
           (*contrast_updated)[ic].start = start;
         start += mc.nvols;
       }
+      return volume_indices;
+    }
+
+    // crop and resize images as defined in contrast: contrast[tissue].start is relative to input,
+    // contrast_updated[tissue].start is relative to cropped image. contrast and contrast_updated can be identical.
+    // The smoothed image can optionally be held in a different image type to the input (e.g. in single precision).
+    template <class ImageType, class SmoothedImageType = ImageType>
+    FORCE_INLINE SmoothedImageType multi_resolution_lmax (ImageType& input,
+                                                  const default_type scale_factor,
+                                                  const bool do_reorientation,
+                                                  const vector<MultiContrastSetting>& contrast,
+                                                  vector<MultiContrastSetting>* contrast_updated = nullptr)
+    {
+      const vector<uint32_t> volume_indices = contrast_volume_indices (contrast, contrast_updated);
       Adapter::Extract1D<ImageType> subset (input, 3, volume_indices);
 
       Filter::Smooth smooth_filter (subset);
@@ -84,12 +97,52 @@ namespace MR
 
       smooth_filter.set_stdev (stdev);
       DEBUG ("creating scratch image for smoothing input image...");
-      auto smoothed = ImageType::scratch (smooth_filter);
+      auto smoothed = SmoothedImageType::scratch (smooth_filter);
       threaded_copy (subset, smoothed);
       DEBUG ("smoothing input image based on scale factor...");
       smooth_filter (smoothed);
       return smoothed;
     }
+
+
+
+    //! hold on to the multi-resolution images of a single input image for reuse
+    /*! This is used when the same image (typically the template) is
+     * registered against multiple moving images: each smoothed image is
+     * computed on first request, and subsequent requests for the same scale
+     * factor and volumes return the same (shared, read-only) image. Smoothed
+     * images can be held in double or single precision. */
+    class MultiResolutionCache { NOMEMALIGN
+      public:
+        template <class SmoothedImageType, class ImageType>
+        SmoothedImageType get (ImageType& input,
+                               const default_type scale_factor,
+                               const bool do_reorientation,
+                               const vector<MultiContrastSetting>& contrast,
+                               vector<MultiContrastSetting>* contrast_updated = nullptr)
+        {
+          const Key key (scale_factor, contrast_volume_indices (contrast));
+          auto& cached = entries (static_cast<SmoothedImageType*> (nullptr));
+          auto it = cached.find (key);
+          if (it != cached.end()) {
+            DEBUG ("reusing smoothed image for scale factor " + str(scale_factor));
+            contrast_volume_indices (contrast, contrast_updated);
+            return it->second;
+          }
+          auto smoothed = multi_resolution_lmax<ImageType, SmoothedImageType> (input, scale_factor, do_reorientation, contrast, contrast_updated);
+          cached.insert (std::make_pair (key, smoothed));
+          return smoothed;
+        }
+
+      protected:
+        using Key = std::pair<default_type, vector<uint32_t>>;
+        std::map<Key, Image<default_type>> double_entries;
+        std::map<Key, Image<float>> float_entries;
+
+        std::map<Key, Image<default_type>>& entries (Image<default_type>*) { return double_entries; }
+        std::map<Key, Image<float>>& entries (Image<float>*) { return float_entries; }
+    };
+
   }
 }
 #endif
@@ -65,6 +65,11 @@ namespace MR
                            "use lmax 0,2,4 with default scale factors 0.25,0.5,1.0 respectively. Note that no reorientation will be performed with lmax = 0.")
       + Argument ("num").type_sequence_int ()
 
+      + Option ("nl_single_precision", "hold the smoothed and warped images and the update fields used during non-linear registration "
+                                        "in single precision, substantially reducing the memory required for FOD registration at the expense "
+                                        "of numerical precision. The displacement fields are always held in double precision (by default, "
+                                        "double precision is used throughout)")
+
       // + Option("cc", "use cc metric with radius")
       // + Argument ("radius").type_integer (1,100)
 
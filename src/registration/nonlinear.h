@@ -26,6 +26,7 @@
 #include "registration/transform/affine.h"
 #include "registration/warp/compose.h"
 #include "registration/warp/convert.h"
+#include "registration/warp/field_pair.h"
 #include "registration/warp/helpers.h"
 #include "registration/warp/invert.h"
 #include "registration/metric/demons.h"
@@ -59,6 +60,7 @@ namespace MR
           do_reorientation (false),
           fod_lmax (3),
           use_cc (false),
+          single_precision (false),
           diagnostics_image_prefix ("") {
             scale_factor[0] = 0.25;
             scale_factor[1] = 0.5;
@@ -75,6 +77,20 @@ namespace MR
                     Im2ImageType& im2_image,
                     Im1MaskType& im1_mask,
                     Im2MaskType& im2_mask) {
+            if (single_precision)
+              run_with_value_type<float> (linear_transform, im1_image, im2_image, im1_mask, im2_mask);
+            else
+              run_with_value_type<default_type> (linear_transform, im1_image, im2_image, im1_mask, im2_mask);
+          }
+
+
+        // ValueType sets the precision of the smoothed and warped images, and of the update fields
+        template <typename ValueType, class TransformType, class Im1ImageType, class Im2ImageType, class Im1MaskType, class Im2MaskType>
+          void run_with_value_type (TransformType linear_transform,
+                                    Im1ImageType& im1_image,
+                                    Im2ImageType& im2_image,
+                                    Im1MaskType& im1_mask,
+                                    Im2MaskType& im2_mask) {
 
             if (!is_initialised) {
               im1_to_mid_linear = linear_transform.get_transform_half();
@@ -146,8 +162,10 @@ namespace MR
               for (const auto & mc : stage_contrasts)
                 DEBUG (str(mc));
 
-              auto im1_smoothed = Registration::multi_resolution_lmax (im1_image, scale_factor[level], do_reorientation, stage_contrasts);
-              auto im2_smoothed = Registration::multi_resolution_lmax (im2_image, scale_factor[level], do_reorientation, stage_contrasts, &stage_contrasts);
+              auto im1_smoothed = Registration::multi_resolution_lmax<Im1ImageType, Image<ValueType>> (im1_image, scale_factor[level], do_reorientation, stage_contrasts);
+              auto im2_smoothed = im2_cache ?
+                  im2_cache->get<Image<ValueType>> (im2_image, scale_factor[level], do_reorientation, stage_contrasts, &stage_contrasts) :
+                  Registration::multi_resolution_lmax<Im2ImageType, Image<ValueType>> (im2_image, scale_factor[level], do_reorientation, stage_contrasts, &stage_contrasts);
 
               for (const auto & mc : stage_contrasts)
                 INFO (str(mc));
@@ -158,17 +176,17 @@ namespace MR
                 warped_header.ndim() = 4;
                 warped_header.size(3) = im1_smoothed.size(3);
               }
-              auto im1_warped = Image<default_type>::scratch (warped_header);
-              auto im2_warped = Image<default_type>::scratch (warped_header);
+              auto im1_warped = Image<ValueType>::scratch (warped_header);
+              auto im2_warped = Image<ValueType>::scratch (warped_header);
 
-              Image<default_type> im_cca, im_ccc, im_ccb, im_cc1, im_cc2;
+              Image<ValueType> im_cca, im_ccc, im_ccb, im_cc1, im_cc2;
               if (use_cc) {
                 DEBUG ("Initialising CC images");
-                im_cca = Image<default_type>::scratch(warped_header);
-                im_ccb = Image<default_type>::scratch(warped_header);
-                im_ccc = Image<default_type>::scratch(warped_header);
-                im_cc1 = Image<default_type>::scratch(warped_header);
-                im_cc2 = Image<default_type>::scratch(warped_header);
+                im_cca = Image<ValueType>::scratch(warped_header);
+                im_ccb = Image<ValueType>::scratch(warped_header);
+                im_ccc = Image<ValueType>::scratch(warped_header);
+                im_cc1 = Image<ValueType>::scratch(warped_header);
+                im_cc2 = Image<ValueType>::scratch(warped_header);
               }
 
               Header field_header (midway_image_header_resized);
@@ -177,10 +195,11 @@ namespace MR
 
               im1_to_mid_new = make_shared<Image<default_type>>(Image<default_type>::scratch (field_header));
               im2_to_mid_new = make_shared<Image<default_type>>(Image<default_type>::scratch (field_header));
-              im1_update = make_shared<Image<default_type>>(Image<default_type>::scratch (field_header));
-              im2_update = make_shared<Image<default_type>>(Image<default_type>::scratch (field_header));
-              im1_update_new = make_shared<Image<default_type>>(Image<default_type>::scratch (field_header));
-              im2_update_new = make_shared<Image<default_type>>(Image<default_type>::scratch (field_header));
+              // the update fields of both images are held in a single buffer, so that they can be smoothed and applied together
+              Warp::FieldPair<ValueType> update (field_header);
+              Warp::FieldPair<ValueType> update_new (field_header);
+              Image<default_type> im1_deform_field = Image<default_type>::scratch (field_header);
+              Image<default_type> im2_deform_field = Image<default_type>::scratch (field_header);
 
               if (!is_initialised) {
                 if (level == 0) {
@@ -208,19 +227,12 @@ namespace MR
               while (!converged) {
                 if (iteration > 1) {
                   DEBUG ("smoothing update fields");
-                  Filter::Smooth smooth_filter (*im1_update);
-                  smooth_filter.set_stdev (update_smoothing_mm);
-                  smooth_filter (*im1_update);
-                  smooth_filter (*im2_update);
-                }
-
-                Image<default_type> im1_deform_field = Image<default_type>::scratch (field_header);
-                Image<default_type> im2_deform_field = Image<default_type>::scratch (field_header);
+                  Filter::Smooth update_smooth_filter (update.both());
+                  update_smooth_filter.set_stdev (update_smoothing_mm);
+                  update_smooth_filter (update.both());
 
-                if (iteration > 1) {
                   DEBUG ("updating displacement field");
-                  Warp::update_displacement_scaling_and_squaring (*im1_to_mid, *im1_update, *im1_to_mid_new, grad_step_altered);
-                  Warp::update_displacement_scaling_and_squaring (*im2_to_mid, *im2_update, *im2_to_mid_new, grad_step_altered);
+                  Warp::update_displacement_scaling_and_squaring (*im1_to_mid, *im2_to_mid, update, *im1_to_mid_new, *im2_to_mid_new, grad_step_altered);
 
                   DEBUG ("smoothing displacement field");
                   Filter::Smooth smooth_filter (*im1_to_mid_new);
@@ -229,11 +241,9 @@ namespace MR
                   smooth_filter (*im1_to_mid_new);
                   smooth_filter (*im2_to_mid_new);
 
-                  Registration::Warp::compose_linear_displacement (im1_to_mid_linear, *im1_to_mid_new, im1_deform_field);
-                  Registration::Warp::compose_linear_displacement (im2_to_mid_linear, *im2_to_mid_new, im2_deform_field);
+                  Registration::Warp::compose_linear_displacement (im1_to_mid_linear, im2_to_mid_linear, *im1_to_mid_new, *im2_to_mid_new, im1_deform_field, im2_deform_field);
                 } else {
-                  Registration::Warp::compose_linear_displacement (im1_to_mid_linear, *im1_to_mid, im1_deform_field);
-                  Registration::Warp::compose_linear_displacement (im2_to_mid_linear, *im2_to_mid, im2_deform_field);
+                  Registration::Warp::compose_linear_displacement (im1_to_mid_linear, im2_to_mid_linear, *im1_to_mid, *im2_to_mid, im1_deform_field, im2_deform_field);
                 }
 
                 DEBUG ("warping input images");
@@ -266,6 +276,8 @@ namespace MR
                 DEBUG ("evaluating metric and computing update field");
                 default_type cost_new = 0.0;
                 size_t voxel_count = 0;
+                auto im1_update_new = update_new[0];
+                auto im2_update_new = update_new[1];
 
                 if (use_cc) {
                   Metric::cc_precompute (im1_warped, im2_warped, im1_mask_warped, im2_mask_warped, im_cca, im_ccb, im_ccc, im_cc1, im_cc2, cc_extent);
@@ -278,23 +290,23 @@ namespace MR
 
                 if (im1_image.ndim() == 4) {
                   assert (!use_cc && "TODO");
-                  Metric::Demons4D<Im1ImageType, Im2ImageType, Im1MaskType, Im2MaskType> metric (
+                  Metric::Demons4D<Image<ValueType>, Image<ValueType>, Im1MaskType, Im2MaskType> metric (
                     cost_new, voxel_count, im1_warped, im2_warped, im1_mask_warped, im2_mask_warped, &stage_contrasts);
-                  ThreadedLoop (im1_warped, 0, 3).run (metric, im1_warped, im2_warped, *im1_update_new, *im2_update_new);
+                  ThreadedLoop (im1_warped, 0, 3).run (metric, im1_warped, im2_warped, im1_update_new, im2_update_new);
                 } else {
                   if (use_cc) {
-                    Metric::DemonsCC<Im1ImageType, Im2ImageType, Im1MaskType, Im2MaskType> metric (
+                    Metric::DemonsCC<Image<ValueType>, Image<ValueType>, Im1MaskType, Im2MaskType> metric (
                       cost_new, voxel_count, im_cc1, im_cc2, im1_mask_warped, im2_mask_warped);
-                    ThreadedLoop (im_cc1, 0, 3).run (metric, im_cc1, im_cc2, im_cca, im_ccb, im_ccc, *im1_update_new, *im2_update_new);
+                    ThreadedLoop (im_cc1, 0, 3).run (metric, im_cc1, im_cc2, im_cca, im_ccb, im_ccc, im1_update_new, im2_update_new);
                   } else {
-                    Metric::Demons<Im1ImageType, Im2ImageType, Im1MaskType, Im2MaskType> metric (
+                    Metric::Demons<Image<ValueType>, Image<ValueType>, Im1MaskType, Im2MaskType> metric (
                       cost_new, voxel_count, im1_warped, im2_warped, im1_mask_warped, im2_mask_warped);
-                    ThreadedLoop (im1_warped, 0, 3).run (metric, im1_warped, im2_warped, *im1_update_new, *im2_update_new);
+                    ThreadedLoop (im1_warped, 0, 3).run (metric, im1_warped, im2_warped, im1_update_new, im2_update_new);
                   }
                 }
 
                 if (App::log_level >= 3)
-                  display<Image<default_type>>(*im1_update_new);
+                  display<Image<ValueType>>(im1_update_new);
 
                 cost_new /= static_cast<default_type>(voxel_count);
 
@@ -305,8 +317,7 @@ namespace MR
                     std::swap (im1_to_mid_new, im1_to_mid);
                     std::swap (im2_to_mid_new, im2_to_mid);
                   }
-                  std::swap (im1_update_new, im1_update);
-                  std::swap (im2_update_new, im2_update);
+                  std::swap (update_new, update);
 
                   DEBUG ("inverting displacement field");
                   {
@@ -522,10 +533,20 @@ namespace MR
             cc_extent = vector<size_t>(3, radius * 2 + 1);
           }
 
+          // hold the smoothed and warped images and the update fields in single precision
+          void set_single_precision (bool single) {
+            single_precision = single;
+          }
+
           void set_diagnostics_image (const std::basic_string<char>& path) {
             diagnostics_image_prefix = path;
           }
 
+          // reuse the smoothed image2 across registrations against the same image2
+          void set_im2_cache (std::shared_ptr<MultiResolutionCache> cache) {
+            im2_cache = cache;
+          }
+
 
         protected:
 
@@ -556,7 +577,9 @@ namespace MR
           bool do_reorientation;
           vector<uint32_t> fod_lmax;
           bool use_cc;
+          bool single_precision;
           std::basic_string<char> diagnostics_image_prefix;
+          std::shared_ptr<MultiResolutionCache> im2_cache;
 
           vector<size_t> cc_extent;
 
@@ -574,11 +597,6 @@ namespace MR
           std::shared_ptr<Image<default_type> > mid_to_im1;
           std::shared_ptr<Image<default_type> > mid_to_im2;
 
-          std::shared_ptr<Image<default_type> > im1_update;
-          std::shared_ptr<Image<default_type> > im2_update;
-          std::shared_ptr<Image<default_type> > im1_update_new;
-          std::shared_ptr<Image<default_type> > im2_update_new;
-
     };
   }
 }
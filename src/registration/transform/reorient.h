@@ -17,6 +17,10 @@
 #ifndef __registration_transform_reorient_h__
 #define __registration_transform_reorient_h__
 
+#include <map>
+#include <mutex>
+#include <tuple>
+
 #include "algo/threaded_loop.h"
 #include "math/SH.h"
 #include "math/least_squares.h"
@@ -40,6 +44,22 @@ namespace MR
         return delta_matrix.transpose();
       }
 
+      //! the mapping from FOD coefficients to aPSF weights along \a directions
+      /*! This only depends on the number of SH coefficients and on the
+       * directions, so is computed once and reused across calls (e.g. for each
+       * iteration of the non-linear registration). */
+      inline Eigen::MatrixXd FOD_to_aPSF_weights_transform (const ssize_t num_SH, const Eigen::MatrixXd& directions)
+      {
+        static std::mutex mutex;
+        static vector<std::tuple<ssize_t, Eigen::MatrixXd, Eigen::MatrixXd>> cache;
+        std::lock_guard<std::mutex> lock (mutex);
+        for (const auto& entry : cache)
+          if (std::get<0> (entry) == num_SH && std::get<1> (entry).cols() == directions.cols() && std::get<1> (entry) == directions)
+            return std::get<2> (entry);
+        cache.emplace_back (num_SH, directions, Math::pinv (aPSF_weights_to_FOD_transform (num_SH, directions)));
+        return std::get<2> (cache.back());
+      }
+
       FORCE_INLINE vector<vector<ssize_t>> multiContrastSetting2start_nvols (const vector<MultiContrastSetting>& mcsettings, size_t& max_n_SH)
       {
         max_n_SH = 0;
@@ -76,11 +96,11 @@ namespace MR
               Eigen::VectorXd modulation_factors = transformed_directions.colwise().norm() / linear_transform.linear().inverse().determinant();
               transformed_directions.colwise().normalize();
               transform.noalias() = aPSF_weights_to_FOD_transform (max_n_SH, transformed_directions) * modulation_factors.asDiagonal()
-                                  * Math::pinv (aPSF_weights_to_FOD_transform (max_n_SH, directions));
+                                  * FOD_to_aPSF_weights_transform (max_n_SH, directions);
             } else {
               transformed_directions.colwise().normalize();
               transform.noalias() = aPSF_weights_to_FOD_transform (max_n_SH, transformed_directions)
-                                  * Math::pinv (aPSF_weights_to_FOD_transform (max_n_SH, directions));
+                                  * FOD_to_aPSF_weights_transform (max_n_SH, directions);
             }
           }
 
@@ -121,11 +141,11 @@ namespace MR
               Eigen::VectorXd modulation_factors = transformed_directions.colwise().norm() / linear_transform.linear().inverse().determinant();
               transformed_directions.colwise().normalize();
               transform.noalias() = aPSF_weights_to_FOD_transform (n_SH, transformed_directions) * modulation_factors.asDiagonal()
-                                  * Math::pinv (aPSF_weights_to_FOD_transform (n_SH, directions));
+                                  * FOD_to_aPSF_weights_transform (n_SH, directions);
             } else {
               transformed_directions.colwise().normalize();
               transform.noalias() = aPSF_weights_to_FOD_transform (n_SH, transformed_directions)
-                                  * Math::pinv (aPSF_weights_to_FOD_transform (n_SH, directions));
+                                  * FOD_to_aPSF_weights_transform (n_SH, directions);
             }
           }
 
@@ -207,132 +227,150 @@ namespace MR
         }
       }
 
+      /*
+      * reorient the FODs in an image according to the local Jacobian of a deformation field.
+      * The image is processed one row of voxels at a time: the voxels that contain an FOD
+      * are gathered first, then the FODs of all such voxels are mapped onto aPSF weights along
+      * each direction using a single matrix-matrix product, before the weights along the
+      * transformed directions are projected back onto the SH basis for each voxel.
+      */
       template <class FODImageType>
-      class NonLinearKernelMultiContrast { MEMALIGN(NonLinearKernelMultiContrast<FODImageType>)
+      class NonLinearKernel { MEMALIGN(NonLinearKernel<FODImageType>)
 
         public:
-          NonLinearKernelMultiContrast (ssize_t n_vol,
-                        ssize_t max_n_SH,
-                        Image<default_type>& warp,
-                        const Eigen::MatrixXd& directions,
-                        const vector<vector<ssize_t>>& vstart_nvols,
-                        const bool modulate) :
-          max_n_SH (max_n_SH), n_dirs (directions.cols()), jacobian_adapter (warp), directions (directions),
-          modulate (modulate), start_nvols (vstart_nvols), fod (n_vol)
+          NonLinearKernel (const FODImageType& fod_image,
+                           Image<default_type>& warp,
+                           const size_t axis,
+                           const Eigen::MatrixXd& directions,
+                           const vector<vector<ssize_t>>& vstart_nvols,
+                           const bool modulate) :
+              fod_image (fod_image),
+              jacobian_adapter (warp),
+              axis (axis),
+              directions (directions),
+              modulate (modulate),
+              start_nvols (vstart_nvols),
+              fod (fod_image.size(3)),
+              fods (fod_image.size(3), fod_image.size(axis)),
+              sh (0),
+              transformed_directions (3, directions.cols()),
+              modulation_factors (Eigen::VectorXd::Ones (directions.cols()))
           {
-            for (auto const & sn : start_nvols)
-              map_FOD_to_aPSF_transform[sn[1]] = Math::pinv (aPSF_weights_to_FOD_transform (sn[1], directions));
-            assert (n_vol > 0);
             assert (start_nvols.size());
+            for (auto const & sn : start_nvols) {
+              if (operators.count (sn[1]))
+                continue;
+              auto& op = operators[sn[1]];
+              op.FOD_to_aPSF = FOD_to_aPSF_weights_transform (sn[1], directions);
+              op.lmax = Math::SH::LforN (sn[1]);
+              Math::SH::aPSF<default_type> aPSF (op.lmax);
+              op.RH.resize (sn[1]);
+              for (ssize_t l = 0; l <= op.lmax; l += 2)
+                for (ssize_t m = -l; m <= l; ++m)
+                  op.RH[Math::SH::index (l, m)] = aPSF.RH_coefs()[l/2];
+              op.aPSF_to_FOD.resize (sn[1], directions.cols());
+            }
           }
 
-          void operator() (FODImageType& image) {
-            // get highest n_SH for compartments that contain a non-zero FOD in this voxel
-            ssize_t max_n_SHvox = 0;
-            for (auto const & sn : start_nvols) {
-              image.index(3) = sn[0];
-              if (image.value() > 0.0) {
-                max_n_SHvox = std::max (max_n_SHvox, sn[1]);
+          void operator() (const Iterator& pos) {
+            assign_pos_of (pos).to (fod_image);
+            for (size_t dim = 0; dim < 3; ++dim)
+              jacobian_adapter.index(dim) = pos.index(dim);
+
+            // gather voxels that contain an FOD, along with the highest n_SH of their non-zero compartments:
+            active.clear();
+            for (auto l = Loop (axis) (fod_image); l; ++l) {
+              ssize_t max_n_SHvox = 0;
+              for (auto const & sn : start_nvols) {
+                fod_image.index(3) = sn[0];
+                if (fod_image.value() > 0.0)
+                  max_n_SHvox = std::max (max_n_SHvox, sn[1]);
               }
+              if (max_n_SHvox)
+                active.push_back ({ fod_image.index(axis), max_n_SHvox });
             }
-            if (max_n_SHvox == 0)
+            if (active.empty())
               return;
 
-            image.index(3) = 0;
-            fod = image.row(3);
-
-            for (size_t dim = 0; dim < 3; ++dim)
-              jacobian_adapter.index(dim) = image.index(dim);
-            Eigen::MatrixXd jacobian = jacobian_adapter.value().inverse().template cast<default_type>();
-            Eigen::MatrixXd transformed_directions = jacobian * directions;
-
-            if (modulate)
-              modulation_factors = transformed_directions.colwise().norm() / jacobian.determinant();
-
-            transformed_directions.colwise().normalize();
-
-            if (modulate) {
-              Eigen::MatrixXd temp = aPSF_weights_to_FOD_transform (max_n_SHvox, transformed_directions);
-              for (ssize_t i = 0; i < n_dirs; ++i)
-                temp.col(i) = temp.col(i) * modulation_factors(0,i);
-
-              transform.noalias() = temp * map_FOD_to_aPSF_transform[max_n_SHvox];
-              // TODO: make this work?
-              // transform.noalias() = (aPSF_weights_to_FOD_transform (max_n_SHvox, transformed_directions).colwise() * modulation_factors.transpose()) * map_FOD_to_aPSF_transform[max_n_SHvox];
-            } else {
-              transform.noalias() = aPSF_weights_to_FOD_transform (max_n_SHvox, transformed_directions) * map_FOD_to_aPSF_transform[max_n_SHvox];
+            // voxels sharing the same n_SH are processed as a block:
+            std::stable_sort (active.begin(), active.end(), [](const Voxel& a, const Voxel& b) { return a.n_SH < b.n_SH; });
+            for (size_t n = 0; n < active.size(); ++n) {
+              fod_image.index(axis) = active[n].index;
+              fod_image.index(3) = 0;
+              fod = fod_image.row(3);
+              fods.col(n) = fod;
             }
 
-            // reorient voxels that contain an FOD
-            for (auto const & sn : start_nvols)
-              if (fod[sn[0]] > 0.0)
-                fod.segment(sn[0],sn[1]) = transform.block(0,0,sn[1],sn[1]) * fod.segment(sn[0],sn[1]);
-
-            image.index(3) = 0; // TODO do we need this?
-            image.row(3) = fod;
-          }
-
-          protected:
-            const ssize_t max_n_SH, n_dirs;
-            Adapter::Jacobian<Image<default_type> > jacobian_adapter;
-            const Eigen::MatrixXd& directions;
-            const bool modulate;
-            const vector<vector<ssize_t>> start_nvols;
-            Eigen::VectorXd fod;
-            std::map<ssize_t, Eigen::MatrixXd> map_FOD_to_aPSF_transform;
-            ssize_t max_n_SHvox;
-            Eigen::MatrixXd transform;
-            Eigen::MatrixXd modulation_factors;
-      };
-
-
-      template <class FODImageType>
-      class NonLinearKernel { MEMALIGN(NonLinearKernel<FODImageType>)
+            for (size_t first = 0; first < active.size();) {
+              const ssize_t n_SH = active[first].n_SH;
+              size_t last = first;
+              while (last < active.size() && active[last].n_SH == n_SH)
+                ++last;
+              auto& op = operators[n_SH];
+
+              // aPSF weights for each compartment and voxel in the block:
+              weights.resize (start_nvols.size());
+              for (size_t c = 0; c < start_nvols.size(); ++c) {
+                const ssize_t start = start_nvols[c][0], nvols = std::min (start_nvols[c][1], n_SH);
+                weights[c].noalias() = op.FOD_to_aPSF.leftCols (nvols) * fods.block (start, first, nvols, last-first);
+              }
 
-        public:
-          NonLinearKernel (const ssize_t n_SH, Image<default_type>& warp, const Eigen::MatrixXd& directions, const bool modulate) :
-                           n_SH (n_SH),
-                           jacobian_adapter (warp),
-                           directions (directions),
-                           modulate (modulate),
-                           FOD_to_aPSF_transform (Math::pinv (aPSF_weights_to_FOD_transform (n_SH, directions))),
-                           fod (n_SH) {}
-
-
-          void operator() (FODImageType& image) {
-            image.index(3) = 0;
-            if (image.value() > 0) {  // only reorient voxels that contain a FOD
-              for (size_t dim = 0; dim < 3; ++dim)
-                jacobian_adapter.index(dim) = image.index(dim);
-              Eigen::MatrixXd jacobian = jacobian_adapter.value().inverse().template cast<default_type>();
-              Eigen::MatrixXd transformed_directions = jacobian * directions;
-
-              if (modulate) {
-                Eigen::MatrixXd modulation_factors = transformed_directions.colwise().norm() / jacobian.determinant();
+              for (size_t n = first; n < last; ++n) {
+                jacobian_adapter.index(axis) = active[n].index;
+                const Eigen::Matrix3d jacobian = jacobian_adapter.value().inverse().template cast<default_type>();
+                transformed_directions.noalias() = jacobian * directions;
+                if (modulate)
+                  modulation_factors = transformed_directions.colwise().norm().transpose() / jacobian.determinant();
                 transformed_directions.colwise().normalize();
 
-                Eigen::MatrixXd temp = aPSF_weights_to_FOD_transform (n_SH, transformed_directions);
-                for (ssize_t i = 0; i < temp.cols(); ++i)
-                  temp.col(i) = temp.col(i) * modulation_factors(0,i);
-
-                transform.noalias() = temp * FOD_to_aPSF_transform;
-              } else {
-                transformed_directions.colwise().normalize();
-                transform.noalias() = aPSF_weights_to_FOD_transform (n_SH, transformed_directions) * FOD_to_aPSF_transform;
+                // aPSF along each transformed direction:
+                for (ssize_t d = 0; d < transformed_directions.cols(); ++d) {
+                  Math::SH::delta (sh, transformed_directions.col(d), op.lmax);
+                  op.aPSF_to_FOD.col(d) = op.RH.cwiseProduct (sh);
+                }
+
+                // reorient compartments that contain an FOD
+                for (size_t c = 0; c < start_nvols.size(); ++c) {
+                  const ssize_t start = start_nvols[c][0], nvols = std::min (start_nvols[c][1], n_SH);
+                  if (fods (start, n) > 0.0)
+                    fods.col(n).segment (start, nvols).noalias() = op.aPSF_to_FOD.topRows (nvols) * weights[c].col(n-first).cwiseProduct (modulation_factors);
+                }
               }
-              fod = image.row(3);
-              fod = transform * fod;
-              image.row(3) = fod;
+              first = last;
+            }
+
+            for (size_t n = 0; n < active.size(); ++n) {
+              fod_image.index(axis) = active[n].index;
+              fod_image.index(3) = 0;
+              fod = fods.col(n);
+              fod_image.row(3) = fod;
             }
           }
-          protected:
-            const ssize_t n_SH;
-            Adapter::Jacobian<Image<default_type> > jacobian_adapter;
-            const Eigen::MatrixXd& directions;
-            const bool modulate;
-            const Eigen::MatrixXd FOD_to_aPSF_transform;
-            Eigen::MatrixXd transform;
-            Eigen::VectorXd fod;
+
+        protected:
+          struct Voxel { NOMEMALIGN
+            ssize_t index, n_SH;
+          };
+          struct Operators { MEMALIGN(Operators)
+            ssize_t lmax;
+            Eigen::MatrixXd FOD_to_aPSF, aPSF_to_FOD;
+            Eigen::VectorXd RH;
+          };
+
+          FODImageType fod_image;
+          Adapter::Jacobian<Image<default_type> > jacobian_adapter;
+          const size_t axis;
+          const Eigen::MatrixXd& directions;
+          const bool modulate;
+          const vector<vector<ssize_t>> start_nvols;
+          std::map<ssize_t, Operators> operators;
+          vector<Voxel> active;
+          Eigen::VectorXd fod;
+          Eigen::MatrixXd fods;
+          vector<Eigen::MatrixXd> weights;
+          Eigen::VectorXd sh;
+          Eigen::MatrixXd transformed_directions;
+          Eigen::VectorXd modulation_factors;
       };
 
 
@@ -350,15 +388,10 @@ namespace MR
         size_t max_n_SH (0);
         if (multi_contrast_settings.size())
           start_nvols = multiContrastSetting2start_nvols (multi_contrast_settings, max_n_SH);
-        if (start_nvols.size()) {
-          DEBUG ("reorienting warp using MultiContrast NonLinearKernel");
-          ThreadedLoop (progress_message, fod_image, 0, 3)
-              .run (NonLinearKernelMultiContrast<FODImageType>(fod_image.size(3), (ssize_t) max_n_SH, warp, directions, start_nvols, modulate), fod_image);
-        } else {
-          DEBUG ("reorienting warp using NonLinearKernel");
-          ThreadedLoop (progress_message, fod_image, 0, 3)
-              .run (NonLinearKernel<FODImageType>(fod_image.size(3), warp, directions, modulate), fod_image);
-        }
+        if (start_nvols.empty())
+          start_nvols.push_back ({ 0, ssize_t (fod_image.size(3)) });
+        auto loop = ThreadedLoop (progress_message, fod_image, 0, 3);
+        loop.run_outer (NonLinearKernel<FODImageType> (fod_image, warp, loop.inner_axes[0], directions, start_nvols, modulate));
       }
 
       template <class FODImageType>
@@ -375,15 +408,10 @@ namespace MR
         if (multi_contrast_settings.size())
           start_nvols = multiContrastSetting2start_nvols (multi_contrast_settings, max_n_SH);
 
-        if (start_nvols.size()) {
-          DEBUG ("reorienting warp using MultiContrast NonLinearKernel");
-          ThreadedLoop (fod_image, 0, 3)
-              .run (NonLinearKernelMultiContrast<FODImageType>(fod_image.size(3), (ssize_t) max_n_SH, warp, directions, start_nvols, modulate), fod_image);
-        } else {
-          DEBUG ("reorienting warp using NonLinearKernel");
-          ThreadedLoop (fod_image, 0, 3)
-              .run (NonLinearKernel<FODImageType>(fod_image.size(3), warp, directions, modulate), fod_image);
-        }
+        if (start_nvols.empty())
+          start_nvols.push_back ({ 0, ssize_t (fod_image.size(3)) });
+        auto loop = ThreadedLoop (fod_image, 0, 3);
+        loop.run_outer (NonLinearKernel<FODImageType> (fod_image, warp, loop.inner_axes[0], directions, start_nvols, modulate));
       }
 
 
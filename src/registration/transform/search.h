@@ -18,6 +18,7 @@
 #define __registration_transform_search_h__
 
 #include <iostream>
+#include <numeric>
 #include <Eigen/Geometry>
 #include <Eigen/Eigen>
 
@@ -57,6 +58,77 @@ namespace MR
       using VecType = Eigen::Matrix<default_type, 3, 1>;
       using QuatType = Eigen::Quaternion<default_type>;
 
+      //! accumulate the cost and overlap of multiple candidate transformations in a single pass over the midway image
+      template <class MetricType, class ParamType>
+        class CandidateKernel { MEMALIGN(CandidateKernel<MetricType,ParamType>)
+          public:
+            CandidateKernel (const MetricType& metric,
+                             const ParamType& parameters,
+                             const vector<TrafoType>& half,
+                             const vector<TrafoType>& half_inverse,
+                             Eigen::VectorXd& overall_cost,
+                             Eigen::VectorXd& overall_overlap) :
+              metric (metric),
+              params (parameters),
+              half (half),
+              half_inverse (half_inverse),
+              cost (Eigen::VectorXd::Zero (half.size())),
+              overlap (Eigen::VectorXd::Zero (half.size())),
+              gradient (params.transformation.size()),
+              overall_cost (overall_cost),
+              overall_overlap (overall_overlap),
+              voxel2scanner (MR::Transform (params.midway_image).voxel2scanner) { }
+
+            ~CandidateKernel () {
+              overall_cost += cost;
+              overall_overlap += overlap;
+            }
+
+            void operator() (const Iterator& iter) {
+              const Eigen::Vector3d voxel_pos ((default_type)iter.index(0), (default_type)iter.index(1), (default_type)iter.index(2));
+              const Eigen::Vector3d midway_point = voxel2scanner * voxel_pos;
+
+              for (size_t n = 0; n < half.size(); ++n) {
+                const Eigen::Vector3d im2_point = half_inverse[n] * midway_point;
+                if (params.im2_mask_interp) {
+                  params.im2_mask_interp->scanner (im2_point);
+                  if (params.im2_mask_interp->value() < 0.5)
+                    continue;
+                }
+
+                const Eigen::Vector3d im1_point = half[n] * midway_point;
+                if (params.im1_mask_interp) {
+                  params.im1_mask_interp->scanner (im1_point);
+                  if (params.im1_mask_interp->value() < 0.5)
+                    continue;
+                }
+
+                params.im1_image_interp->scanner (im1_point);
+                if (!(*params.im1_image_interp))
+                  continue;
+                params.im2_image_interp->scanner (im2_point);
+                if (!(*params.im2_image_interp))
+                  continue;
+
+                overlap[n] += 1.0;
+                cost[n] += metric (params, im1_point, im2_point, midway_point, gradient);
+              }
+            }
+
+          private:
+            MetricType metric;
+            ParamType params;
+            const vector<TrafoType>& half;
+            const vector<TrafoType>& half_inverse;
+            Eigen::VectorXd cost, overlap;
+            Eigen::Matrix<default_type, Eigen::Dynamic, 1> gradient;
+            Eigen::VectorXd& overall_cost;
+            Eigen::VectorXd& overall_overlap;
+            transform_type voxel2scanner;
+        };
+
+
+
       template <class MetricType = Registration::Metric::MeanSquaredNoGradient>
         class ExhaustiveRotationSearch { MEMALIGN(ExhaustiveRotationSearch<MetricType>)
           public:
@@ -84,7 +156,9 @@ namespace MR
             global_search (init.init_rotation.search.run_global),
             translation_extent (init.init_rotation.search.translation_extent),
             idx_angle (0),
-            idx_dir (0) {
+            idx_dir (0),
+            pyramid_scale_factor (0.5),
+            retained_fraction (0.25) {
               local_trafo.set_centre_without_transform_update (centre);
               local_trafo.set_translation (offset);
               Eigen::Matrix<default_type, 3, 3> lin = input_trafo.get_transform().linear();
@@ -138,35 +212,31 @@ namespace MR
             void run ( bool debug = false ) {
               std::string what = global_search? "global" : "local";
               size_t iterations = global_search? global_search_iterations : (rot_angles.size() * local_search_directions);
-              ProgressBar progress ("performing " + what + " search for best rotation", iterations);
-              overlap_it.resize (iterations);
-              cost_it.resize (iterations);
-              trafo_it.reserve (iterations);
+              ProgressBar progress ("performing " + what + " search for best rotation", 3);
 
               if (!global_search) {
                 gen_uniform_rotation_axes (local_search_directions, 180.0); // full sphere
                 az_el_to_cartesian();
               }
 
-              size_t iteration (0);
-              ssize_t cnt (0);
-              Eigen::Matrix<default_type, Eigen::Dynamic, 1> gradient (local_trafo.size());
-              Eigen::VectorXd cost = Eigen::VectorXd::Zero(1,1);
-              transform_type T;
+              // all candidates are evaluated on the midway image of the initial transformation
+              midway_image_header = compute_minimum_average_header (im1, im2, local_trafo.get_transform_half_inverse(), local_trafo.get_transform_half());
+
+              // generate all candidate transformations up front, starting with the initial (unrotated) one
               const Eigen::Translation<default_type, 3> Tc2 (centre - 0.5 * offset), To (offset);
               transform_type R0;
-              R0.translation().fill(0);
+              R0.setIdentity();
 
               Eigen::Vector3d extent(0,0,0);
               if (translation_extent != 0) {
-                ParamType parameters = get_parameters ();
                 extent << midway_image_header.spacing(0) * translation_extent * (midway_image_header.size(0) - 0.5),
                                   midway_image_header.spacing(1) * translation_extent * (midway_image_header.size(1) - 0.5),
                                   midway_image_header.spacing(2) * translation_extent * (midway_image_header.size(2) - 0.5);
               }
 
-              while ( ++iteration < iterations ) {
-                ++progress;
+              trafo_it.clear();
+              trafo_it.reserve (iterations);
+              for (size_t iteration = 0; iteration < iterations; ++iteration) {
                 if (iteration > 0) {
                   if (global_search)
                     gen_random_quaternion ();
@@ -179,83 +249,104 @@ namespace MR
                     R0.translation() = rndn () * (quat * extent);
                     DEBUG("translation: " + str(R0.translation().transpose()));
                   }
-
-                  T = Tc2 * To * R0 * Tc2.inverse();
-                  local_trafo.set_transform<transform_type>(T);
                 }
-
-                ParamType parameters = get_parameters ();
-                // parameters.make_diagnostics_image ("/tmp/debugme"+str(iteration)+".mif", true); // REMOVEME
-                cost.fill(0);
-                cnt = 0;
-                Metric::ThreadKernel<MetricType, ParamType> kernel (metric, parameters, cost, gradient, &cnt);
-                ThreadedLoop (parameters.midway_image, 0, 3).run (kernel);
-                DEBUG ("rotation search: iteration " + str(iteration) + " cost: " + str(cost) + " cnt: " + str(cnt));
-                if (debug)
-                  std::cout << str(iteration) + " " + str(cost) + " " + str(cnt) << " " << T.matrix().row(0) << " " << T.matrix().row(1) << " " << T.matrix().row(2) << std::endl;
-                // write_images ( "im1_" + str(iteration) + ".mif", "im2_" + str(iteration) + ".mif");
-                if (cnt == 0) {
-                  if (iteration == 0)
-                    throw Exception ("zero voxel overlap at initialisation. input matrix wrong?");
-                  WARN ("rotation search: overlap count is zero");
+                trafo_it.push_back (Tc2 * To * R0 * Tc2.inverse());
+              }
+              ++progress;
+
+              // evaluate all candidates at a coarser resolution first, and only retain the most promising ones
+              vector<size_t> candidates (iterations);
+              std::iota (candidates.begin(), candidates.end(), 0);
+              evaluate (candidates, pyramid_scale_factor * image_scale_factor);
+              if (overlap_it[0] == 0)
+                throw Exception ("zero voxel overlap at initialisation. input matrix wrong?");
+              vector<size_t> order = rank_candidates();
+              candidates.resize (std::max (size_t(1), size_t (std::ceil (retained_fraction * iterations))));
+              for (size_t n = 0; n < candidates.size(); ++n)
+                candidates[n] = order[n];
+              ++progress;
+
+              evaluate (candidates, image_scale_factor);
+              if (overlap_it.maxCoeff() == 0)
+                WARN ("rotation search: overlap count is zero");
+              for (size_t n = 0; n < candidates.size(); ++n) {
+                DEBUG ("rotation search: candidate " + str(candidates[n]) + " cost: " + str(cost_it[n]) + " cnt: " + str(overlap_it[n]));
+                if (debug) {
+                  const transform_type& T = trafo_it[candidates[n]];
+                  std::cout << str(candidates[n]) + " " + str(cost_it[n]) + " " + str(overlap_it[n]) << " " << T.matrix().row(0) << " " << T.matrix().row(1) << " " << T.matrix().row(2) << std::endl;
                 }
-                overlap_it[iteration] = cnt;
-                cost_it[iteration] = cost(0) / static_cast<default_type>(cnt);
-                trafo_it.push_back (T);
               }
-              // if (debug) {
-              //   save_matrix(cost_it, "/tmp/cost_before.txt");
-              //   save_matrix(overlap_it, "/tmp/overlap.txt");
-              // }
+
               //  best trafo := lowest cost per voxel with at least mean overlap
-              {
-                auto max_ = Eigen::MatrixXd::Constant(cost_it.rows(), 1, std::numeric_limits<default_type>::max());
-                // default_type max_overlap = overlap_it.maxCoeff();
-                default_type mean_overlap = static_cast<default_type>(overlap_it.sum()) / static_cast<default_type>(iterations);
-                // reject solutions with less than mean overlap by setting cost to max
-                cost_it = (overlap_it.array() > mean_overlap).select(cost_it, max_);
-                std::ptrdiff_t i;
-                min_cost = cost_it.minCoeff(&i);
-                T = trafo_it[i];
-                best_trafo = T;
-              }
-              // if (debug) {
-              //   save_matrix(cost_it, "/tmp/cost_after.txt");
-              //   Eigen::VectorXd t(2);
-              //   t(0) = cost_it(0);
-              //   t(1) = min_cost;
-              //   save_matrix(t, "/tmp/cost_mass_chosen.txt");
-              //   save_matrix(centre, "/tmp/centre.txt");
-              //   parameters.transformation.set_transform (best_trafo);
-              //   write_images ( "/tmp/im1_best.mif", "/tmp/im2_best.mif");
-              // }
+              order = rank_candidates();
+              min_cost = cost_it[order[0]];
+              best_trafo = trafo_it[candidates[order[0]]];
+              ++progress;
+
               input_trafo.set_transform<transform_type> (best_trafo);
             };
 
           private:
-            FORCE_INLINE ParamType get_parameters () {
-              // create resized midway image
-              // vector<Eigen::Transform<default_type, 3, Eigen::Projective>> init_transforms;
-              // {
-              //   Eigen::Transform<default_type, 3, Eigen::Projective> init_trafo_1 = ;
-              //   Eigen::Transform<default_type, 3, Eigen::Projective> init_trafo_2 = local_trafo.get_transform_half();
-              //   init_transforms.push_back (init_trafo_1);
-              //   init_transforms.push_back (init_trafo_2);
-              // }
-              // auto padding = Eigen::Matrix<default_type, 4, 1>(1.0, 1.0, 1.0, 1.0);
-              // int subsample = 1;
-              // vector<Header> headers;
-              // headers.push_back (Header (im1));
-              // headers.push_back (Header (im2));
-              midway_image_header = compute_minimum_average_header (im1, im2, local_trafo.get_transform_half_inverse(), local_trafo.get_transform_half());
-
+            // evaluate the cost and overlap of the candidate transformations in a single pass over the
+            // midway image, with the images and midway image downsampled by scale
+            void evaluate (const vector<size_t>& candidates, const default_type scale) {
               Filter::Resize midway_resize_filter (midway_image_header);
-              midway_resize_filter.set_scale_factor (image_scale_factor);
+              midway_resize_filter.set_scale_factor (scale);
               midway_resized_header = Header (midway_resize_filter);
 
-              ParamType parameters (local_trafo, im1, im2, midway_resized_header, mask1, mask2);
-              parameters.loop_density = 1.0;
-              return parameters;
+              Image<default_type> im1_resized = downsample (im1, scale);
+              Image<default_type> im2_resized = downsample (im2, scale);
+              ParamType parameters (local_trafo, im1_resized, im2_resized, midway_resized_header, mask1, mask2);
+
+              vector<TrafoType> half, half_inverse;
+              for (auto n : candidates) {
+                local_trafo.set_transform<transform_type> (trafo_it[n]);
+                half.push_back (local_trafo.get_transform_half());
+                half_inverse.push_back (local_trafo.get_transform_half_inverse());
+              }
+              local_trafo.set_transform<transform_type> (trafo_it[0]);
+
+              Eigen::VectorXd cost = Eigen::VectorXd::Zero (candidates.size());
+              Eigen::VectorXd overlap = Eigen::VectorXd::Zero (candidates.size());
+              ThreadedLoop (midway_resized_header, 0, 3).run (CandidateKernel<MetricType, ParamType> (metric, parameters, half, half_inverse, cost, overlap));
+
+              overlap_it = overlap;
+              cost_it = cost;
+            }
+
+            // order the evaluated candidates by cost per voxel, placing those with less than mean overlap last;
+            // the mean is taken over the candidates evaluated, and candidates with exactly the mean overlap
+            // are retained, so that at least one candidate remains eligible when all overlap equally
+            vector<size_t> rank_candidates () const {
+              const default_type mean_overlap = overlap_it.mean();
+              Eigen::VectorXd cost_per_voxel (cost_it.size());
+              for (ssize_t n = 0; n < cost_it.size(); ++n)
+                cost_per_voxel[n] = (overlap_it[n] > 0.0 && overlap_it[n] >= mean_overlap) ?
+                    cost_it[n] / overlap_it[n] : std::numeric_limits<default_type>::max();
+              vector<size_t> order (cost_it.size());
+              std::iota (order.begin(), order.end(), 0);
+              std::stable_sort (order.begin(), order.end(), [&cost_per_voxel](size_t a, size_t b) { return cost_per_voxel[a] < cost_per_voxel[b]; });
+              return order;
+            }
+
+            // the first volume of image, resampled by scale; the other volumes of 4D images do not contribute to the search
+            static Image<default_type> downsample (Image<default_type>& image, const default_type scale) {
+              Image<default_type> volume (image);
+              if (image.ndim() > 3) {
+                Header header (image);
+                header.ndim() = 3;
+                volume = Image<default_type>::scratch (header);
+                Image<default_type> source (image);
+                source.index(3) = 0;
+                for (auto l = Loop (volume) (volume, source); l; ++l)
+                  volume.value() = source.value();
+              }
+              Filter::Resize resize_filter (volume);
+              resize_filter.set_scale_factor (scale);
+              resize_filter.set_interp_type (1);
+              auto downsampled = Image<default_type>::scratch (resize_filter);
+              resize_filter (volume, downsampled);
+              return downsampled;
             }
 
             // gen_random_quaternion generates random element of SO(3)
@@ -339,6 +430,7 @@ namespace MR
             bool global_search;
             double translation_extent;
             size_t idx_angle, idx_dir;
+            const default_type pyramid_scale_factor, retained_fraction;
             Registration::Transform::Rigid local_trafo;
             Eigen::Matrix<default_type, Eigen::Dynamic, 2> az_el;
             Eigen::Matrix<default_type, Eigen::Dynamic, 3> xyz;
@@ -23,6 +23,7 @@
 #include "interp/linear.h"
 #include "adapter/jacobian.h" //TODO remove after debug
 #include "registration/warp/helpers.h"
+#include "registration/warp/field_pair.h"
 #include "adapter/extract.h"
 
 namespace MR
@@ -67,9 +68,10 @@ namespace MR
             MR::Transform image_transform;
         };
 
-        class ComposeDispKernel { MEMALIGN(ComposeDispKernel)
+        template <class UpdateFieldType = Image<default_type>>
+        class ComposeDispKernel { MEMALIGN(ComposeDispKernel<UpdateFieldType>)
           public:
-            ComposeDispKernel (Image<default_type>& disp_input1, Image<default_type>& disp_input2, default_type step) :
+            ComposeDispKernel (Image<default_type>& disp_input1, UpdateFieldType& disp_input2, default_type step) :
                                disp1_transform (disp_input1), disp2_interp (disp_input2), step (step) {}
 
 
@@ -81,7 +83,7 @@ namespace MR
               if (!disp2_interp) {
                 disp_output.row(3) = disp_input1.row(3);
               } else {
-                Eigen::Vector3d displacement (Eigen::Vector3d(disp2_interp.row(3)).array() * step);
+                Eigen::Vector3d displacement (disp2_interp.row(3).template cast<default_type>().array() * step);
                 Eigen::Vector3d new_position = displacement + original_position;
                 disp_output.row(3) = new_position - voxel_position;
               }
@@ -89,11 +91,78 @@ namespace MR
 
           protected:
             MR::Transform disp1_transform;
-            Interp::Linear<Image<default_type> > disp2_interp;
+            Interp::Linear<UpdateFieldType> disp2_interp;
             default_type step;
         };
 
 
+        // Compose the displacement fields of both images with their respective updates in the same pass
+        template <class UpdateFieldType>
+        class ComposeDispPairKernel { MEMALIGN(ComposeDispPairKernel<UpdateFieldType>)
+          public:
+            ComposeDispPairKernel (Image<default_type>& disp_input1, UpdateFieldType& update1,
+                                   Image<default_type>& disp_input2, UpdateFieldType& update2, default_type step) :
+                                   compose1 (disp_input1, update1, step), compose2 (disp_input2, update2, step) {}
+
+
+            void operator() (Image<default_type>& disp_input1, Image<default_type>& disp_output1,
+                             Image<default_type>& disp_input2, Image<default_type>& disp_output2) {
+              compose1 (disp_input1, disp_output1);
+              compose2 (disp_input2, disp_output2);
+            }
+
+          protected:
+            ComposeDispKernel<UpdateFieldType> compose1, compose2;
+        };
+
+
+        class ComposeLinearDispPairKernel { MEMALIGN(ComposeLinearDispPairKernel)
+          public:
+            template<class DisplacementFieldType>
+            ComposeLinearDispPairKernel (const transform_type& linear_transform1, const transform_type& linear_transform2,
+                                         const DisplacementFieldType& disp_in) :
+                                         compose1 (linear_transform1, disp_in),
+                                         compose2 (linear_transform2, disp_in) {}
+
+
+            template <class DisplacementField1Type, class DeformationField1Type, class DisplacementField2Type, class DeformationField2Type>
+            void operator() (DisplacementField1Type& disp_input1, DeformationField1Type& deform_output1,
+                             DisplacementField2Type& disp_input2, DeformationField2Type& deform_output2) {
+              compose1 (disp_input1, deform_output1);
+              compose2 (disp_input2, deform_output2);
+            }
+
+          protected:
+            ComposeLinearDispKernel compose1, compose2;
+        };
+
+
+        // Record the largest displacement within each field of a pair
+        class MaxNormPairKernel { MEMALIGN(MaxNormPairKernel)
+          public:
+            MaxNormPairKernel (Eigen::Vector2d& global_max_norm) :
+                               global_max_norm (global_max_norm),
+                               thread_max_norm (0.0, 0.0),
+                               mutex (new std::mutex) {}
+
+            ~MaxNormPairKernel () {
+              std::lock_guard<std::mutex> lock (*mutex);
+              global_max_norm = global_max_norm.cwiseMax (thread_max_norm);
+            }
+
+            template <class FieldType>
+            void operator() (FieldType& field1, FieldType& field2) {
+              thread_max_norm[0] = std::max (thread_max_norm[0], Eigen::Vector3d (field1.row(3)).norm());
+              thread_max_norm[1] = std::max (thread_max_norm[1], Eigen::Vector3d (field2.row(3)).norm());
+            }
+
+          protected:
+            Eigen::Vector2d& global_max_norm;
+            Eigen::Vector2d thread_max_norm;
+            std::shared_ptr<std::mutex> mutex;
+        };
+
+
         template <class DeformationField1Type, class DeformationField2Type>
         class ComposeHalfwayKernel { MEMALIGN(ComposeHalfwayKernel<DeformationField1Type,DeformationField2Type>)
           public:
@@ -148,25 +217,30 @@ namespace MR
         ThreadedLoop (deform_in, 0, 3).run (ComposeLinearDeformKernel (transform), deform_in, deform_out);
       }
 
-      // Compose two displacement fields and output a displacement field. The input and output can be the same image.
-      FORCE_INLINE  void update_displacement (Image<default_type>& input, Image<default_type>& update, Image<default_type>& output, default_type step = 1.0)
+      // Compose a linear transform with each displacement field of a pair in a single pass. The output fields are deformation fields.
+      template <class DeformationFieldType>
+      FORCE_INLINE  void compose_linear_displacement (const transform_type& transform1, const transform_type& transform2,
+                                                      Image<default_type>& disp_in1, Image<default_type>& disp_in2,
+                                                      DeformationFieldType& deform_out1, DeformationFieldType& deform_out2)
       {
-        check_dimensions (input, output, 0, 3);
-        ThreadedLoop (input, 0, 3).run (ComposeDispKernel (input, update, step), input, output);
+        check_dimensions (disp_in1, deform_out1, 0, 3);
+        check_dimensions (disp_in2, deform_out2, 0, 3);
+        ThreadedLoop (disp_in1, 0, 3).run (ComposeLinearDispPairKernel (transform1, transform2, disp_in1),
+                                           disp_in1, deform_out1, disp_in2, deform_out2);
       }
 
-      // Compose two displacement fields and output a displacement field using scaling and squaring.  The input and output can be the same image.
-      FORCE_INLINE  void update_displacement_scaling_and_squaring (Image<default_type>& input, Image<default_type>& update, Image<default_type>& output, const default_type step = 1.0)
+      // Compose two displacement fields and output a displacement field. The input and output can be the same image.
+      template <class UpdateFieldType>
+      FORCE_INLINE  void update_displacement (Image<default_type>& input, UpdateFieldType& update, Image<default_type>& output, default_type step = 1.0)
       {
         check_dimensions (input, output, 0, 3);
+        ThreadedLoop (input, 0, 3).run (ComposeDispKernel<UpdateFieldType> (input, update, step), input, output);
+      }
 
-        default_type max_norm = 0.0;
-        auto max_norm_func = [&max_norm](Image<default_type>& update) {
-          default_type norm = Eigen::Vector3d (update.row(3)).norm();
-          if (norm > max_norm)
-            max_norm = norm;
-        };
-        ThreadedLoop (update).run (max_norm_func, update);
+      // Compose two displacement fields using scaling and squaring, for an update field whose maximum norm is already known.
+      template <class UpdateFieldType>
+      FORCE_INLINE  void update_displacement_scaling_and_squaring (Image<default_type>& input, UpdateFieldType& update, Image<default_type>& output, const default_type step, const default_type max_norm)
+      {
         default_type min_vox_size = static_cast<default_type> (std::min (input.spacing(0), std::min (input.spacing(1), input.spacing(2))));
 
         // if the maximum update is larger than half a voxel, perform scaling and squaring to ensure the displacement field remains diffeomorphic
@@ -177,13 +251,16 @@ namespace MR
         } else {
           scale_factor = std::pow (2, std::ceil (std::log ((max_norm * step) / (min_vox_size / 2.0)) / std::log (2.0)));
 
-          std::shared_ptr<Image<default_type>> scaled_update = make_shared<Image<default_type> >(Image<default_type>::scratch (update));
-          std::shared_ptr<Image<default_type>> composed = make_shared<Image<default_type> >(Image<default_type>::scratch (update));
+          // the update may be a view into a FieldPair
+          Header scratch_header (update);
+          scratch_header.ndim() = 4;
+          std::shared_ptr<Image<default_type>> scaled_update = make_shared<Image<default_type> >(Image<default_type>::scratch (scratch_header));
+          std::shared_ptr<Image<default_type>> composed = make_shared<Image<default_type> >(Image<default_type>::scratch (scratch_header));
 
           // Scaling
           default_type scaled_step = step / scale_factor; // apply the step size and scale factor at once
-          ThreadedLoop (update).run (
-                [&scaled_step](Image<default_type>& update, Image<default_type>& scaled_update) {
+          ThreadedLoop (update, 0, 3).run (
+                [&scaled_step](UpdateFieldType& update, Image<default_type>& scaled_update) {
                   scaled_update.row(3) = Eigen::Vector3d (update.row(3)) * scaled_step;
                 }, update, *scaled_update);
 
@@ -215,6 +292,44 @@ namespace MR
         }
       }
 
+      // Compose two displacement fields and output a displacement field using scaling and squaring.  The input and output can be the same image.
+      FORCE_INLINE  void update_displacement_scaling_and_squaring (Image<default_type>& input, Image<default_type>& update, Image<default_type>& output, const default_type step = 1.0)
+      {
+        check_dimensions (input, output, 0, 3);
+
+        default_type max_norm = 0.0;
+        auto max_norm_func = [&max_norm](Image<default_type>& update) {
+          default_type norm = Eigen::Vector3d (update.row(3)).norm();
+          if (norm > max_norm)
+            max_norm = norm;
+        };
+        ThreadedLoop (update).run (max_norm_func, update);
+        update_displacement_scaling_and_squaring (input, update, output, step, max_norm);
+      }
+
+      // Update the displacement fields of both images using scaling and squaring, with the update fields held in a FieldPair.
+      // Unless either update requires squaring, both fields are updated in a single pass.
+      template <typename ValueType>
+      FORCE_INLINE  void update_displacement_scaling_and_squaring (Image<default_type>& input1, Image<default_type>& input2, FieldPair<ValueType>& update,
+                                                                   Image<default_type>& output1, Image<default_type>& output2, const default_type step = 1.0)
+      {
+        check_dimensions (input1, output1, 0, 3);
+        check_dimensions (input2, output2, 0, 3);
+
+        auto update1 = update[0];
+        auto update2 = update[1];
+        Eigen::Vector2d max_norm (0.0, 0.0);
+        ThreadedLoop (update1, 0, 3).run (MaxNormPairKernel (max_norm), update1, update2);
+
+        default_type min_vox_size = static_cast<default_type> (std::min (input1.spacing(0), std::min (input1.spacing(1), input1.spacing(2))));
+        if (max_norm.maxCoeff() * step < min_vox_size / 2.0) {
+          ThreadedLoop (input1, 0, 3).run (ComposeDispPairKernel<Image<ValueType>> (input1, update1, input2, update2, step), input1, output1, input2, output2);
+        } else {
+          update_displacement_scaling_and_squaring (input1, update1, output1, step, max_norm[0]);
+          update_displacement_scaling_and_squaring (input2, update2, output2, step, max_norm[1]);
+        }
+      }
+
 
 
       // Compose linear1<->deform1<->[midway space]<->deform2<->linear2.
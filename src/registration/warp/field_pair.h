@@ -0,0 +1,78 @@
+/* Copyright (c) 2008-2024 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#ifndef __registration_warp_field_pair_h__
+#define __registration_warp_field_pair_h__
+
+#include "image.h"
+
+namespace MR
+{
+  namespace Registration
+  {
+    namespace Warp
+    {
+
+      //! a pair of 4D vector fields, one for each image, sharing the same voxel grid
+      /*! Both fields are held in a single 5D scratch image, with the
+       * components of each vector along the 4th axis and the field index
+       * along the 5th. Each component is stored as a contiguous volume, so
+       * that both fields can be processed in a single pass: for instance,
+       * both can be smoothed with a single call to Filter::Smooth.
+       *
+       * The fields are stored using \a ValueType, irrespective of the datatype
+       * of \a field_header. */
+      template <typename ValueType>
+      class FieldPair { MEMALIGN(FieldPair<ValueType>)
+        public:
+          FieldPair () { }
+
+          template <class HeaderType>
+          FieldPair (const HeaderType& field_header) {
+            Header header (field_header);
+            header.ndim() = 5;
+            header.size(3) = 3;
+            header.size(4) = 2;
+            header.stride(3) = header.stride(4) = 0;
+            fields = Image<ValueType>::scratch (header, "field pair");
+          }
+
+          bool valid () const { return fields.valid(); }
+
+          //! the field for image \a n (0 or 1)
+          /*! This returns the shared 5D image, positioned at index \a n
+           * along the 5th axis; it is not a 4D view. Loops over the field
+           * must therefore be restricted to the first 4 axes, and the index
+           * along the 5th axis must not be modified. */
+          Image<ValueType> operator[] (size_t n) const {
+            assert (n < 2);
+            Image<ValueType> field (fields);
+            field.index(4) = n;
+            return field;
+          }
+
+          //! both fields as a single 5D image
+          Image<ValueType>& both () { return fields; }
+
+        protected:
+          Image<ValueType> fields;
+      };
+
+    }
+  }
+}
+
+#endif
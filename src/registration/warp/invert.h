@@ -19,6 +19,7 @@
 
 #include "image.h"
 #include "interp/linear.h"
+#include "filter/resize.h"
 #include "algo/threaded_loop.h"
 #include "registration/warp/convert.h"
 #include "transform.h"
@@ -32,49 +33,113 @@ namespace MR
 
       namespace {
 
+        // the smallest grid (along any spatial axis) on which a coarse-to-fine initialisation is performed
+        constexpr ssize_t multigrid_min_size = 16;
+
+
+        // solve the fixed-point problem x = x + residual(x), as used to invert the warp at each voxel,
+        // using Anderson acceleration with a history of up to two previous iterates. The history is
+        // discarded and a plain fixed-point step taken instead whenever an accelerated step would
+        // increase the residual (or leave the field of view, where the residual is NaN). As for the
+        // plain iteration, the last residual is added on exit.
+        template <class ResidualFunctor>
+        FORCE_INLINE void anderson_solve (Eigen::Vector3d& current, ResidualFunctor&& residual, const size_t max_iter, const default_type error_tolerance)
+        {
+          // differences between successive iterates and residuals, most recent last:
+          Eigen::Matrix<default_type, 3, 2> delta_x, delta_r;
+          int history = 0;
+
+          Eigen::Vector3d r = residual (current);
+          default_type error = r.squaredNorm();
+          size_t iter = 1;
+          while (iter < max_iter && error > error_tolerance) {
+            Eigen::Vector3d next = current + r;
+            if (history) {
+              // mixing coefficients minimise the linearised residual || r - delta_r * gamma ||,
+              // solved directly via the normal equations, falling back to the most recent
+              // difference alone if the two are close to collinear:
+              const Eigen::Vector3d d1 = delta_r.col (history-1);
+              const default_type a11 = d1.squaredNorm();
+              bool mixed = false;
+              if (history == 2) {
+                const Eigen::Vector3d d0 = delta_r.col(0);
+                const default_type a00 = d0.squaredNorm(), a01 = d0.dot (d1);
+                const default_type det = a00*a11 - a01*a01;
+                if (det > 1.0e-6 * a00*a11) {
+                  const default_type b0 = d0.dot (r), b1 = d1.dot (r);
+                  const default_type g0 = (a11*b0 - a01*b1) / det, g1 = (a00*b1 - a01*b0) / det;
+                  next -= g0 * (delta_x.col(0) + d0) + g1 * (delta_x.col(1) + d1);
+                  mixed = true;
+                }
+              }
+              if (!mixed && a11 > 0.0)
+                next -= (d1.dot (r) / a11) * (delta_x.col (history-1) + d1);
+            }
 
-      class DisplacementThreadKernel { MEMALIGN(DisplacementThreadKernel)
-
-        public:
-          DisplacementThreadKernel (Image<default_type> & displacement,
-                        Image<default_type> & displacement_inverse,
-                        const size_t max_iter,
-                        const default_type error_tol) :
-                          displacement (displacement),
-                          transform (displacement_inverse),
-                          max_iter (max_iter),
-                          error_tolerance (error_tol) {}
-
-          void operator() (Image<default_type>& displacement_inverse)
-          {
-            Eigen::Vector3d voxel ((default_type)displacement_inverse.index(0), (default_type)displacement_inverse.index(1), (default_type)displacement_inverse.index(2));
-            Eigen::Vector3d truth = transform.voxel2scanner * voxel;
-            Eigen::Vector3d current = truth + Eigen::Vector3d(displacement_inverse.row(3));
-
-            size_t iter = 0;
-            default_type error = std::numeric_limits<default_type>::max();
-            while (iter < max_iter && error > error_tolerance) {
-              error = update (current, truth);
+            Eigen::Vector3d r_next = residual (next);
+            ++iter;
+            if (history && !(r_next.squaredNorm() <= error)) {
+              // with no iterations left to evaluate the plain step, it is taken on exit instead
+              if (iter >= max_iter)
+                break;
+              history = 0;
+              next = current + r;
+              r_next = residual (next);
               ++iter;
             }
-            displacement_inverse.row(3) = current - truth;
-          }
 
-        private:
+            if (history == 2) {
+              delta_x.col(0) = delta_x.col(1);
+              delta_r.col(0) = delta_r.col(1);
+            } else {
+              ++history;
+            }
+            delta_x.col (history-1) = next - current;
+            delta_r.col (history-1) = r_next - r;
 
-          default_type update (Eigen::Vector3d& current, const Eigen::Vector3d& truth)
-          {
-            displacement.scanner (current);
-            Eigen::Vector3d discrepancy = truth - (current + Eigen::Vector3d (displacement.row(3)));
-            current += discrepancy;
-            return discrepancy.dot (discrepancy);
+            current = next;
+            r = r_next;
+            error = r.squaredNorm();
           }
+          current += r;
+        }
+
+
+        class DisplacementThreadKernel { MEMALIGN(DisplacementThreadKernel)
 
-          Interp::Linear<Image<default_type> > displacement;
-          MR::Transform transform;
-          const size_t max_iter;
-          default_type error_tolerance;
-      };
+          public:
+            DisplacementThreadKernel (Image<default_type> & displacement,
+                          Image<default_type> & displacement_inverse,
+                          const size_t max_iter,
+                          const default_type error_tol) :
+                            displacement (displacement),
+                            transform (displacement_inverse),
+                            max_iter (max_iter),
+                            error_tolerance (error_tol) {}
+
+            void operator() (Image<default_type>& displacement_inverse)
+            {
+              Eigen::Vector3d voxel ((default_type)displacement_inverse.index(0), (default_type)displacement_inverse.index(1), (default_type)displacement_inverse.index(2));
+              const Eigen::Vector3d truth = transform.voxel2scanner * voxel;
+              Eigen::Vector3d current = truth + Eigen::Vector3d(displacement_inverse.row(3));
+
+              anderson_solve (current, [&] (const Eigen::Vector3d& position) {
+                  displacement.scanner (position);
+                  return Eigen::Vector3d (truth - (position + Eigen::Vector3d (displacement.row(3))));
+                }, max_iter, error_tolerance);
+
+              displacement_inverse.row(3) = current - truth;
+            }
+
+            // an initial estimate of the inverse displacement field, prior to any update
+            static void identity (Image<default_type>&) { }
+
+          private:
+            Interp::Linear<Image<default_type> > displacement;
+            MR::Transform transform;
+            const size_t max_iter;
+            default_type error_tolerance;
+        };
 
 
         class DeformationThreadKernel { MEMALIGN(DeformationThreadKernel)
@@ -92,33 +157,74 @@ namespace MR
             void operator() (Image<default_type>& inv_deform)
             {
               Eigen::Vector3d voxel ((default_type)inv_deform.index(0), (default_type)inv_deform.index(1), (default_type)inv_deform.index(2));
-              Eigen::Vector3d truth = transform.voxel2scanner * voxel;
+              const Eigen::Vector3d truth = transform.voxel2scanner * voxel;
               Eigen::Vector3d current = inv_deform.row(3);
 
-              size_t iter = 0;
-              default_type error = std::numeric_limits<default_type>::max();
-              while (iter < max_iter && error > error_tolerance) {
-                error = update (current, truth);
-                ++iter;
-              }
+              anderson_solve (current, [&] (const Eigen::Vector3d& position) {
+                  deform.scanner (position);
+                  return Eigen::Vector3d (truth - Eigen::Vector3d (deform.row(3)));
+                }, max_iter, error_tolerance);
+
               inv_deform.row(3) = current;
             }
 
-          private:
-
-            default_type update (Eigen::Vector3d& current, const Eigen::Vector3d& truth)
-            {
-              deform.scanner (current);
-              Eigen::Vector3d discrepancy = truth - Eigen::Vector3d (deform.row(3));
-              current += discrepancy;
-              return discrepancy.dot (discrepancy);
+            // an initial estimate of the inverse deformation field, prior to any update
+            static void identity (Image<default_type>& inv_deform) {
+              displacement2deformation (inv_deform, inv_deform);
             }
 
+          private:
             Interp::Linear<Image<default_type> > deform;
             MR::Transform transform;
             const size_t max_iter;
             default_type error_tolerance;
         };
+
+
+        // resample a coarse estimate of the inverse onto the grid of a finer one, leaving any voxels
+        // outside the coarse field of view, or where the coarse inverse is undefined, untouched
+        class UpsampleThreadKernel { MEMALIGN(UpsampleThreadKernel)
+
+          public:
+            UpsampleThreadKernel (Image<default_type>& coarse,
+                          Image<default_type>& fine) :
+                            coarse (coarse, 0.0),
+                            transform (fine) {}
+
+            void operator() (Image<default_type>& fine)
+            {
+              Eigen::Vector3d voxel ((default_type)fine.index(0), (default_type)fine.index(1), (default_type)fine.index(2));
+              if (coarse.scanner (transform.voxel2scanner * voxel)) {
+                const Eigen::Vector3d value (coarse.row(3));
+                if (value.allFinite())
+                  fine.row(3) = value;
+              }
+            }
+
+          private:
+            Interp::Linear<Image<default_type> > coarse;
+            MR::Transform transform;
+        };
+
+
+        // initialise the inverse by inverting on a grid downsampled by a factor of two (itself
+        // initialised in the same way), and upsampling the result. The coarse inversion still
+        // samples the full resolution forward field, so no accuracy is lost on the coarse grid.
+        template <class KernelType>
+        void initialise_coarse_to_fine (Image<default_type>& field, Image<default_type>& inv_field, const size_t max_iter, const default_type error_tolerance)
+        {
+          if (std::min ({ inv_field.size(0), inv_field.size(1), inv_field.size(2) }) < 2 * multigrid_min_size)
+            return;
+
+          Filter::Resize resize_filter (inv_field);
+          resize_filter.set_scale_factor (0.5);
+          auto coarse = Image<default_type>::scratch (resize_filter, "coarse inverse warp");
+          KernelType::identity (coarse);
+          initialise_coarse_to_fine<KernelType> (field, coarse, max_iter, error_tolerance);
+
+          ThreadedLoop (coarse, 0, 3).run (KernelType (field, coarse, max_iter, error_tolerance), coarse);
+          ThreadedLoop (inv_field, 0, 3).run (UpsampleThreadKernel (coarse, inv_field), inv_field);
+        }
       }
 
 
@@ -126,15 +232,18 @@ namespace MR
         @{ */
 
           /*! Estimate the inverse of a deformation field
-           * Note that the output inv_warp can be passed as either a zero field or an initial estimate
+           * Note that the output inv_warp can be passed as either a zero field or an initial estimate.
+           * In the former case, the inverse is first estimated on successively coarser grids.
            */
           FORCE_INLINE void invert_deformation (Image<default_type>& deform_field, Image<default_type>& inv_deform_field, bool is_initialised = false, size_t max_iter = 50, default_type error_tolerance = 0.0001)
           {
             check_dimensions (deform_field, inv_deform_field);
             error_tolerance *= (deform_field.spacing(0) + deform_field.spacing(1) + deform_field.spacing(2)) / 3;
 
-            if (!is_initialised)
-              displacement2deformation (inv_deform_field, inv_deform_field);
+            if (!is_initialised) {
+              DeformationThreadKernel::identity (inv_deform_field);
+              initialise_coarse_to_fine<DeformationThreadKernel> (deform_field, inv_deform_field, max_iter, error_tolerance);
+            }
 
             ThreadedLoop ("inverting warp field...", inv_deform_field, 0, 3)
               .run (DeformationThreadKernel (deform_field, inv_deform_field, max_iter, error_tolerance), inv_deform_field);
@@ -153,13 +262,20 @@ namespace MR
 
 
           /*! Estimate the inverse of a displacement field
-           * Note that the output inv_warp can be passed as either a zero field or an initial estimate
+           * Note that the output inv_warp can be passed as either a zero field or an initial estimate.
+           * If \a is_initialised is false, the contents of inv_warp are ignored, and the inverse is
+           * first estimated on successively coarser grids.
            */
-          FORCE_INLINE void invert_displacement (Image<default_type>& disp_field, Image<default_type>& inv_disp_field, size_t max_iter = 50, default_type error_tolerance = 0.0001)
+          FORCE_INLINE void invert_displacement (Image<default_type>& disp_field, Image<default_type>& inv_disp_field, size_t max_iter = 50, default_type error_tolerance = 0.0001, bool is_initialised = true)
           {
             check_dimensions (disp_field, inv_disp_field);
             error_tolerance *= (disp_field.spacing(0) + disp_field.spacing(1) + disp_field.spacing(2)) / 3;
 
+            if (!is_initialised) {
+              ThreadedLoop (inv_disp_field, 0, 3).run ([] (Image<default_type>& inv_disp) { inv_disp.row(3) = Eigen::Vector3d::Zero(); }, inv_disp_field);
+              initialise_coarse_to_fine<DisplacementThreadKernel> (disp_field, inv_disp_field, max_iter, error_tolerance);
+            }
+
             ThreadedLoop ("inverting displacement field...", inv_disp_field, 0, 3)
               .run (DisplacementThreadKernel (disp_field, inv_disp_field, max_iter, error_tolerance), inv_disp_field);
           }
@@ -55,6 +55,12 @@ namespace MR
           }
 
           void operator() (in_column_type, const value_type, out_column_type) const override;
+
+          bool provides_adjacency () const override { return true; }
+          void get_neighbours (const size_t index, vector<size_t>& neighbours) const override {
+            const auto adjacent = connector.adjacency[index];
+            neighbours.assign (adjacent.begin(), adjacent.end());
+          }
       };
       //! @}
 
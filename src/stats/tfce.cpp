@@ -45,6 +45,12 @@ namespace MR
 
       void Wrapper::operator() (in_column_type in, out_column_type out) const
       {
+        // With an extent exponent of zero, elements not within any cluster
+        //   would nevertheless contribute; retain explicit integration
+        if (enhancer->provides_adjacency() && E > 0.0) {
+          incremental (in, out);
+          return;
+        }
         out.setZero();
         const value_type max_input_value = in.maxCoeff();
         for (value_type h = dH; (h-dH) < max_input_value; h += dH) {
@@ -58,6 +64,88 @@ namespace MR
 
 
 
+      void Wrapper::incremental (in_column_type in, out_column_type out) const
+      {
+        out.setZero();
+        const value_type max_input_value = in.maxCoeff();
+        vector<value_type> thresholds;
+        for (value_type h = dH; (h-dH) < max_input_value; h += dH)
+          thresholds.push_back (h);
+        if (thresholds.empty())
+          return;
+        const size_t num_thresholds = thresholds.size();
+
+        // Sweep is performed from the highest threshold downwards;
+        //   cumulative_h[t] is the sum of h^H over the first t thresholds visited
+        vector<value_type> cumulative_h (num_thresholds + 1, value_type(0));
+        for (size_t t = 0; t != num_thresholds; ++t)
+          cumulative_h[t+1] = cumulative_h[t] + std::pow (thresholds[num_thresholds-1-t], H);
+
+        // Only elements exceeding the lowest threshold can contribute
+        vector<size_t> order;
+        for (size_t i = 0; i != size_t(in.size()); ++i) {
+          if (enhancer->supra_threshold (in[i], thresholds.front()))
+            order.push_back (i);
+        }
+        std::sort (order.begin(), order.end(), [&] (const size_t a, const size_t b) { return in[a] > in[b]; });
+
+        // For each cluster root, enhancement accumulated up to the time at
+        //   which its extent last changed; for any other element, the offset
+        //   of its own total relative to that of its parent
+        const size_t not_added = in.size();
+        vector<size_t> parent (in.size(), not_added), extent (in.size(), 0), since (in.size(), 0), link_order;
+        vector<value_type> accumulated (in.size(), value_type(0));
+
+        // No path compression: this would invalidate the relative offsets;
+        //   union by extent keeps the trees shallow
+        auto find = [&] (size_t i) { while (parent[i] != i) i = parent[i]; return i; };
+        auto flush = [&] (const size_t root, const size_t t) {
+          accumulated[root] += std::pow (value_type(extent[root]), E) * (cumulative_h[t] - cumulative_h[since[root]]);
+          since[root] = t;
+        };
+
+        vector<size_t> neighbours;
+        size_t next = 0;
+        for (size_t t = 0; t != num_thresholds; ++t) {
+          const value_type h = thresholds[num_thresholds-1-t];
+          for (; next != order.size() && enhancer->supra_threshold (in[order[next]], h); ++next) {
+            const size_t element = order[next];
+            parent[element] = element;
+            extent[element] = 1;
+            since[element] = t;
+            enhancer->get_neighbours (element, neighbours);
+            for (auto n : neighbours) {
+              if (parent[n] == not_added)
+                continue;
+              size_t a = find (element), b = find (n);
+              if (a == b)
+                continue;
+              flush (a, t);
+              flush (b, t);
+              if (extent[a] < extent[b])
+                std::swap (a, b);
+              parent[b] = a;
+              accumulated[b] -= accumulated[a];
+              extent[a] += extent[b];
+              link_order.push_back (b);
+            }
+          }
+        }
+
+        // Any element's parent was linked beneath its own parent (if at all)
+        //   after the element itself; resolve totals in reverse order of linking
+        for (auto i : order) {
+          if (parent[i] == i) {
+            flush (i, num_thresholds);
+            out[i] = accumulated[i];
+          }
+        }
+        for (auto i = link_order.rbegin(); i != link_order.rend(); ++i)
+          out[*i] = accumulated[*i] + out[parent[*i]];
+      }
+
+
+
     }
   }
 }
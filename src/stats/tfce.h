@@ -49,6 +49,16 @@ namespace MR
           // Alternative functor that also takes the threshold value;
           //   makes TFCE integration cleaner
           virtual void operator() (in_column_type /*input_statistics*/, const value_type /*threshold*/, out_column_type /*enhanced_statistics*/) const = 0;
+
+          // Enhancers for which the output for each element is the number of
+          //   elements within the connected cluster of supra-threshold elements
+          //   to which it belongs may additionally provide the following; this
+          //   permits Wrapper to integrate over all thresholds within a single
+          //   sweep, rather than re-computing the clusters at every threshold
+          virtual bool provides_adjacency () const { return false; }
+          virtual bool supra_threshold (const value_type value, const value_type threshold) const { return value > threshold; }
+          virtual void get_neighbours (const size_t /*index*/, vector<size_t>& /*neighbours*/) const { assert (0); }
+
           friend class Wrapper;
       };
 
@@ -75,6 +85,12 @@ namespace MR
           value_type dH, E, H;
 
           void operator() (in_column_type, out_column_type) const override;
+
+          // Sort elements by statistic once, then sweep from the highest
+          //   threshold to the lowest, merging clusters within a disjoint-set
+          //   forest as elements are added and accumulating each cluster's
+          //   contribution at the time its extent changes
+          void incremental (in_column_type, out_column_type) const;
       };
 
 
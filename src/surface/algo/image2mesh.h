@@ -18,9 +18,11 @@
 #define __surface_algo_image2mesh_h__
 
 #include <array>
+#include <limits>
 #include <map>
 
 #include "image_helpers.h"
+#include "thread_queue.h"
 #include "transform.h"
 #include "types.h"
 
@@ -144,8 +146,11 @@ namespace MR
 
 
     // Image-to-mesh conversion function using the Marching Cubes algorithm
+    // The image is processed as multiple slabs in parallel unless \a multithreaded
+    //   is false (e.g. if the caller is itself running multiple conversions
+    //   concurrently); the output mesh is identical in either case
     template <class ImageType>
-    void image2mesh_mc (const ImageType& input_image, Mesh& out, const default_type threshold)
+    void image2mesh_mc (const ImageType& input_image, Mesh& out, const default_type threshold, const bool multithreaded = true)
     {
       static const Vox neighbour_offsets[] = { Vox (0, 0, 0),
                                                Vox (1, 0, 0),
@@ -437,89 +442,189 @@ namespace MR
         {0, 3, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
         {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1} };
 
-      VertexList vertices;
-      TriangleList triangles;
-
-      Transform transform (input_image);
+      // For each of the 12 cube edges: the axis along which it lies, and the
+      //   cube vertex at its lower end; together these identify the edge
+      //   uniquely within a dense per-plane lookup table
+      static const uint8_t edge_axis[12]   = { 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2 };
+      static const uint8_t edge_origin[12] = { 0, 1, 3, 0, 4, 5, 7, 4, 0, 1, 2, 3 };
+
+      static const uint32_t invalid_index = std::numeric_limits<uint32_t>::max();
+      // Marks an output vertex index that refers to the top plane of the
+      //   preceding slab, rather than to a vertex generated within this slab
+      static const uint32_t boundary_flag = 0x80000000;
+
+      // The image is processed in slabs of consecutive cube layers along the
+      //   third axis; cube corners span [-1, size] along each axis.
+      // Vertices and triangles are generated within each slab in exactly the
+      //   same order as a single raster scan over the whole image would; any
+      //   vertex lying in the plane shared with the preceding slab is always
+      //   generated by that preceding slab, and is resolved once all slabs are
+      //   complete. The output is therefore independent of the number of slabs.
+      class Slab
+      { NOMEMALIGN
+        public:
+          Slab () : first_layer (0), last_layer (0) { }
+
+          void operator() (const ImageType& input_image, const default_type threshold, const transform_type& voxel2scanner)
+          {
+            ImageType voxel (input_image);
+            const int nx = voxel.size(0), ny = voxel.size(1), nz = voxel.size(2);
+            const size_t row = nx + 2, plane = row * (ny + 2);
+
+            vector<float> below (plane), above (plane);
+            vector<uint32_t> lower_edges (2*plane, invalid_index), upper_edges (2*plane, invalid_index), vertical_edges (plane, invalid_index);
+
+            auto load_plane = [&] (vector<float>& values, const int z) {
+              std::fill (values.begin(), values.end(), 0.0f);
+              if (z < 0 || z >= nz)
+                return;
+              voxel.index(2) = z;
+              for (int y = 0; y != ny; ++y) {
+                voxel.index(1) = y;
+                float* p = values.data() + 1 + row * (y+1);
+                for (int x = 0; x != nx; ++x) {
+                  voxel.index(0) = x;
+                  *p++ = voxel.value();
+                }
+              }
+            };
 
-      ImageType voxel (input_image);
-      float in_vertex_values[8];
-      std::map< Vox, std::map<Vox, size_t> > input_vertex_pair_to_output_vertex_index_map;
-      Vox lower_corner;
-      for (lower_corner[2] = -1; lower_corner[2] != voxel.size(2); ++lower_corner[2]) {
-        for (lower_corner[1] = -1; lower_corner[1] != voxel.size(1); ++lower_corner[1]) {
-          for (lower_corner[0] = -1; lower_corner[0] != voxel.size(0); ++lower_corner[0]) {
-
-            // This is our lower corner for our region of 8 voxels
-            uint8_t code = 0x00;
-            for (size_t neighbour_index = 0; neighbour_index != 8; ++neighbour_index) {
-              assign_pos_of (lower_corner + neighbour_offsets[neighbour_index]).to (voxel);
-              in_vertex_values[neighbour_index] = 0.0f;
-              if (!is_out_of_bounds (voxel))
-                in_vertex_values[neighbour_index] = voxel.value();
-              if (in_vertex_values[neighbour_index] > threshold)
-                code |= (1 << neighbour_index);
+            // Edges in the lowest plane of all but the first slab belong to the preceding slab
+            if (first_layer >= 0) {
+              for (size_t i = 0; i != lower_edges.size(); ++i)
+                lower_edges[i] = boundary_flag | uint32_t(i);
             }
-            // Our code here acts as a lookup index to the table cube_edge_flags
-            const uint32_t edge_flags = cube_edge_flags[code];
-            // Now we find out which edges are intersected, based on this flag
-            // For all relevant output vertices, we need to store the output index
-            //   of that vertex
-            std::array<uint32_t, 12> edge_to_output_vertex;
-            edge_to_output_vertex.fill (0);
-            for (size_t edge_index = 0; edge_index != 12; ++edge_index) {
-              if (edge_flags & (1 << edge_index)) {
-
-                // OK, so now we have two vertices corresponding to this edge
-                // However, we don't want to duplicate vertices
-                // Therefore, need to do a lookup
-                // Remember: we have the lower corner position, and 8 offsets from that
-                std::array<uint8_t, 2> vertex_indices;
-                std::array<Vox,     2> vertex_positions;
-
-                for (size_t i = 0; i != 2; ++i) {
-                  const uint8_t vertex_index = edge_vertices[edge_index][i];
-                  vertex_indices[i] = vertex_index;
-                  vertex_positions[i] = lower_corner + neighbour_offsets[vertex_index];
-                }
-                // Has a vertex already been generated somewhere along this edge?
-                auto lookup_zero_it = input_vertex_pair_to_output_vertex_index_map.find (vertex_positions[0]);
-                if (lookup_zero_it == input_vertex_pair_to_output_vertex_index_map.end())
-                  lookup_zero_it = input_vertex_pair_to_output_vertex_index_map.insert (std::make_pair (vertex_positions[0], std::map<Vox, size_t>())).first;
-                auto lookup_one_it = input_vertex_pair_to_output_vertex_index_map.find (vertex_positions[1]);
-                if (lookup_one_it == input_vertex_pair_to_output_vertex_index_map.end())
-                  lookup_one_it = input_vertex_pair_to_output_vertex_index_map.insert (std::make_pair (vertex_positions[1], std::map<Vox, size_t>())).first;
-                auto& lookup_zero = lookup_zero_it->second;
-                auto& lookup_one  = lookup_one_it ->second;
-                auto existing_zero = lookup_zero.find (vertex_positions[1]);
-                if (existing_zero == lookup_zero.end()) {
-                  lookup_zero.insert (std::make_pair (vertex_positions[1], vertices.size()));
-                  lookup_one .insert (std::make_pair (vertex_positions[0], vertices.size()));
-                  edge_to_output_vertex[edge_index] = vertices.size();
-                  // Calculate the precise position of this vertex, based on the
-                  //   image intensities in the two relevant voxels
-                  const default_type alpha = (threshold - in_vertex_values[vertex_indices[0]]) / (in_vertex_values[vertex_indices[1]] - in_vertex_values[vertex_indices[0]]);
-                  const Vertex pos_voxelspace = vertex_positions[0].cast<default_type>() + (alpha * (vertex_positions[1] - vertex_positions[0]).cast<default_type>());
-                  vertices.push_back (transform.voxel2scanner * pos_voxelspace);
-                } else {
-                  edge_to_output_vertex[edge_index] = existing_zero->second;
-                }
 
+            load_plane (below, first_layer);
+            load_plane (above, first_layer+1);
+
+            float in_vertex_values[8];
+            Vox lower_corner;
+            for (lower_corner[2] = first_layer; lower_corner[2] != last_layer; ++lower_corner[2]) {
+              for (lower_corner[1] = -1; lower_corner[1] != ny; ++lower_corner[1]) {
+                for (lower_corner[0] = -1; lower_corner[0] != nx; ++lower_corner[0]) {
+
+                  // This is our lower corner for our region of 8 voxels
+                  uint8_t code = 0x00;
+                  for (size_t neighbour_index = 0; neighbour_index != 8; ++neighbour_index) {
+                    const Vox& offset (neighbour_offsets[neighbour_index]);
+                    const size_t corner = (lower_corner[0]+1+offset[0]) + row * (lower_corner[1]+1+offset[1]);
+                    in_vertex_values[neighbour_index] = offset[2] ? above[corner] : below[corner];
+                    if (in_vertex_values[neighbour_index] > threshold)
+                      code |= (1 << neighbour_index);
+                  }
+                  // Our code here acts as a lookup index to the table cube_edge_flags
+                  const uint32_t edge_flags = cube_edge_flags[code];
+                  if (!edge_flags)
+                    continue;
+
+                  // For all intersected edges, find or generate the output vertex index
+                  std::array<uint32_t, 12> edge_to_output_vertex;
+                  edge_to_output_vertex.fill (0);
+                  for (size_t edge_index = 0; edge_index != 12; ++edge_index) {
+                    if (edge_flags & (1 << edge_index)) {
+
+                      const Vox& origin (neighbour_offsets[edge_origin[edge_index]]);
+                      const size_t corner = (lower_corner[0]+1+origin[0]) + row * (lower_corner[1]+1+origin[1]);
+                      uint32_t& lookup = edge_axis[edge_index] == 2 ?
+                                         vertical_edges[corner] :
+                                         (origin[2] ? upper_edges : lower_edges)[2*corner + edge_axis[edge_index]];
+
+                      // Has a vertex already been generated somewhere along this edge?
+                      if (lookup == invalid_index) {
+                        std::array<uint8_t, 2> vertex_indices;
+                        std::array<Vox,     2> vertex_positions;
+                        for (size_t i = 0; i != 2; ++i) {
+                          const uint8_t vertex_index = edge_vertices[edge_index][i];
+                          vertex_indices[i] = vertex_index;
+                          vertex_positions[i] = lower_corner + neighbour_offsets[vertex_index];
+                        }
+                        lookup = vertices.size();
+                        // Calculate the precise position of this vertex, based on the
+                        //   image intensities in the two relevant voxels
+                        const default_type alpha = (threshold - in_vertex_values[vertex_indices[0]]) / (in_vertex_values[vertex_indices[1]] - in_vertex_values[vertex_indices[0]]);
+                        const Vertex pos_voxelspace = vertex_positions[0].cast<default_type>() + (alpha * (vertex_positions[1] - vertex_positions[0]).cast<default_type>());
+                        vertices.push_back (voxel2scanner * pos_voxelspace);
+                      }
+                      edge_to_output_vertex[edge_index] = lookup;
+
+                    }
+                  }
+
+                  // Based on the code for this voxel, now we use the table cube_triangle_table to see
+                  //   which edges need to have triangles constructed from the relevant generated vertices
+                  // Note that flipping the last two vertex indices is deliberate; the provided
+                  //   lookup table does not use a right-hand rule axis convention, so this is necessary
+                  //   to calculate the correct surface normals
+                  for (const int8_t* first_edge = cube_triangle_table[code]; *first_edge >= 0; first_edge += 3)
+                    triangles.push_back ({ edge_to_output_vertex[*first_edge], edge_to_output_vertex[*(first_edge+2)], edge_to_output_vertex[*(first_edge+1)] });
+
+                }
               }
-            }
 
-            // OK, so now the relevant edges have an output vertex index associated with them
-            // Based on the code for this voxel, now we use the table cube_triangle_table to see
-            //   which edges need to have triangles constructed from the relevant generated vertices
-            // Note that flipping the last two vertex indices is deliberate; the provided
-            //   lookup table does not use a right-hand rule axis convention, so this is necessary
-            //   to calculate the correct surface normals
-            for (const int8_t* first_edge = cube_triangle_table[code]; *first_edge >= 0; first_edge += 3) {
-              const uint32_t indices[3] { edge_to_output_vertex[*first_edge], edge_to_output_vertex[*(first_edge+2)], edge_to_output_vertex[*(first_edge+1)] };
-              triangles.push_back (Triangle (indices));
+              // Move up one layer
+              std::swap (lower_edges, upper_edges);
+              std::fill (upper_edges.begin(), upper_edges.end(), invalid_index);
+              std::fill (vertical_edges.begin(), vertical_edges.end(), invalid_index);
+              std::swap (below, above);
+              load_plane (above, lower_corner[2]+2);
             }
 
-      } } } // Finished looping over all voxels in the input image
+            top_edges = std::move (lower_edges);
+          }
+
+          int first_layer, last_layer;
+          VertexList vertices;
+          vector<std::array<uint32_t, 3>> triangles;
+          vector<uint32_t> top_edges;
+      };
+
+      Transform transform (input_image);
+      const int num_layers = input_image.size(2) + 1;
+      const int num_slabs = multithreaded ? std::max (1, std::min (num_layers, int(2 * Thread::number_of_threads()))) : 1;
+
+      vector<Slab> slabs (num_slabs);
+      for (int i = 0; i != num_slabs; ++i) {
+        slabs[i].first_layer = -1 + (i * num_layers) / num_slabs;
+        slabs[i].last_layer  = -1 + ((i+1) * num_layers) / num_slabs;
+      }
+
+      if (num_slabs == 1) {
+        slabs[0] (input_image, threshold, transform.voxel2scanner);
+      } else {
+        size_t next_slab = 0;
+        auto source = [&] (size_t& out) { out = next_slab++; return (out < slabs.size()); };
+        auto sink = [&] (const size_t& in) { slabs[in] (input_image, threshold, transform.voxel2scanner); return true; };
+        Thread::run_queue (source, size_t(), Thread::multi (sink));
+      }
+
+      // Stitch the slabs together: local vertex indices are offset by the
+      //   number of vertices generated by all preceding slabs, and references
+      //   to the top plane of the preceding slab are resolved
+      VertexList vertices;
+      TriangleList triangles;
+      vector<size_t> offsets (num_slabs, 0);
+      for (int i = 0; i != num_slabs; ++i) {
+        offsets[i] = vertices.size();
+        vertices.insert (vertices.end(), slabs[i].vertices.begin(), slabs[i].vertices.end());
+        VertexList().swap (slabs[i].vertices);
+      }
+      for (int i = 0; i != num_slabs; ++i) {
+        for (const auto& t : slabs[i].triangles) {
+          uint32_t indices[3];
+          for (size_t v = 0; v != 3; ++v) {
+            if (t[v] & boundary_flag) {
+              assert (i > 0);
+              const uint32_t previous = slabs[i-1].top_edges[t[v] & ~boundary_flag];
+              assert (previous != invalid_index);
+              indices[v] = offsets[i-1] + previous;
+            } else {
+              indices[v] = offsets[i] + t[v];
+            }
+          }
+          triangles.push_back (Triangle (indices));
+        }
+      }
 
       // Write the result to the output class
       out.load (vertices, triangles);
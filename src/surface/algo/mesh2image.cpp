@@ -16,12 +16,14 @@
 
 #include "surface/algo/mesh2image.h"
 
-#include <map>
+#include <mutex>
 
 #include "header.h"
 #include "progressbar.h"
 #include "thread_queue.h"
 #include "types.h"
+#include "algo/threaded_loop.h"
+#include "misc/union_find.h"
 
 #include "surface/types.h"
 #include "surface/utils.h"
@@ -39,6 +41,77 @@ namespace MR
       constexpr size_t pve_nsamples = Math::pow3 (pve_os_ratio);
 
 
+
+      namespace {
+
+        // Use the Separating Axis Theorem to determine whether or not a polygon
+        //   intersects a particular voxel
+        bool overlap (const VertexList& vertices, const Eigen::Vector3d& polygon_normal, const Vox& vox)
+        {
+          const size_t num_vertices = vertices.size();
+
+          // Test whether or not the two objects can be separated via projection onto an axis
+          auto separating_axis = [&] (const Eigen::Vector3d& axis) -> bool {
+            default_type voxel_low  =  std::numeric_limits<default_type>::infinity();
+            default_type voxel_high = -std::numeric_limits<default_type>::infinity();
+            default_type poly_low   =  std::numeric_limits<default_type>::infinity();
+            default_type poly_high  = -std::numeric_limits<default_type>::infinity();
+
+            static const Eigen::Vector3d voxel_offsets[8] = { { -0.5, -0.5, -0.5 },
+                                                             { -0.5, -0.5,  0.5 },
+                                                             { -0.5,  0.5, -0.5 },
+                                                             { -0.5,  0.5,  0.5 },
+                                                             {  0.5, -0.5, -0.5 },
+                                                             {  0.5, -0.5,  0.5 },
+                                                             {  0.5,  0.5, -0.5 },
+                                                             {  0.5,  0.5,  0.5 } };
+
+            for (size_t i = 0; i != 8; ++i) {
+              const Eigen::Vector3d v (vox.matrix().cast<default_type>() + voxel_offsets[i]);
+              const default_type projection = axis.dot (v);
+              voxel_low  = std::min (voxel_low,  projection);
+              voxel_high = std::max (voxel_high, projection);
+            }
+
+            for (const auto& v : vertices) {
+              const default_type projection = axis.dot (v);
+              poly_low  = std::min (poly_low,  projection);
+              poly_high = std::max (poly_high, projection);
+            }
+
+            // Is this a separating axis?
+            return (poly_low > voxel_high || voxel_low > poly_high);
+          };
+
+          // The following axes need to be tested as potential separating axes:
+          //   x, y, z
+          //   All cross-products between voxel and polygon edges
+          //   Polygon normal
+          for (size_t i = 0; i != 3; ++i) {
+            Eigen::Vector3d axis (0.0, 0.0, 0.0);
+            axis[i] = 1.0;
+            if (separating_axis (axis))
+              return false;
+            for (size_t j = 0; j != num_vertices-1; ++j) {
+              if (separating_axis (axis.cross (vertices[j+1] - vertices[j])))
+                return false;
+            }
+            if (separating_axis (axis.cross (vertices[num_vertices-1] - vertices[0])))
+              return false;
+          }
+          if (separating_axis (polygon_normal))
+            return false;
+
+          // No axis has been found that separates the two objects
+          // Therefore, the two objects overlap
+          return true;
+        }
+
+      }
+
+
+
+
       void mesh2image (const Mesh& mesh_realspace, Image<float>& image)
       {
 
@@ -50,8 +123,7 @@ namespace MR
         vector<Eigen::Vector3d> polygon_normals;
 
         // For every edge voxel, stores those polygons that may intersect the voxel
-        using Vox2Poly = std::map< Vox, vector<size_t> >;
-        Vox2Poly voxel2poly;
+        Voxel2Poly voxel2poly;
 
         {
           ProgressBar progress ("Performing voxel-based segmentation of surface", 8);
@@ -65,13 +137,6 @@ namespace MR
           if (!mesh.have_normals())
             mesh.calculate_normals();
 
-          static const Vox adj_voxels[6] = { { -1,  0,  0 },
-                                             { +1,  0,  0 },
-                                             {  0, -1,  0 },
-                                             {  0, +1,  0 },
-                                             {  0,  0, -1 },
-                                             {  0,  0, +1 } };
-
           // Compute normals for polygons
           polygon_normals.reserve (mesh.num_polygons());
           for (TriangleList::const_iterator p = mesh.get_triangles().begin(); p != mesh.get_triangles().end(); ++p)
@@ -80,135 +145,79 @@ namespace MR
             polygon_normals.push_back (normal (mesh, *p));
           ++progress;
 
-          // Create some memory to work with:
-          // Stores a flag for each voxel as encoded in enum vox_mesh_t
+          // Work on flat arrays indexed by linear voxel index, so that these
+          //   can be processed concurrently without needing per-thread image access
           Header H (image);
-          H.datatype() = DataType::UInt8;
-          auto init_seg = Image<uint8_t>::scratch (H);
-          for (auto l = Loop(init_seg) (init_seg); l; ++l)
-            init_seg.value() = vox_mesh_t::UNDEFINED;
-
-          // Map each polygon to the underlying voxels
-          for (size_t poly_index = 0; poly_index != mesh.num_polygons(); ++poly_index) {
-
-            const size_t num_vertices = (poly_index < mesh.num_triangles()) ? 3 : 4;
-
-            // Figure out the voxel extent of this polygon in three dimensions
-            Vox lower_bound (H.size(0)-1, H.size(1)-1, H.size(2)-1), upper_bound (0, 0, 0);
-            VertexList this_poly_verts;
-            if (num_vertices == 3)
-              mesh.load_triangle_vertices (this_poly_verts, poly_index);
-            else
-              mesh.load_quad_vertices (this_poly_verts, poly_index - mesh.num_triangles());
-            for (VertexList::const_iterator v = this_poly_verts.begin(); v != this_poly_verts.end(); ++v) {
-              for (size_t axis = 0; axis != 3; ++axis) {
-                const int this_axis_voxel = std::round((*v)[axis]);
-                lower_bound[axis] = std::min (lower_bound[axis], this_axis_voxel);
-                upper_bound[axis] = std::max (upper_bound[axis], this_axis_voxel);
-              }
-            }
+          const size_t nx = H.size(0), ny = H.size(1), nz = H.size(2);
+          const size_t num_voxels = nx * ny * nz;
+          auto linear_index = [&] (const Vox& v) -> size_t { return v[0] + nx * (v[1] + ny * v[2]); };
 
-            // Constrain to lie within the dimensions of the image
-            for (size_t axis = 0; axis != 3; ++axis) {
-              lower_bound[axis] = std::max(0,                   lower_bound[axis]);
-              upper_bound[axis] = std::min(int(H.size(axis)-1), upper_bound[axis]);
-            }
+          // Stores a flag for each voxel as encoded in enum vox_mesh_t
+          vector<uint8_t> init_seg (num_voxels, vox_mesh_t::UNDEFINED);
+
+          // Map each polygon to the underlying voxels; this is done for multiple polygons in parallel
+          {
+            vector<std::pair<size_t, size_t>> voxel_poly_pairs;
+
+            size_t next_polygon = 0;
+            auto source = [&] (size_t& out) { out = next_polygon++; return (out < mesh.num_polygons()); };
+
+            auto pipe = [&] (const size_t& poly_index, std::pair<size_t, vector<size_t>>& out)
+            {
+              out.first = poly_index;
+              out.second.clear();
 
-            // For all voxels within this rectangular region, assign this polygon to the map
-            // Use the Separating Axis Theorem to be more stringent as to which voxels this
-            //   polygon will be processed in
-            auto overlap = [&] (const Vox& vox, const size_t poly_index) -> bool {
+              const size_t num_vertices = (poly_index < mesh.num_triangles()) ? 3 : 4;
 
-              VertexList vertices;
+              // Figure out the voxel extent of this polygon in three dimensions
+              Vox lower_bound (H.size(0)-1, H.size(1)-1, H.size(2)-1), upper_bound (0, 0, 0);
+              VertexList this_poly_verts;
               if (num_vertices == 3)
-                mesh.load_triangle_vertices (vertices, poly_index);
+                mesh.load_triangle_vertices (this_poly_verts, poly_index);
               else
-                mesh.load_quad_vertices (vertices, poly_index - mesh.num_triangles());
-
-              // Test whether or not the two objects can be separated via projection onto an axis
-              auto separating_axis = [&] (const Eigen::Vector3d& axis) -> bool {
-                default_type voxel_low  =  std::numeric_limits<default_type>::infinity();
-                default_type voxel_high = -std::numeric_limits<default_type>::infinity();
-                default_type poly_low   =  std::numeric_limits<default_type>::infinity();
-                default_type poly_high  = -std::numeric_limits<default_type>::infinity();
-
-                static const Eigen::Vector3d voxel_offsets[8] = { { -0.5, -0.5, -0.5 },
-                                                                 { -0.5, -0.5,  0.5 },
-                                                                 { -0.5,  0.5, -0.5 },
-                                                                 { -0.5,  0.5,  0.5 },
-                                                                 {  0.5, -0.5, -0.5 },
-                                                                 {  0.5, -0.5,  0.5 },
-                                                                 {  0.5,  0.5, -0.5 },
-                                                                 {  0.5,  0.5,  0.5 } };
-
-                for (size_t i = 0; i != 8; ++i) {
-                  const Eigen::Vector3d v (vox.matrix().cast<default_type>() + voxel_offsets[i]);
-                  const default_type projection = axis.dot (v);
-                  voxel_low  = std::min (voxel_low,  projection);
-                  voxel_high = std::max (voxel_high, projection);
-                }
-
-                for (const auto& v : vertices) {
-                  const default_type projection = axis.dot (v);
-                  poly_low  = std::min (poly_low,  projection);
-                  poly_high = std::max (poly_high, projection);
+                mesh.load_quad_vertices (this_poly_verts, poly_index - mesh.num_triangles());
+              for (VertexList::const_iterator v = this_poly_verts.begin(); v != this_poly_verts.end(); ++v) {
+                for (size_t axis = 0; axis != 3; ++axis) {
+                  const int this_axis_voxel = std::round((*v)[axis]);
+                  lower_bound[axis] = std::min (lower_bound[axis], this_axis_voxel);
+                  upper_bound[axis] = std::max (upper_bound[axis], this_axis_voxel);
                 }
+              }
 
-                // Is this a separating axis?
-                return (poly_low > voxel_high || voxel_low > poly_high);
-              };
-
-              // The following axes need to be tested as potential separating axes:
-              //   x, y, z
-              //   All cross-products between voxel and polygon edges
-              //   Polygon normal
-              for (size_t i = 0; i != 3; ++i) {
-                Eigen::Vector3d axis (0.0, 0.0, 0.0);
-                axis[i] = 1.0;
-                if (separating_axis (axis))
-                  return false;
-                for (size_t j = 0; j != num_vertices-1; ++j) {
-                  if (separating_axis (axis.cross (vertices[j+1] - vertices[j])))
-                    return false;
-                }
-                if (separating_axis (axis.cross (vertices[num_vertices-1] - vertices[0])))
-                  return false;
+              // Constrain to lie within the dimensions of the image
+              for (size_t axis = 0; axis != 3; ++axis) {
+                lower_bound[axis] = std::max(0,                   lower_bound[axis]);
+                upper_bound[axis] = std::min(int(H.size(axis)-1), upper_bound[axis]);
               }
-              if (separating_axis (polygon_normals[poly_index]))
-                return false;
 
-              // No axis has been found that separates the two objects
-              // Therefore, the two objects overlap
+              // Rather than testing this polygon for every single voxel within this 3D
+              //   bounding box, only test it within those voxels that the polygon actually intersects
+              Vox voxel;
+              for (voxel[2] = lower_bound[2]; voxel[2] <= upper_bound[2]; ++voxel[2]) {
+                for (voxel[1] = lower_bound[1]; voxel[1] <= upper_bound[1]; ++voxel[1]) {
+                  for (voxel[0] = lower_bound[0]; voxel[0] <= upper_bound[0]; ++voxel[0]) {
+                    if (overlap (this_poly_verts, polygon_normals[poly_index], voxel))
+                      out.second.push_back (linear_index (voxel));
+                  } } }
               return true;
             };
 
-            Vox voxel;
-            for (voxel[2] = lower_bound[2]; voxel[2] <= upper_bound[2]; ++voxel[2]) {
-              for (voxel[1] = lower_bound[1]; voxel[1] <= upper_bound[1]; ++voxel[1]) {
-                for (voxel[0] = lower_bound[0]; voxel[0] <= upper_bound[0]; ++voxel[0]) {
-                  // Rather than adding this polygon to the list of polygons to test for
-                  //   every single voxel within this 3D bounding box, only test it within
-                  //   those voxels that the polygon actually intersects
-                  if (overlap (voxel, poly_index)) {
-                    vector<size_t> this_voxel_polys;
-                    // Has this voxel already been intersected by at least one polygon?
-                    // If it has, we need to concatenate this polygon to the list
-                    //   (which involves deleting the existing entry then re-writing the concatenated list);
-                    // If it has not, we're adding a new entry to the list of voxels to be tested,
-                    //   with only one entry in the list for that voxel
-                    Vox2Poly::const_iterator existing = voxel2poly.find (voxel);
-                    if (existing != voxel2poly.end()) {
-                      this_voxel_polys = existing->second;
-                      voxel2poly.erase (existing);
-                    } else {
-                      // Only call this once each voxel, regardless of the number of intersecting polygons
-                      assign_pos_of (voxel).to (init_seg);
-                      init_seg.value() = vox_mesh_t::ON_MESH;
-                    }
-                    this_voxel_polys.push_back (poly_index);
-                    voxel2poly.insert (std::make_pair (voxel, this_voxel_polys));
-                  } } } }
+            auto sink = [&] (const std::pair<size_t, vector<size_t>>& in)
+            {
+              for (auto v : in.second) {
+                voxel_poly_pairs.push_back (std::make_pair (v, in.first));
+                init_seg[v] = vox_mesh_t::ON_MESH;
+              }
+              return true;
+            };
 
+            Thread::run_queue (source,
+                               Thread::batch (size_t()),
+                               Thread::multi (pipe),
+                               Thread::batch (std::pair<size_t, vector<size_t>>()),
+                               sink);
+
+            voxel2poly.set (voxel_poly_pairs, H);
           }
           ++progress;
 
@@ -218,9 +227,7 @@ namespace MR
           //   by the normal at the vertex.
           // Each voxel not directly on the mesh should then be assigned as prelim_inside or prelim_outside
           //   depending on whether the summed value is positive or negative
-          H.datatype() = DataType::Float32;
-          H.datatype().set_byte_order_native();
-          auto sum_distances = Image<float>::scratch (H, "Sum of distances from polygon planes");
+          vector<float> sum_distances (num_voxels, 0.0f);
           Vox adj_voxel;
           for (size_t i = 0; i != mesh.num_vertices(); ++i) {
             const Vox centre_voxel (mesh.vert(i));
@@ -231,154 +238,186 @@ namespace MR
                     const Eigen::Vector3d offset (adj_voxel.cast<default_type>().matrix() - mesh.vert(i));
                     const default_type dp_normal = offset.dot (mesh.norm(i));
                     const default_type offset_on_plane = (offset - (mesh.norm(i) * dp_normal)).norm();
-                    assign_pos_of (adj_voxel).to (sum_distances);
                     // If offset_on_plane is close to zero, this vertex should contribute strongly toward
                     //   the sum of distances from the surface within this voxel
-                    sum_distances.value() += (1.0 / (1.0 + offset_on_plane)) * dp_normal;
+                    sum_distances[linear_index (adj_voxel)] += (1.0 / (1.0 + offset_on_plane)) * dp_normal;
                   }
                 }
               }
             }
           }
           ++progress;
-          for (auto l = Loop(init_seg) (init_seg, sum_distances); l; ++l) {
-            if (static_cast<float> (sum_distances.value()) != 0.0f && init_seg.value() != vox_mesh_t::ON_MESH)
-              init_seg.value() = sum_distances.value() < 0.0 ? vox_mesh_t::PRELIM_INSIDE : vox_mesh_t::PRELIM_OUTSIDE;
+          for (size_t i = 0; i != num_voxels; ++i) {
+            if (sum_distances[i] != 0.0f && init_seg[i] != vox_mesh_t::ON_MESH)
+              init_seg[i] = sum_distances[i] < 0.0f ? vox_mesh_t::PRELIM_INSIDE : vox_mesh_t::PRELIM_OUTSIDE;
           }
           ++progress;
 
 
           // Can't guarantee that mesh might have a single isolated polygon pointing the wrong way
           // Therefore, need to:
-          //   - Select voxels both inside and outside the mesh to expand
-          //   - When expanding each region, count the number of pre-assigned voxels both inside and outside
+          //   - Identify the connected regions of voxels not lying on the mesh
+          //   - For each region, count the number of pre-assigned voxels both inside and outside
           //   - For the final region selection, assign values to voxels based on a majority vote
-          Image<uint8_t> seed (init_seg);
-          vector<Vox> to_fill;
-          std::stack<Vox> to_expand;
-          for (auto l = Loop(seed) (seed); l; ++l) {
-            if (seed.value() == vox_mesh_t::PRELIM_INSIDE || seed.value() == vox_mesh_t::PRELIM_OUTSIDE) {
-              size_t prelim_inside_count = 0, prelim_outside_count = 0;
-              float sum_sum_distances = 0.0f;
-              if (seed.value() == vox_mesh_t::PRELIM_INSIDE)
-                prelim_inside_count = 1;
-              else
-                prelim_outside_count = 1;
-              to_expand.push (Vox (seed.index(0), seed.index(1), seed.index(2)));
-              to_fill.assign (1, to_expand.top());
-              do {
-                const Vox voxel (to_expand.top());
-                to_expand.pop();
-                for (size_t adj_vox_idx = 0; adj_vox_idx != 6; ++adj_vox_idx) {
-                  const Vox adj_voxel (voxel + adj_voxels[adj_vox_idx]);
-                  assign_pos_of (adj_voxel).to (init_seg);
-                  if (!is_out_of_bounds (init_seg)) {
-                    const uint8_t adj_value = init_seg.value();
-                    if (adj_value == vox_mesh_t::UNDEFINED || adj_value == vox_mesh_t::PRELIM_INSIDE || adj_value == vox_mesh_t::PRELIM_OUTSIDE) {
-                      if (adj_value == vox_mesh_t::PRELIM_INSIDE)
-                        ++prelim_inside_count;
-                      else if (adj_value == vox_mesh_t::PRELIM_OUTSIDE)
-                        ++prelim_outside_count;
-                      assign_pos_of (init_seg).to (sum_distances);
-                      sum_sum_distances += sum_distances.value();
-                      to_expand.push (adj_voxel);
-                      to_fill.push_back (adj_voxel);
-                      init_seg.value() = vox_mesh_t::FILL_TEMP;
-                    }
-                  }
+          // The regions are identified by concurrently merging each such voxel with its
+          //   preceding neighbours along each axis, processing multiple slices in parallel
+          UnionFind regions (num_voxels);
+          {
+            size_t next_slice = 0;
+            auto source = [&] (size_t& out) { out = next_slice++; return (out < nz); };
+            auto sink = [&] (const size_t& z)
+            {
+              size_t i = nx * ny * z;
+              for (size_t y = 0; y != ny; ++y) {
+                for (size_t x = 0; x != nx; ++x, ++i) {
+                  if (init_seg[i] == vox_mesh_t::ON_MESH)
+                    continue;
+                  if (x && init_seg[i-1] != vox_mesh_t::ON_MESH)
+                    regions.merge (i, i-1);
+                  if (y && init_seg[i-nx] != vox_mesh_t::ON_MESH)
+                    regions.merge (i, i-nx);
+                  if (z && init_seg[i-nx*ny] != vox_mesh_t::ON_MESH)
+                    regions.merge (i, i-nx*ny);
                 }
-              } while (to_expand.size());
-              vox_mesh_t fill_value = vox_mesh_t::UNDEFINED;
-              if (prelim_inside_count == prelim_outside_count && sum_sum_distances) {
-                fill_value = sum_sum_distances < 0.0f ? vox_mesh_t::INSIDE : vox_mesh_t::OUTSIDE;
-              } else if (prelim_inside_count > 10 * prelim_outside_count) {
-                fill_value = vox_mesh_t::INSIDE;
-              } else if (prelim_outside_count > 10 * prelim_inside_count) {
+              }
+              return true;
+            };
+            Thread::run_queue (source, size_t(), Thread::multi (sink));
+          }
+
+          // Accumulate the relevant statistics for each region
+          // Each voxel contributes exactly once to the statistics of its region, and the
+          //   distances are summed in double precision, so that the outcome does not depend
+          //   on the order in which the voxels of a region are visited
+          class Region
+          { NOMEMALIGN
+            public:
+              Region () : prelim_inside_count (0), prelim_outside_count (0), corner_count (0), size (0), sum_sum_distances (0.0) { }
+              size_t prelim_inside_count, prelim_outside_count, corner_count, size;
+              double sum_sum_distances;
+          };
+          vector<Region> region_data;
+          vector<uint32_t> region_index (num_voxels, std::numeric_limits<uint32_t>::max());
+          for (size_t i = 0; i != num_voxels; ++i) {
+            if (init_seg[i] == vox_mesh_t::ON_MESH)
+              continue;
+            // Roots always have the lowest index within their region, and are therefore encountered first
+            const size_t root = regions.find (i);
+            if (root == i) {
+              region_index[i] = region_data.size();
+              region_data.push_back (Region());
+            } else {
+              region_index[i] = region_index[root];
+            }
+            Region& region (region_data[region_index[i]]);
+            ++region.size;
+            if (init_seg[i] == vox_mesh_t::PRELIM_INSIDE)
+              ++region.prelim_inside_count;
+            else if (init_seg[i] == vox_mesh_t::PRELIM_OUTSIDE)
+              ++region.prelim_outside_count;
+            region.sum_sum_distances += sum_distances[i];
+          }
+          // If all eight corners of the FoV are included in a region, we can be
+          //   reasonably confident that this connected region lies outside the structure
+          {
+            vector<size_t> corners;
+            for (size_t z = 0; z != 2; ++z)
+              for (size_t y = 0; y != 2; ++y)
+                for (size_t x = 0; x != 2; ++x)
+                  corners.push_back (linear_index (Vox (x ? nx-1 : 0, y ? ny-1 : 0, z ? nz-1 : 0)));
+            std::sort (corners.begin(), corners.end());
+            corners.erase (std::unique (corners.begin(), corners.end()), corners.end());
+            for (auto i : corners) {
+              if (init_seg[i] != vox_mesh_t::ON_MESH)
+                ++region_data[region_index[i]].corner_count;
+            }
+          }
+
+          // Decide for each region whether it lies inside or outside the structure
+          vector<uint8_t> region_fill_value (region_data.size(), vox_mesh_t::UNDEFINED);
+          for (size_t r = 0; r != region_data.size(); ++r) {
+            const Region& region (region_data[r]);
+            // Regions containing no preliminary classifications are filled later
+            if (!region.prelim_inside_count && !region.prelim_outside_count)
+              continue;
+            vox_mesh_t fill_value = vox_mesh_t::UNDEFINED;
+            if (region.prelim_inside_count == region.prelim_outside_count && region.sum_sum_distances) {
+              fill_value = region.sum_sum_distances < 0.0 ? vox_mesh_t::INSIDE : vox_mesh_t::OUTSIDE;
+            } else if (region.prelim_inside_count > 10 * region.prelim_outside_count) {
+              fill_value = vox_mesh_t::INSIDE;
+            } else if (region.prelim_outside_count > 10 * region.prelim_inside_count) {
+              fill_value = vox_mesh_t::OUTSIDE;
+            } else {
+              // Residual ambiguity about whether the connected region is inside or outside the surface
+              if (region.corner_count == 8) {
                 fill_value = vox_mesh_t::OUTSIDE;
+              } else if (!region.corner_count) {
+                fill_value = vox_mesh_t::INSIDE;
+              } else if (region.sum_sum_distances) {
+                fill_value = region.sum_sum_distances < 0.0 ? vox_mesh_t::INSIDE : vox_mesh_t::OUTSIDE;
               } else {
-                // Residual ambiguity about whether the connected region is inside or outside the surface
-                // What other tests can we perform to make this decision?
-                // If all eight corners of the FoV are included in to_fill, we can be
-                //   reasonably confident that this connected region lies outside the structure
-                size_t corner_count = 0;
-                for (const auto& voxel : to_fill) {
-                  if ((voxel[0] == 0 || voxel[0] == H.size(0) - 1) &&
-                      (voxel[1] == 0 || voxel[1] == H.size(1) - 1) &&
-                      (voxel[2] == 0 || voxel[2] == H.size(2) - 1))
-                    ++corner_count;
-                }
-                if (corner_count == 8) {
-                  fill_value = vox_mesh_t::OUTSIDE;
-                } else if (!corner_count) {
-                  fill_value = vox_mesh_t::INSIDE;
-                } else if (sum_sum_distances) {
-                  fill_value = sum_sum_distances < 0.0f ? vox_mesh_t::INSIDE : vox_mesh_t::OUTSIDE;
-                } else {
-                  Exception e ("Internal error: fundamental ambiguity in voxel-based segmentation of surface");
-                  e.push_back ("Fill region size: " + str(to_fill.size()));
-                  e.push_back ("Preliminary classifications: " + str(prelim_inside_count) + " inside, " + str(prelim_outside_count) + " outside");
-                  e.push_back ("FoV corners: " + str(corner_count));
-                  throw e;
-                }
-              }
-              for (const auto& voxel : to_fill) {
-                assign_pos_of (voxel).to (init_seg);
-                init_seg.value() = fill_value;
+                Exception e ("Internal error: fundamental ambiguity in voxel-based segmentation of surface");
+                e.push_back ("Fill region size: " + str(region.size));
+                e.push_back ("Preliminary classifications: " + str(region.prelim_inside_count) + " inside, " + str(region.prelim_outside_count) + " outside");
+                e.push_back ("FoV corners: " + str(region.corner_count));
+                throw e;
               }
-              to_fill.clear();
             }
+            region_fill_value[r] = fill_value;
           }
           ++progress;
 
           // Any voxel not yet processed must lie outside the structure(s)
-          for (auto l = Loop(init_seg) (init_seg); l; ++l) {
-            if (init_seg.value() == vox_mesh_t::UNDEFINED)
-              init_seg.value() = vox_mesh_t::OUTSIDE;
+          for (size_t i = 0; i != num_voxels; ++i) {
+            if (init_seg[i] != vox_mesh_t::ON_MESH) {
+              const uint8_t fill_value = region_fill_value[region_index[i]];
+              init_seg[i] = fill_value == vox_mesh_t::UNDEFINED ? vox_mesh_t::OUTSIDE : fill_value;
+            }
           }
           ++progress;
 
           // Write initial ternary segmentation
-          for (auto l = Loop (init_seg) (init_seg, image); l; ++l) {
-            switch (init_seg.value()) {
+          ThreadedLoop (image, 0, 3).run ([&] (Image<float>& out) {
+            switch (init_seg[out.index(0) + nx * (out.index(1) + ny * out.index(2))]) {
               case vox_mesh_t (UNDEFINED): throw Exception ("Code error: poor filling of initial mesh estimate"); break;
-              case vox_mesh_t (ON_MESH):   image.value() = 0.5; break;
-              case vox_mesh_t (OUTSIDE):   image.value() = 0.0; break;
-              case vox_mesh_t (INSIDE):    image.value() = 1.0; break;
+              case vox_mesh_t (ON_MESH):   out.value() = 0.5; break;
+              case vox_mesh_t (OUTSIDE):   out.value() = 0.0; break;
+              case vox_mesh_t (INSIDE):    out.value() = 1.0; break;
               default: assert (0);
             }
-          }
+          }, image);
 
         }
 
         // Construct class functors necessary to calculate, for each voxel intersected by the
         //   surface, the partial volume fraction
         class Source
-        { MEMALIGN(Source)
+        { NOMEMALIGN
           public:
-            Source (const Vox2Poly& data) :
+            Source (const Voxel2Poly& data) :
                 data (data),
-                i (data.begin()) { }
+                i (0) { }
 
-            bool operator() (std::pair<Vox, vector<size_t>>& out)
+            bool operator() (size_t& out)
             {
-              if (i == data.end())
+              if (i == data.size())
                 return false;
-              out = std::make_pair (i->first, i->second);
-              ++i;
+              out = i++;
               return true;
             }
 
           private:
-            const Vox2Poly& data;
-            Vox2Poly::const_iterator i;
+            const Voxel2Poly& data;
+            size_t i;
         };
 
         class Pipe
         { NOMEMALIGN
           public:
-            Pipe (const Mesh& mesh, const vector<Eigen::Vector3d>& polygon_normals) :
+            Pipe (const Mesh& mesh, const vector<Eigen::Vector3d>& polygon_normals, const Voxel2Poly& voxel2poly) :
                 mesh (mesh),
-                polygon_normals (polygon_normals)
+                polygon_normals (polygon_normals),
+                voxel2poly (voxel2poly)
 
             {
               // Generate a set of points within this voxel that need to be tested individually
@@ -396,9 +435,9 @@ namespace MR
               }
             }
 
-            bool operator() (const std::pair<Vox, vector<size_t>>& in, std::pair<Vox, float>& out) const
+            bool operator() (const size_t& in, std::pair<Vox, float>& out) const
             {
-              const Vox& voxel (in.first);
+              const Vox& voxel (voxel2poly.voxel (in));
 
               // Count the number of these points that lie inside the mesh
               size_t inside_mesh_count = 0;
@@ -411,7 +450,7 @@ namespace MR
                 default_type best_min_distance_from_interior_projection = std::numeric_limits<default_type>::infinity();
 
                 // Only test against those polygons that are near this voxel
-                for (vector<size_t>::const_iterator polygon_index = in.second.begin(); polygon_index != in.second.end(); ++polygon_index) {
+                for (const size_t* polygon_index = voxel2poly.begin (in); polygon_index != voxel2poly.end (in); ++polygon_index) {
                   const Eigen::Vector3d& n (polygon_normals[*polygon_index]);
 
                   const size_t polygon_num_vertices = (*polygon_index < mesh.num_triangles()) ? 3 : 4;
@@ -517,6 +556,7 @@ namespace MR
           private:
             const Mesh& mesh;
             const vector<Eigen::Vector3d>& polygon_normals;
+            const Voxel2Poly& voxel2poly;
 
             std::shared_ptr<vector<Eigen::Vector3d>> offsets_to_test;
 
@@ -545,11 +585,11 @@ namespace MR
         };
 
         Source source (voxel2poly);
-        Pipe pipe (mesh, polygon_normals);
+        Pipe pipe (mesh, polygon_normals, voxel2poly);
         Sink sink (image, voxel2poly.size());
 
         Thread::run_queue (source,
-                           std::pair<Vox, vector<size_t>>(),
+                           size_t(),
                            Thread::multi (pipe),
                            std::pair<Vox, float>(),
                            sink);
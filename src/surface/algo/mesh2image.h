@@ -18,9 +18,11 @@
 #define __surface_algo_mesh2image_h__
 
 
+#include "header.h"
 #include "image.h"
 #include "types.h"
 #include "surface/mesh.h"
+#include "surface/types.h"
 
 
 
@@ -32,6 +34,45 @@ namespace MR
     {
 
 
+      //! for every voxel intersected by a mesh, the polygons that may intersect it
+      /*! This is stored as a flat compressed table, with voxels sorted by
+       * linear index and the polygons of each voxel in ascending order. */
+      class Voxel2Poly
+      { NOMEMALIGN
+        public:
+          size_t size () const { return voxels.size(); }
+          const Vox& voxel (const size_t i) const { return voxels[i]; }
+          const size_t* begin (const size_t i) const { return polygons.data() + offsets[i]; }
+          const size_t* end   (const size_t i) const { return polygons.data() + offsets[i+1]; }
+
+          //! construct from a list of [linear voxel index, polygon index] pairs
+          /*! The pairs are sorted in place. */
+          void set (vector<std::pair<size_t, size_t>>& pairs, const Header& H)
+          {
+            std::sort (pairs.begin(), pairs.end());
+            voxels.clear();
+            offsets.clear();
+            polygons.clear();
+            polygons.reserve (pairs.size());
+            for (size_t i = 0; i != pairs.size(); ++i) {
+              if (!i || pairs[i].first != pairs[i-1].first) {
+                const size_t index = pairs[i].first;
+                voxels.push_back (Vox (index % H.size(0), (index / H.size(0)) % H.size(1), index / (H.size(0) * H.size(1))));
+                offsets.push_back (polygons.size());
+              }
+              polygons.push_back (pairs[i].second);
+            }
+            offsets.push_back (polygons.size());
+          }
+
+        private:
+          vector<Vox> voxels;
+          vector<size_t> offsets;
+          vector<size_t> polygons;
+      };
+
+
+
       void mesh2image (const Mesh&, Image<float>&);
 
 
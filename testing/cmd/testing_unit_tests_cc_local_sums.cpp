@@ -0,0 +1,203 @@
+/* Copyright (c) 2008-2024 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#include "command.h"
+#include "header.h"
+#include "image.h"
+#include "algo/loop.h"
+#include "math/rng.h"
+#include "registration/metric/cc_helper.h"
+
+using namespace MR;
+using namespace App;
+using Registration::Metric::cc_sums_type;
+
+void usage ()
+{
+  AUTHOR = "J-Donald Tournier (jdtournier@gmail.com)";
+  SYNOPSIS = "Verify the local cross-correlation sums against a direct sum over each neighbourhood";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+// direct sum over the neighbourhood of each voxel, truncated at the image boundary:
+cc_sums_type brute_force (Image<float>& im1, Image<float>& im2, Image<bool>& mask1, Image<bool>& mask2,
+                          const vector<size_t>& extent, const ssize_t x, const ssize_t y, const ssize_t z)
+{
+  const ssize_t position[] = { x, y, z };
+  ssize_t from[3], to[3];
+  for (size_t axis = 0; axis < 3; ++axis) {
+    const ssize_t radius = (extent[axis]-1)/2;
+    from[axis] = std::max (position[axis] - radius, ssize_t(0));
+    to[axis] = std::min (position[axis] + radius, ssize_t (im1.size (axis)) - 1);
+  }
+  cc_sums_type sums = cc_sums_type::Zero();
+  for (im1.index(2) = from[2]; im1.index(2) <= to[2]; ++im1.index(2)) {
+    for (im1.index(1) = from[1]; im1.index(1) <= to[1]; ++im1.index(1)) {
+      for (im1.index(0) = from[0]; im1.index(0) <= to[0]; ++im1.index(0)) {
+        assign_pos_of (im1).to (im2);
+        if (mask1.valid()) {
+          assign_pos_of (im1).to (mask1);
+          if (!mask1.value())
+            continue;
+        }
+        if (mask2.valid()) {
+          assign_pos_of (im1).to (mask2);
+          if (!mask2.value())
+            continue;
+        }
+        const default_type v1 = im1.value(), v2 = im2.value();
+        if (std::isnan (v1) || std::isnan (v2))
+          continue;
+        sums += (cc_sums_type() << 1.0, v1, v2, v1*v1, v2*v2, v1*v2).finished();
+      }
+    }
+  }
+  return sums;
+}
+
+
+
+void test (Image<float>& im1, Image<float>& im2, Image<bool>& mask1, Image<bool>& mask2,
+           const vector<size_t>& extent, const std::string& msg, vector<std::string>& failed_tests)
+{
+  const std::string label = msg + ", extent " + str(extent[0]) + "," + str(extent[1]) + "," + str(extent[2]);
+
+  // sums computed incrementally, checked against the direct sums, with the
+  // tolerance relative to the magnitude of the terms summed:
+  size_t num_visited = 0, num_errors = 0;
+  default_type max_error = 0.0;
+  ssize_t expected = 0;
+  bool in_order = true;
+  Registration::Metric::cc_local_sums (im1, im2, mask1, mask2, extent,
+      [&] (const ssize_t x, const ssize_t y, const ssize_t z, const cc_sums_type& sums) {
+        if (x + im1.size(0) * (y + im1.size(1) * z) != expected++)
+          in_order = false;
+        ++num_visited;
+        const cc_sums_type reference = brute_force (im1, im2, mask1, mask2, extent, x, y, z);
+        for (size_t n = 0; n < 6; ++n) {
+          const default_type error = std::abs (sums[n] - reference[n]) / std::max (1.0, std::abs (reference[n]));
+          max_error = std::max (max_error, error);
+          if (error > 1.0e-10)
+            ++num_errors;
+        }
+      });
+
+  if (num_visited != size_t (voxel_count (im1)) || !in_order)
+    failed_tests.push_back (label + ": " + str(num_visited) + " voxels visited" + (in_order ? "" : " out of order")
+                            + " (expected " + str(voxel_count (im1)) + ")");
+  if (num_errors)
+    failed_tests.push_back (label + ": " + str(num_errors) + " sums differ from direct computation (maximum relative error " + str(max_error) + ")");
+
+  // the statistics computed by cc_precompute() for the nonlinear CC metric,
+  // against centred sums computed directly:
+  auto A = Image<default_type>::scratch (im1);
+  auto B = Image<default_type>::scratch (im1);
+  auto C = Image<default_type>::scratch (im1);
+  auto meansubtr1 = Image<default_type>::scratch (im1);
+  auto meansubtr2 = Image<default_type>::scratch (im1);
+  {
+    LogLevelLatch log_level (0);
+    Registration::Metric::cc_precompute (im1, im2, mask1, mask2, A, B, C, meansubtr1, meansubtr2, extent);
+  }
+  num_errors = 0;
+  for (auto l = Loop (A) (A, B, C, meansubtr1, meansubtr2); l; ++l) {
+    const cc_sums_type sums = brute_force (im1, im2, mask1, mask2, extent, A.index(0), A.index(1), A.index(2));
+    if (sums[0] == 0.0) {
+      if (!std::isnan (A.value()) || !std::isnan (B.value()) || !std::isnan (C.value()) || !std::isnan (meansubtr1.value()) || !std::isnan (meansubtr2.value()))
+        ++num_errors;
+      continue;
+    }
+    const default_type m1 = sums[1] / sums[0], m2 = sums[2] / sums[0];
+    const default_type var1 = sums[3] / sums[0] - m1*m1, var2 = sums[4] / sums[0] - m2*m2;
+    const default_type tolerance = 1.0e-6 * sums[0] * (std::abs (var1) + std::abs (var2) + 1.0);
+    assign_pos_of (A).to (im1, im2);
+    const default_type v1 = im1.value(), v2 = im2.value();
+    if (std::abs (B.value() - sums[0] * var1) > tolerance ||
+        std::abs (C.value() - sums[0] * var2) > tolerance ||
+        (B.value() && C.value() && std::abs (A.value() - (sums[5] - sums[0] * m1 * m2)) > tolerance) ||
+        (!std::isnan (v1) && !std::isnan (v2) &&
+          (std::abs (meansubtr1.value() - (v1 - m1)) > 1.0e-6 || std::abs (meansubtr2.value() - (v2 - m2)) > 1.0e-6)))
+      ++num_errors;
+  }
+  if (num_errors)
+    failed_tests.push_back (label + ": " + str(num_errors) + " voxels with incorrect statistics from cc_precompute()");
+}
+
+
+
+void run ()
+{
+  vector<std::string> failed_tests;
+  Math::RNG::Normal<float> normal;
+  Math::RNG::Uniform<float> uniform;
+
+  Header H;
+  H.ndim() = 3;
+  H.size(0) = 12;
+  H.size(1) = 10;
+  H.size(2) = 9;
+  H.spacing(0) = H.spacing(1) = H.spacing(2) = 1.0;
+  H.transform().setIdentity();
+
+  auto im1 = Image<float>::scratch (H, "first test image");
+  auto im2 = Image<float>::scratch (H, "second test image");
+  auto mask1 = Image<bool>::scratch (H, "first test mask");
+  auto mask2 = Image<bool>::scratch (H, "second test mask");
+  Image<bool> no_mask;
+
+  // intensities with a large offset relative to their variation, to expose
+  // any accumulation of rounding errors in the running sums:
+  for (auto l = Loop (im1) (im1, im2, mask1, mask2); l; ++l) {
+    im1.value() = 1000.0 + normal();
+    im2.value() = 0.5 * im1.value() + normal();
+    mask1.value() = uniform() > 0.2;
+    mask2.value() = uniform() > 0.2;
+  }
+
+  // neighbourhoods with no extent along z (rz = 0), larger than the image,
+  // and anisotropic:
+  const vector<vector<size_t>> extents = { { 3, 3, 3 }, { 1, 1, 1 }, { 5, 3, 1 }, { 3, 5, 7 }, { 25, 21, 19 } };
+
+  for (const auto& extent : extents) {
+    test (im1, im2, no_mask, no_mask, extent, "no mask", failed_tests);
+    test (im1, im2, mask1, no_mask, extent, "first mask", failed_tests);
+    test (im1, im2, no_mask, mask2, extent, "second mask", failed_tests);
+    test (im1, im2, mask1, mask2, extent, "both masks", failed_tests);
+  }
+
+  // NaNs in either image, including whole slices, so that some
+  // neighbourhoods contain no valid voxels:
+  for (auto l = Loop (im1) (im1, im2); l; ++l) {
+    if (uniform() < 0.1 || im1.index(2) == 4)
+      im1.value() = NaN;
+    if (uniform() < 0.1 || im2.index(2) == 5)
+      im2.value() = NaN;
+  }
+  for (const auto& extent : extents) {
+    test (im1, im2, no_mask, no_mask, extent, "NaN values", failed_tests);
+    test (im1, im2, mask1, mask2, extent, "NaN values, both masks", failed_tests);
+  }
+
+  if (failed_tests.size()) {
+    Exception e (str(failed_tests.size()) + " tests of local cross-correlation sums failed:");
+    for (auto s : failed_tests)
+      e.push_back (s);
+    throw e;
+  }
+}
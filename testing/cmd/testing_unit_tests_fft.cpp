@@ -0,0 +1,127 @@
+/* Copyright (c) 2008-2024 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#include "command.h"
+#include "math/fft.h"
+#include "math/rng.h"
+
+using namespace MR;
+using namespace App;
+
+void usage ()
+{
+  AUTHOR = "J-Donald Tournier (jdtournier@gmail.com)";
+  SYNOPSIS = "Verify the batched FFT against a direct computation of the DFT";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+// direct O(N^2) DFT of each row, in double precision:
+template <class ArrayType>
+Eigen::Array<cdouble, Eigen::Dynamic, Eigen::Dynamic> dft (const ArrayType& data, const bool inverse)
+{
+  const ssize_t n = data.cols();
+  Eigen::Array<cdouble, Eigen::Dynamic, Eigen::Dynamic> result (data.rows(), n);
+  for (ssize_t b = 0; b < data.rows(); ++b) {
+    for (ssize_t k = 0; k < n; ++k) {
+      cdouble sum (0.0, 0.0);
+      for (ssize_t j = 0; j < n; ++j)
+        sum += cdouble (data(b,j)) * std::polar (1.0, (inverse ? 2.0 : -2.0) * Math::pi * ((j*k) % n) / double(n));
+      result(b,k) = inverse ? sum / double(n) : sum;
+    }
+  }
+  return result;
+}
+
+
+
+template <class ArrayType>
+double max_error (const ArrayType& result, const Eigen::Array<cdouble, Eigen::Dynamic, Eigen::Dynamic>& reference)
+{
+  double error = 0.0, scale = 0.0;
+  for (ssize_t b = 0; b < result.rows(); ++b) {
+    for (ssize_t k = 0; k < result.cols(); ++k) {
+      error = std::max (error, std::abs (cdouble (result(b,k)) - reference(b,k)));
+      scale = std::max (scale, std::abs (reference(b,k)));
+    }
+  }
+  return error / scale;
+}
+
+
+
+template <typename ValueType>
+void test (const size_t n, const double tolerance, vector<std::string>& failed_tests)
+{
+  using FFT = Math::BatchFFT<ValueType>;
+  Math::RNG::Normal<ValueType> normal;
+  const std::string msg = (std::is_same<ValueType,float>::value ? "float32" : "float64") + std::string (", N = ") + str(n);
+
+  // use an odd number of lines, to exercise the unpaired line in the real transform:
+  const ssize_t batch = 7;
+  typename FFT::array_type data (batch, n);
+  typename FFT::real_array_type real (batch, n);
+  for (ssize_t b = 0; b < batch; ++b) {
+    for (size_t k = 0; k < n; ++k) {
+      data(b,k) = typename FFT::complex_type (normal(), normal());
+      real(b,k) = normal();
+    }
+  }
+
+  FFT fft (n);
+  // the transform should be unaffected by copying, or by a previous size:
+  FFT copy (fft), assigned (n+1);
+  assigned = fft;
+
+  typename FFT::array_type result = data;
+  fft.forward (result);
+  double error = max_error (result, dft (data, false));
+  if (error > tolerance)
+    failed_tests.push_back (msg + ": forward transform differs from DFT (relative error " + str(error) + ")");
+
+  result = data;
+  assigned.inverse (result);
+  error = max_error (result, dft (data, true));
+  if (error > tolerance)
+    failed_tests.push_back (msg + ": inverse transform differs from DFT (relative error " + str(error) + ")");
+
+  copy.forward (real, result);
+  error = max_error (result, dft (real, false));
+  if (error > tolerance)
+    failed_tests.push_back (msg + ": real forward transform differs from DFT (relative error " + str(error) + ")");
+}
+
+
+
+void run ()
+{
+  vector<std::string> failed_tests;
+
+  // powers of 2 & 4, radices 3, 5 & 7 alone & mixed, and a larger prime:
+  for (const size_t n : { 1, 2, 4, 8, 16, 64, 3, 9, 5, 25, 7, 49, 6, 12, 30, 60, 90, 105, 210, 97 }) {
+    test<float> (n, 1.0e-5, failed_tests);
+    test<double> (n, 1.0e-12, failed_tests);
+  }
+
+  if (failed_tests.size()) {
+    Exception e (str(failed_tests.size()) + " tests of batched FFT failed:");
+    for (auto s : failed_tests)
+      e.push_back (s);
+    throw e;
+  }
+}
@@ -0,0 +1,131 @@
+/* Copyright (c) 2008-2024 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#include "command.h"
+#include "header.h"
+#include "image.h"
+#include "algo/histogram.h"
+#include "algo/loop.h"
+#include "math/rng.h"
+
+using namespace MR;
+using namespace App;
+
+void usage ()
+{
+  AUTHOR = "J-Donald Tournier (jdtournier@gmail.com)";
+  SYNOPSIS = "Verify that single-pass histogram generation matches separate calibration and binning";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+Header make_header ()
+{
+  Header H;
+  H.ndim() = 3;
+  H.size(0) = 64;
+  H.size(1) = 48;
+  H.size(2) = 40;
+  H.spacing(0) = H.spacing(1) = H.spacing(2) = 1.0;
+  H.transform().setIdentity();
+  return H;
+}
+
+
+
+void compare (const Algo::Histogram::Data& single, const Algo::Histogram::Data& reference,
+              const size_t max_difference, const std::string& msg, vector<std::string>& failed_tests)
+{
+  const auto& a = single.get_calibration();
+  const auto& b = reference.get_calibration();
+  if (a.get_min() != b.get_min() || a.get_max() != b.get_max() ||
+      a.get_num_bins() != b.get_num_bins() || a.get_bin_width() != b.get_bin_width()) {
+    failed_tests.push_back (msg + ": calibration differs (min " + str(a.get_min()) + " vs " + str(b.get_min())
+                            + ", max " + str(a.get_max()) + " vs " + str(b.get_max())
+                            + ", bins " + str(a.get_num_bins()) + " vs " + str(b.get_num_bins()) + ")");
+    return;
+  }
+  if (single.pdf().sum() != reference.pdf().sum()) {
+    failed_tests.push_back (msg + ": total count " + str(single.pdf().sum()) + " vs " + str(reference.pdf().sum()));
+    return;
+  }
+  size_t difference = 0;
+  for (size_t n = 0; n != single.size(); ++n)
+    difference += std::max (single[n], reference[n]) - std::min (single[n], reference[n]);
+  if (difference > max_difference)
+    failed_tests.push_back (msg + ": " + str(difference) + " values binned differently (maximum " + str(max_difference) + ")");
+}
+
+
+
+template <class ImageType>
+void test (ImageType& image, Image<bool>& mask, const size_t num_bins, const bool ignore_zero,
+           const size_t max_difference, const std::string& msg, vector<std::string>& failed_tests)
+{
+  Algo::Histogram::Calibrator calibrator (num_bins, ignore_zero);
+  Algo::Histogram::calibrate (calibrator, image, mask);
+  const auto reference = Algo::Histogram::generate (calibrator, image, mask);
+  const auto single = Algo::Histogram::generate (image, mask, num_bins, ignore_zero);
+  compare (single, reference, max_difference, msg, failed_tests);
+}
+
+
+
+void run ()
+{
+  vector<std::string> failed_tests;
+  Header H = make_header();
+  Math::RNG::Normal<default_type> normal;
+  Math::RNG::Integer<int> integer (200);
+
+  auto floats = Image<float>::scratch (H, "floating-point test data");
+  auto integers = Image<int32_t>::scratch (H, "integer test data");
+  auto mask = Image<bool>::scratch (H, "test mask");
+  Image<bool> no_mask;
+  const size_t num_voxels = voxel_count (floats);
+  // values within one fine bin (at most 1/128 of a bin) of a bin boundary
+  //   may be counted in the adjacent bin, each contributing twice to the
+  //   difference between the histograms:
+  const size_t tolerance = num_voxels / 64;
+
+  for (auto l = Loop (floats) (floats, integers, mask); l; ++l) {
+    floats.value() = 1000.0 * normal() + 50.0;
+    integers.value() = integer();
+    mask.value() = normal() > 0.0;
+  }
+  test (floats, no_mask, 100, false, tolerance, "normal data, 100 bins", failed_tests);
+  test (floats, no_mask, 0, false, tolerance, "normal data, automatic bins", failed_tests);
+  test (floats, mask, 100, false, tolerance, "normal data, 100 bins, masked", failed_tests);
+  test (integers, no_mask, 50, false, 0, "integer data, 50 bins", failed_tests);
+  test (integers, no_mask, 0, false, 0, "integer data, automatic bins", failed_tests);
+  test (integers, mask, 0, true, 0, "integer data, automatic bins, masked, ignoring zero", failed_tests);
+
+  // values far from zero relative to their range, quantised by the
+  //   floating-point precision, with many zeros
+  for (auto l = Loop (floats) (floats); l; ++l)
+    floats.value() = normal() > 0.0 ? 1.0e6 + normal() : 0.0;
+  test (floats, no_mask, 100, true, 0, "offset data, 100 bins, ignoring zero", failed_tests);
+  test (floats, no_mask, 0, true, 0, "offset data, automatic bins, ignoring zero", failed_tests);
+
+  if (failed_tests.size()) {
+    Exception e (str(failed_tests.size()) + " tests of single-pass histogram generation failed:");
+    for (auto s : failed_tests)
+      e.push_back (s);
+    throw e;
+  }
+}
@@ -0,0 +1,153 @@
+/* Copyright (c) 2008-2024 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#include "command.h"
+#include "math/quantile_sketch.h"
+#include "math/rng.h"
+
+using namespace MR;
+using namespace App;
+using Math::QuantileSketch;
+
+void usage ()
+{
+  AUTHOR = "J-Donald Tournier (jdtournier@gmail.com)";
+  SYNOPSIS = "Verify the rank error of quantiles estimated using QuantileSketch";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+// the largest difference between the requested rank and the range of ranks
+// of the estimated value in the sorted data, as a fraction of the number of values:
+default_type rank_error (const QuantileSketch& sketch, const vector<QuantileSketch::value_type>& sorted)
+{
+  default_type error = 0.0;
+  for (default_type q = 0.01; q < 1.0; q += 0.01) {
+    const auto value = sketch.quantile (q);
+    const default_type lower = std::lower_bound (sorted.begin(), sorted.end(), value) - sorted.begin();
+    const default_type upper = std::upper_bound (sorted.begin(), sorted.end(), value) - sorted.begin();
+    const default_type target = q * sorted.size();
+    if (target < lower)
+      error = std::max (error, lower - target);
+    else if (target > upper)
+      error = std::max (error, target - upper);
+  }
+  return error / sorted.size();
+}
+
+
+
+void check (const QuantileSketch& sketch, vector<QuantileSketch::value_type> values, const default_type tolerance,
+            const std::string& msg, vector<std::string>& failed_tests)
+{
+  if (sketch.size() != values.size()) {
+    failed_tests.push_back (msg + ": sketch holds " + str(sketch.size()) + " values (expected " + str(values.size()) + ")");
+    return;
+  }
+  std::sort (values.begin(), values.end());
+  const default_type error = rank_error (sketch, values);
+  if (error > tolerance)
+    failed_tests.push_back (msg + ": rank error " + str(error) + " (maximum " + str(tolerance) + ")");
+}
+
+
+
+void run ()
+{
+  vector<std::string> failed_tests;
+  Math::RNG::Normal<QuantileSketch::value_type> normal;
+  Math::RNG::Integer<int> integer (100);
+
+  vector<QuantileSketch::value_type> values;
+  auto fill = [&] (QuantileSketch& sketch, size_t num, bool integers) {
+    for (size_t n = 0; n < num; ++n) {
+      const QuantileSketch::value_type value = integers ? integer() : normal();
+      sketch (value);
+      values.push_back (value);
+    }
+  };
+
+  {
+    QuantileSketch sketch;
+    if (!std::isnan (sketch.quantile (0.5)))
+      failed_tests.push_back ("empty sketch: median should be NaN");
+    fill (sketch, 1000, false);
+    // no compaction has occurred yet:
+    check (sketch, values, 0.0, "1000 values", failed_tests);
+  }
+
+  // the rank error is of the order of 1/k; this is the maximum over all
+  // percentiles, so allow some margin over the typical error:
+  for (const size_t k : { size_t(2048), size_t(256), size_t(64) }) {
+    const default_type tolerance = 3.0 / k;
+    const std::string size = "k = " + str(k) + ", ";
+
+    values.clear();
+    QuantileSketch sketch (k);
+    fill (sketch, 1000000, false);
+    check (sketch, values, tolerance, size + "1000000 normal values", failed_tests);
+
+    values.clear();
+    QuantileSketch sorted (k);
+    for (size_t n = 0; n < 1000000; ++n) {
+      sorted (n);
+      values.push_back (n);
+    }
+    check (sorted, values, tolerance, size + "1000000 values in increasing order", failed_tests);
+
+    values.clear();
+    QuantileSketch ties (k);
+    fill (ties, 1000000, true);
+    check (ties, values, tolerance, size + "1000000 integer values", failed_tests);
+
+    // sketches of very different sizes, and so with different numbers of
+    // levels, merged into both the larger & the smaller one:
+    values.clear();
+    QuantileSketch large (k), medium (k), small (k), single (k);
+    fill (large, 1000000, false);
+    fill (medium, 10000, false);
+    fill (small, 100, false);
+    fill (single, 1, false);
+    QuantileSketch into_small (small);
+    into_small.merge (large);
+    into_small.merge (single);
+    into_small.merge (medium);
+    check (into_small, values, tolerance, size + "uneven sketches merged into smallest", failed_tests);
+    large.merge (medium);
+    large.merge (small);
+    large.merge (single);
+    check (large, values, tolerance, size + "uneven sketches merged into largest", failed_tests);
+
+    // many partial sketches of uneven sizes, as accumulated by different threads:
+    values.clear();
+    QuantileSketch total (k);
+    for (size_t n = 0; n < 50; ++n) {
+      QuantileSketch partial (k);
+      fill (partial, (n+1) * (n+1) * 100, false);
+      total.merge (partial);
+    }
+    check (total, values, tolerance, size + "50 partial sketches merged", failed_tests);
+  }
+
+  if (failed_tests.size()) {
+    Exception e (str(failed_tests.size()) + " tests of quantile sketch failed:");
+    for (auto s : failed_tests)
+      e.push_back (s);
+    throw e;
+  }
+}
@@ -0,0 +1,170 @@
+/* Copyright (c) 2008-2024 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#include <atomic>
+
+#include "command.h"
+#include "thread.h"
+#include "math/rng.h"
+#include "misc/union_find.h"
+
+using namespace MR;
+using namespace App;
+
+void usage ()
+{
+  AUTHOR = "J-Donald Tournier (jdtournier@gmail.com)";
+  SYNOPSIS = "Verify the sets formed by the UnionFind class, with merges performed sequentially or concurrently";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+using pair_type = std::pair<UnionFind::index_type, UnionFind::index_type>;
+
+
+
+// the lowest element of the set to which each element belongs, by repeated
+// relabelling until no further change occurs:
+vector<size_t> reference_labels (const size_t num, const vector<pair_type>& pairs)
+{
+  vector<size_t> labels (num);
+  for (size_t i = 0; i != num; ++i)
+    labels[i] = i;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (const auto& p : pairs) {
+      const size_t lowest = std::min (labels[p.first], labels[p.second]);
+      for (auto i : { p.first, p.second }) {
+        if (labels[i] != lowest) {
+          labels[i] = lowest;
+          changed = true;
+        }
+      }
+    }
+    for (size_t i = 0; i != num; ++i) {
+      if (labels[labels[i]] != labels[i]) {
+        labels[i] = labels[labels[i]];
+        changed = true;
+      }
+    }
+  }
+  return labels;
+}
+
+
+
+void check (UnionFind& forest, const vector<size_t>& labels, const std::string& msg, vector<std::string>& failed_tests)
+{
+  size_t num_errors = 0;
+  for (size_t i = 0; i != forest.size(); ++i) {
+    if (forest.find (i) != labels[i] || forest.is_root (i) != (labels[i] == i))
+      ++num_errors;
+  }
+  if (num_errors)
+    failed_tests.push_back (msg + ": " + str(num_errors) + " elements assigned to the wrong set");
+}
+
+
+
+class Merger { NOMEMALIGN
+  public:
+    Merger (UnionFind& forest, const vector<pair_type>& pairs, std::atomic<size_t>& next, std::atomic<size_t>& num_merged) :
+        forest (forest), pairs (pairs), next (next), num_merged (num_merged) { }
+
+    void execute () {
+      size_t i;
+      while ((i = next++) < pairs.size())
+        if (forest.merge (pairs[i].first, pairs[i].second))
+          ++num_merged;
+    }
+
+  private:
+    UnionFind& forest;
+    const vector<pair_type>& pairs;
+    std::atomic<size_t>& next;
+    std::atomic<size_t>& num_merged;
+};
+
+
+
+void run ()
+{
+  vector<std::string> failed_tests;
+
+  {
+    UnionFind forest (5);
+    size_t num_errors = 0;
+    for (UnionFind::index_type i = 0; i != 5; ++i)
+      if (!forest.is_root (i) || forest.find (i) != i)
+        ++num_errors;
+    if (num_errors)
+      failed_tests.push_back ("initial state: elements do not each form their own set");
+    if (!forest.merge (3, 1) || !forest.merge (4, 3) || forest.merge (1, 4) || forest.merge (4, 4))
+      failed_tests.push_back ("small set: merge() reported incorrectly whether the sets differed");
+    check (forest, { 0, 1, 2, 1, 1 }, "small set", failed_tests);
+    forest.reset();
+    check (forest, { 0, 1, 2, 3, 4 }, "small set after reset", failed_tests);
+  }
+
+  try {
+    UnionFind forest (size_t(std::numeric_limits<UnionFind::index_type>::max()) + 1);
+    failed_tests.push_back ("too many elements: no exception thrown");
+  }
+  catch (Exception&) { }
+
+  // random pairs, few enough to leave many sets of different sizes:
+  const size_t num = 100000;
+  Math::RNG::Integer<UnionFind::index_type> random (num-1);
+  vector<pair_type> pairs (num * 9 / 10);
+  for (auto& p : pairs)
+    p = { random(), random() };
+  const auto labels = reference_labels (num, pairs);
+  size_t num_sets = 0;
+  for (size_t i = 0; i != num; ++i)
+    num_sets += (labels[i] == i);
+
+  {
+    UnionFind forest (num);
+    size_t num_merged = 0;
+    for (const auto& p : pairs)
+      num_merged += forest.merge (p.first, p.second);
+    check (forest, labels, "sequential merges", failed_tests);
+    if (num_merged != num - num_sets)
+      failed_tests.push_back ("sequential merges: " + str(num_merged) + " merges reported (expected " + str(num - num_sets) + ")");
+  }
+
+  // the same merges performed concurrently, repeatedly to improve the
+  // chances of exercising contended updates:
+  for (size_t repeat = 0; repeat != 10; ++repeat) {
+    UnionFind forest (num);
+    std::atomic<size_t> next (0), num_merged (0);
+    Merger merger (forest, pairs, next, num_merged);
+    Thread::run (Thread::multi (merger), "union-find merges").wait();
+    check (forest, labels, "concurrent merges", failed_tests);
+    if (num_merged != num - num_sets)
+      failed_tests.push_back ("concurrent merges: " + str(size_t(num_merged)) + " merges reported (expected " + str(num - num_sets) + ")");
+  }
+
+  if (failed_tests.size()) {
+    Exception e (str(failed_tests.size()) + " tests of union-find failed:");
+    for (auto s : failed_tests)
+      e.push_back (s);
+    throw e;
+  }
+}
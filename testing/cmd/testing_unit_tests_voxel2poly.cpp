@@ -0,0 +1,118 @@
+/* Copyright (c) 2008-2024 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#include <map>
+#include <set>
+
+#include "command.h"
+#include "header.h"
+#include "math/rng.h"
+#include "surface/algo/mesh2image.h"
+
+using namespace MR;
+using namespace App;
+using Surface::Algo::Voxel2Poly;
+
+void usage ()
+{
+  AUTHOR = "J-Donald Tournier (jdtournier@gmail.com)";
+  SYNOPSIS = "Verify the compressed voxel-to-polygon table used in mesh2image";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+void check (const Voxel2Poly& table, const std::map<size_t, std::set<size_t>>& reference, const Header& H,
+            const std::string& msg, vector<std::string>& failed_tests)
+{
+  if (table.size() != reference.size()) {
+    failed_tests.push_back (msg + ": " + str(table.size()) + " voxels in table (expected " + str(reference.size()) + ")");
+    return;
+  }
+  size_t i = 0, num_errors = 0;
+  for (const auto& entry : reference) {
+    // voxels in order of linear index, with their position decoded:
+    const size_t index = entry.first;
+    const Surface::Vox& vox (table.voxel (i));
+    if (vox[0] != ssize_t (index % H.size(0)) || vox[1] != ssize_t ((index / H.size(0)) % H.size(1)) || vox[2] != ssize_t (index / (H.size(0) * H.size(1))))
+      ++num_errors;
+    // polygons in ascending order:
+    if (size_t (table.end(i) - table.begin(i)) != entry.second.size() || !std::equal (table.begin(i), table.end(i), entry.second.begin()))
+      ++num_errors;
+    ++i;
+  }
+  if (num_errors)
+    failed_tests.push_back (msg + ": " + str(num_errors) + " incorrect entries in table");
+}
+
+
+
+void run ()
+{
+  vector<std::string> failed_tests;
+
+  Header H;
+  H.ndim() = 3;
+  H.size(0) = 17;
+  H.size(1) = 13;
+  H.size(2) = 11;
+  const size_t num_voxels = H.size(0) * H.size(1) * H.size(2);
+
+  Voxel2Poly table;
+  vector<std::pair<size_t, size_t>> pairs;
+  std::map<size_t, std::set<size_t>> reference;
+
+  table.set (pairs, H);
+  check (table, reference, H, "empty table", failed_tests);
+
+  // a single polygon spanning the first & last voxels:
+  pairs = { { num_voxels-1, 0 }, { 0, 0 } };
+  reference = { { 0, { 0 } }, { num_voxels-1, { 0 } } };
+  table.set (pairs, H);
+  check (table, reference, H, "single polygon", failed_tests);
+
+  // each polygon mapping to a few voxels near some random location, so that
+  // many voxels are shared, with the pairs out of order as produced by
+  // multiple threads:
+  Math::RNG::Integer<size_t> voxel (num_voxels-1), offset (30);
+  for (size_t num_polygons : { 100, 10000 }) {
+    pairs.clear();
+    reference.clear();
+    for (size_t p = 0; p != num_polygons; ++p) {
+      const size_t centre = voxel();
+      std::set<size_t> voxels;
+      for (size_t n = 0; n != 8; ++n)
+        voxels.insert (std::min (centre + offset(), num_voxels-1));
+      for (auto v : voxels) {
+        pairs.push_back ({ v, p });
+        reference[v].insert (p);
+      }
+    }
+    std::reverse (pairs.begin(), pairs.end());
+    std::rotate (pairs.begin(), pairs.begin() + pairs.size()/3, pairs.end());
+    // the table is reused, so must not retain any previous contents:
+    table.set (pairs, H);
+    check (table, reference, H, str(num_polygons) + " polygons", failed_tests);
+  }
+
+  if (failed_tests.size()) {
+    Exception e (str(failed_tests.size()) + " tests of voxel-to-polygon table failed:");
+    for (auto s : failed_tests)
+      e.push_back (s);
+    throw e;
+  }
+}